@@ -9,6 +9,7 @@ static void signal (struct intq *q, struct thread **waiter);
 /* Initializes interrupt queue Q. */
 void
 intq_init (struct intq *q) {
+	spinlock_init (&q->spin, "intq");
 	lock_init (&q->lock);
 	q->not_full = q->not_empty = NULL;
 	q->head = q->tail = 0;
@@ -37,16 +38,23 @@ intq_getc (struct intq *q) {
 	uint8_t byte;
 
 	ASSERT (intr_get_level () == INTR_OFF);
+	spinlock_acquire (&q->spin);
 	while (intq_empty (q)) {
 		ASSERT (!intr_context ());
+		spinlock_release (&q->spin);
 		lock_acquire (&q->lock);
-		wait (q, &q->not_empty);
+		spinlock_acquire (&q->spin);
+		if (intq_empty (q))
+			wait (q, &q->not_empty);
+		spinlock_release (&q->spin);
 		lock_release (&q->lock);
+		spinlock_acquire (&q->spin);
 	}
 
 	byte = q->buf[q->tail];
 	q->tail = next (q->tail);
 	signal (q, &q->not_full);
+	spinlock_release (&q->spin);
 	return byte;
 }
 
@@ -57,16 +65,23 @@ intq_getc (struct intq *q) {
 void
 intq_putc (struct intq *q, uint8_t byte) {
 	ASSERT (intr_get_level () == INTR_OFF);
+	spinlock_acquire (&q->spin);
 	while (intq_full (q)) {
 		ASSERT (!intr_context ());
+		spinlock_release (&q->spin);
 		lock_acquire (&q->lock);
-		wait (q, &q->not_full);
+		spinlock_acquire (&q->spin);
+		if (intq_full (q))
+			wait (q, &q->not_full);
+		spinlock_release (&q->spin);
 		lock_release (&q->lock);
+		spinlock_acquire (&q->spin);
 	}
 
 	q->buf[q->head] = byte;
 	q->head = next (q->head);
 	signal (q, &q->not_empty);
+	spinlock_release (&q->spin);
 }
 
 /* Returns the position after POS within an intq. */
@@ -76,25 +91,26 @@ next (int pos) {
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member.  Waits until the given condition is true.  Q's spin
+   lock must be held; it is released while waiting. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) {
+wait (struct intq *q, struct thread **waiter) {
 	ASSERT (!intr_context ());
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	ASSERT ((waiter == &q->not_empty && intq_empty (q))
 			|| (waiter == &q->not_full && intq_full (q)));
 
 	*waiter = thread_current ();
-	thread_block ();
+	thread_block_locked (&q->spin);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
    member, and the associated condition must be true.  If a
    thread is waiting for the condition, wakes it up and resets
-   the waiting thread. */
+   the waiting thread.  Q's spin lock must be held. */
 static void
-signal (struct intq *q UNUSED, struct thread **waiter) {
-	ASSERT (intr_get_level () == INTR_OFF);
+signal (struct intq *q, struct thread **waiter) {
+	ASSERT (spinlock_held_by_current_cpu (&q->spin));
 	ASSERT ((waiter == &q->not_empty && !intq_empty (q))
 			|| (waiter == &q->not_full && !intq_full (q)));
 
@@ -0,0 +1,183 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC of the processor.  See [IA32-v3a] chapter 10
+   "Advanced Programmable Interrupt Controller (APIC)".
+
+   The registers are memory mapped at LAPIC_PHYS.  Every register
+   is 32 bits wide and sits on a 16-byte boundary. */
+#define LAPIC_PHYS 0xfee00000
+
+/* Register offsets. */
+#define LAPIC_ID       0x020    /* Local APIC ID. */
+#define LAPIC_EOI      0x0b0    /* End of interrupt. */
+#define LAPIC_SVR      0x0f0    /* Spurious interrupt vector. */
+#define LAPIC_ICR_LO   0x300    /* Interrupt command, low half. */
+#define LAPIC_ICR_HI   0x310    /* Interrupt command, high half. */
+#define LAPIC_LVT_TMR  0x320    /* LVT timer. */
+#define LAPIC_TMR_INIT 0x380    /* Timer initial count. */
+#define LAPIC_TMR_CUR  0x390    /* Timer current count. */
+#define LAPIC_TMR_DIV  0x3e0    /* Timer divide configuration. */
+
+#define SVR_ENABLE 0x100        /* APIC software enable. */
+#define LVT_MASKED 0x10000      /* Interrupt masked. */
+#define LVT_PERIODIC 0x20000    /* Timer mode: periodic. */
+#define TMR_DIV_16 0x3          /* Divide the bus clock by 16. */
+
+/* Interrupt command register bits. */
+#define ICR_FIXED 0x00000       /* Delivery mode: fixed vector. */
+#define ICR_INIT 0x00500        /* Delivery mode: INIT. */
+#define ICR_STARTUP 0x00600     /* Delivery mode: STARTUP. */
+#define ICR_PENDING 0x01000     /* Delivery status: send pending. */
+#define ICR_ASSERT 0x04000      /* Level: assert. */
+
+/* CPUID.1:EDX bit that reports an on-chip local APIC. */
+#define CPUID_APIC (1 << 9)
+
+/* Kernel virtual address of the register page, or NULL if the
+   local APIC has not been initialized. */
+static volatile uint32_t *lapic;
+
+static uint32_t
+lapic_read (int reg) {
+	return lapic[reg / 4];
+}
+
+static void
+lapic_write (int reg, uint32_t value) {
+	lapic[reg / 4] = value;
+	(void) lapic_read (LAPIC_ID);   /* Wait for the write to finish. */
+}
+
+/* Maps the local APIC's registers uncached into the kernel's
+   address space and software-enables the APIC.  Returns false if
+   the processor has no local APIC. */
+bool
+lapic_init (void) {
+	uint32_t eax = 1, ebx, ecx = 0, edx;
+	uint64_t *pte;
+
+	if (lapic != NULL)
+		return true;
+
+	asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if ((edx & CPUID_APIC) == 0)
+		return false;
+
+	pte = pml4e_walk (base_pml4, (uint64_t) ptov (LAPIC_PHYS), 1);
+	if (pte == NULL)
+		return false;
+	*pte = LAPIC_PHYS | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+	lapic = ptov (LAPIC_PHYS);
+
+	lapic_init_ap ();
+	return true;
+}
+
+/* Software-enables the running processor's local APIC, with its
+   timer masked.  Every processor has its own local APIC at the
+   same address, so lapic_init() must have mapped it already. */
+void
+lapic_init_ap (void) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+	lapic_write (LAPIC_LVT_TMR, LVT_MASKED);
+	lapic_write (LAPIC_TMR_DIV, TMR_DIV_16);
+}
+
+/* Returns true if lapic_init() has succeeded. */
+bool
+lapic_enabled (void) {
+	return lapic != NULL;
+}
+
+/* Returns the local APIC ID of the running processor. */
+uint32_t
+lapic_id (void) {
+	ASSERT (lapic != NULL);
+	return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being serviced. */
+void
+lapic_eoi (void) {
+	ASSERT (lapic != NULL);
+	lapic_write (LAPIC_EOI, 0);
+}
+
+/* Arms the local APIC timer to raise interrupt VEC once, after
+   COUNT ticks of the divided bus clock.  Replaces any pending
+   one-shot. */
+void
+lapic_timer_oneshot (uint8_t vec, uint32_t count) {
+	ASSERT (lapic != NULL);
+	ASSERT (count > 0);
+
+	lapic_write (LAPIC_LVT_TMR, vec);
+	lapic_write (LAPIC_TMR_INIT, count);
+}
+
+/* Programs the local APIC timer to raise interrupt VEC every
+   COUNT ticks of the divided bus clock. */
+void
+lapic_timer_periodic (uint8_t vec, uint32_t count) {
+	ASSERT (lapic != NULL);
+	ASSERT (count > 0);
+
+	lapic_write (LAPIC_LVT_TMR, vec | LVT_PERIODIC);
+	lapic_write (LAPIC_TMR_INIT, count);
+}
+
+/* Cancels the pending one-shot, if any. */
+void
+lapic_timer_stop (void) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_LVT_TMR, LVT_MASKED);
+	lapic_write (LAPIC_TMR_INIT, 0);
+}
+
+/* Returns the number of ticks left before the pending one-shot
+   fires, or 0 if it has already fired. */
+uint32_t
+lapic_timer_count (void) {
+	ASSERT (lapic != NULL);
+	return lapic_read (LAPIC_TMR_CUR);
+}
+
+/* Sends interrupt command LO to the processor whose local APIC ID
+   is APIC_ID and waits until it has been accepted for delivery. */
+static void
+lapic_send (uint32_t apic_id, uint32_t lo) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_ICR_HI, apic_id << 24);
+	lapic_write (LAPIC_ICR_LO, lo);
+	while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+		asm volatile ("pause");
+}
+
+/* Sends an INIT IPI, which resets processor APIC_ID into the
+   wait-for-SIPI state. */
+void
+lapic_send_init (uint32_t apic_id) {
+	lapic_send (apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+/* Sends a STARTUP IPI, which starts processor APIC_ID in real mode
+   at physical address PAGE * 4 kB. */
+void
+lapic_send_startup (uint32_t apic_id, uint8_t page) {
+	lapic_send (apic_id, ICR_STARTUP | ICR_ASSERT | page);
+}
+
+/* Raises interrupt VEC on processor APIC_ID. */
+void
+lapic_send_ipi (uint32_t apic_id, uint8_t vec) {
+	lapic_send (apic_id, ICR_FIXED | ICR_ASSERT | vec);
+}
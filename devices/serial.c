@@ -5,6 +5,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -54,6 +55,10 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Serializes access to the UART's registers, and moving bytes
+   from TXQ to the port, between CPUs. */
+static struct spinlock serial_lock = SPINLOCK_INITIALIZER ("serial");
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -88,7 +93,9 @@ serial_init_queue (void) {
 	intr_register_ext (0x20 + 4, serial_interrupt, "serial");
 	mode = QUEUE;
 	old_level = intr_disable ();
+	spinlock_acquire (&serial_lock);
 	write_ier ();
+	spinlock_release (&serial_lock);
 	intr_set_level (old_level);
 }
 
@@ -102,7 +109,9 @@ serial_putc (uint8_t byte) {
 		   use dumb polling to transmit a byte. */
 		if (mode == UNINIT)
 			init_poll ();
+		spinlock_acquire (&serial_lock);
 		putc_poll (byte);
+		spinlock_release (&serial_lock);
 	} else {
 		/* Otherwise, queue a byte and update the interrupt enable
 		   register. */
@@ -111,12 +120,18 @@ serial_putc (uint8_t byte) {
 			   If we wanted to wait for the queue to empty,
 			   we'd have to reenable interrupts.
 			   That's impolite, so we'll send a character via
-			   polling instead. */
-			putc_poll (intq_getc (&txq));
+			   polling instead.  Another CPU may have drained
+			   the queue meanwhile, so check again. */
+			spinlock_acquire (&serial_lock);
+			if (!intq_empty (&txq))
+				putc_poll (intq_getc (&txq));
+			spinlock_release (&serial_lock);
 		}
 
 		intq_putc (&txq, byte);
+		spinlock_acquire (&serial_lock);
 		write_ier ();
+		spinlock_release (&serial_lock);
 	}
 
 	intr_set_level (old_level);
@@ -127,8 +142,10 @@ serial_putc (uint8_t byte) {
 void
 serial_flush (void) {
 	enum intr_level old_level = intr_disable ();
+	spinlock_acquire (&serial_lock);
 	while (!intq_empty (&txq))
 		putc_poll (intq_getc (&txq));
+	spinlock_release (&serial_lock);
 	intr_set_level (old_level);
 }
 
@@ -139,8 +156,11 @@ serial_flush (void) {
 void
 serial_notify (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	if (mode == QUEUE)
+	if (mode == QUEUE) {
+		spinlock_acquire (&serial_lock);
 		write_ier ();
+		spinlock_release (&serial_lock);
+	}
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -162,12 +182,12 @@ set_serial (int bps) {
 	outb (LCR_REG, LCR_N81);
 }
 
-/* Update interrupt enable register. */
+/* Update interrupt enable register.  serial_lock must be held. */
 static void
 write_ier (void) {
 	uint8_t ier = 0;
 
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&serial_lock));
 
 	/* Enable transmit interrupt if we have any characters to
 	   transmit. */
@@ -183,10 +203,10 @@ write_ier (void) {
 }
 
 /* Polls the serial port until it's ready,
-   and then transmits BYTE. */
+   and then transmits BYTE.  serial_lock must be held. */
 static void
 putc_poll (uint8_t byte) {
-	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&serial_lock));
 
 	while ((inb (LSR_REG) & LSR_THRE) == 0)
 		continue;
@@ -207,9 +227,11 @@ serial_interrupt (struct intr_frame *f UNUSED) {
 
 	/* As long as we have a byte to transmit, and the hardware is
 	   ready to accept a byte for transmission, transmit a byte. */
+	spinlock_acquire (&serial_lock);
 	while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
 		outb (THR_REG, intq_getc (&txq));
 
 	/* Update interrupt enable register based on queue status. */
 	write_ier ();
+	spinlock_release (&serial_lock);
 }
@@ -3,10 +3,13 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,17 +20,64 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Advanced by the
+   bootstrap processor's timer interrupt. */
 static int64_t ticks;
 
-/* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
-static unsigned loops_per_tick;
+/* The time stamp counter, measured against the 8254 by
+   timer_calibrate().  timer_ns() converts TSC cycles to
+   nanoseconds by multiplying by TSC_MULT, a 32.32 fixed-point
+   number, and counts from NS_AT_CALIBRATION, the time at which the
+   TSC read TSC_AT_CALIBRATION.  Until then, TSC_MULT is 0 and
+   timer_ns() only has tick resolution. */
+#define NS_PER_SEC 1000000000
+#define NS_PER_TICK (NS_PER_SEC / TIMER_FREQ)
+static uint64_t tsc_per_sec;        /* TSC cycles per second. */
+static uint64_t tsc_mult;           /* Nanoseconds per cycle, << 32. */
+static uint64_t tsc_at_calibration;
+static int64_t ns_at_calibration;
+
+/* If false (default), the 8254 interrupts every tick.
+   If true, the local APIC timer is programmed one-shot for the
+   next deadline, so it stops ticking while the idle thread runs
+   and sub-tick sleeps block instead of spinning.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Local APIC one-shot state, all in units of local APIC timer
+   counts.  LAPIC_CLOCK is the count at which the pending one-shot
+   was armed with LAPIC_ARMED counts, so the current time is
+   LAPIC_CLOCK plus the counts consumed since then. */
+#define CALIBRATE_TICKS 10      /* PIT ticks to calibrate over. */
+static bool lapic_mode;         /* Ticks come from the local APIC? */
+static uint64_t lapic_per_tick; /* Local APIC counts per timer tick. */
+static uint64_t lapic_clock;    /* Counts elapsed when last armed. */
+static uint32_t lapic_armed;    /* Length of the pending one-shot. */
+static uint64_t next_tick_at;   /* Count at which the next tick is due. */
+static bool idle_stretched;     /* One-shot stretched for idle? */
+
+/* Threads in timer_usleep() or timer_nsleep() for less than a
+   tick, ordered by deadline. */
+static struct list hr_sleepers;
+
+/* One thread in a sub-tick sleep. */
+struct hr_sleeper {
+	struct list_elem elem;      /* List element. */
+	uint64_t deadline;          /* Local APIC count to wake up at. */
+	struct semaphore sema;      /* Upped at the deadline. */
+};
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
-static void busy_wait (int64_t loops);
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func lapic_tick_interrupt;
+static void timer_tick (void);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void lapic_timer_calibrate (void);
+static uint64_t lapic_now (void);
+static void lapic_rearm (void);
+static bool hr_sleep (int64_t num, int32_t denom);
+static bool hr_less (const struct list_elem *, const struct list_elem *,
+		void *aux);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -45,29 +95,109 @@ timer_init (void) {
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Measures the rate of the time stamp counter, which drives
+   timer_ns() and brief delays. */
 void
 timer_calibrate (void) {
-	unsigned high_bit, test_bit;
+	uint64_t tsc_start;
+	int64_t start;
 
 	ASSERT (intr_get_level () == INTR_ON);
 	printf ("Calibrating timer...  ");
 
-	/* Approximate loops_per_tick as the largest power-of-two
-	   still less than one timer tick. */
-	loops_per_tick = 1u << 10;
-	while (!too_many_loops (loops_per_tick << 1)) {
-		loops_per_tick <<= 1;
-		ASSERT (loops_per_tick != 0);
-	}
+	/* Count cycles over CALIBRATE_TICKS ticks, starting on a tick
+	   boundary. */
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	tsc_start = rdtsc ();
+	start = ticks;
+	while (ticks - start < CALIBRATE_TICKS)
+		barrier ();
+	tsc_per_sec = (rdtsc () - tsc_start) * TIMER_FREQ / CALIBRATE_TICKS;
+	ASSERT (tsc_per_sec > 0);
+
+	tsc_at_calibration = tsc_start;
+	ns_at_calibration = start * NS_PER_TICK;
+	barrier ();
+	tsc_mult = ((uint64_t) NS_PER_SEC << 32) / tsc_per_sec;
+
+	printf ("%'"PRIu64" TSC cycles/s.\n", tsc_per_sec);
+
+	if (timer_tickless)
+		lapic_timer_calibrate ();
+}
+
+/* Initializes the local APIC and measures its timer against the
+   8254, if not done yet.  Returns false if there is no local
+   APIC. */
+bool
+timer_lapic_init (void) {
+	uint32_t left;
+	int64_t start;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	if (lapic_per_tick > 0)
+		return true;
+	if (!lapic_init ())
+		return false;
+	intr_register_ext (LAPIC_TICK_VEC, lapic_tick_interrupt,
+			"Local APIC Tick");
+
+	/* Count down from the maximum over CALIBRATE_TICKS ticks,
+	   starting on a tick boundary. */
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	lapic_timer_oneshot (LAPIC_TIMER_VEC, UINT32_MAX);
+	start = ticks;
+	while (ticks - start < CALIBRATE_TICKS)
+		barrier ();
+	left = lapic_timer_count ();
+	lapic_timer_stop ();
+	lapic_per_tick = (UINT32_MAX - left) / CALIBRATE_TICKS;
+	ASSERT (lapic_per_tick > 0);
+	return true;
+}
+
+/* Starts the periodic tick of an application processor.  Only the
+   bootstrap processor advances the system tick count; the others
+   just need their own time slices. */
+void
+timer_start_ap (void) {
+	ASSERT (lapic_per_tick > 0);
+
+	lapic_timer_periodic (LAPIC_TICK_VEC, lapic_per_tick);
+}
+
+/* Hands the timer tick over to the local APIC in one-shot mode and
+   masks the 8254's IRQ 0.  Leaves the 8254 in charge if there is
+   no local APIC. */
+static void
+lapic_timer_calibrate (void) {
+	enum intr_level old_level;
 
-	/* Refine the next 8 bits of loops_per_tick. */
-	high_bit = loops_per_tick;
-	for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-		if (!too_many_loops (high_bit | test_bit))
-			loops_per_tick |= test_bit;
+	ASSERT (intr_get_level () == INTR_ON);
+	if (!timer_lapic_init ()) {
+		printf ("No local APIC, tickless mode disabled.\n");
+		timer_tickless = false;
+		return;
+	}
+	list_init (&hr_sleepers);
+	intr_register_ext (LAPIC_TIMER_VEC, lapic_timer_interrupt,
+			"Local APIC Timer");
+
+	old_level = intr_disable ();
+	outb (0x21, inb (0x21) | 0x01);     /* Mask IRQ 0 on the master PIC. */
+	lapic_mode = true;
+	lapic_clock = 0;
+	lapic_armed = 0;
+	next_tick_at = lapic_per_tick;
+	lapic_rearm ();
+	intr_set_level (old_level);
 
-	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+	printf ("Tickless timer: %'"PRIu64" local APIC counts/tick.\n",
+			lapic_per_tick);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -87,6 +217,23 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since the OS booted, from the
+   time stamp counter once timer_calibrate() has run.  Cheap
+   enough to call from any context, including interrupt handlers
+   and with interrupts off.  The TSC is assumed to run at a
+   constant rate and in step on all CPUs, as it does on current
+   processors and under QEMU. */
+int64_t
+timer_ns (void) {
+	uint64_t mult = tsc_mult;
+
+	barrier ();
+	if (mult == 0)
+		return timer_ticks () * NS_PER_TICK;
+	return ns_at_calibration + (int64_t) (((unsigned __int128)
+				(rdtsc () - tsc_at_calibration) * mult) >> 32);
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void
 timer_sleep (int64_t duration) {
@@ -96,6 +243,34 @@ timer_sleep (int64_t duration) {
 	thread_sleep (start + duration);
 }
 
+/* Called by the idle thread, with interrupts off, right before it
+   halts.  In tickless mode, stretches the pending one-shot so that
+   no interrupt arrives before the next sleeping thread is due. */
+void
+timer_idle_enter (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (lapic_mode && cpu_current () == &cpus[0]) {
+		idle_stretched = true;
+		lapic_rearm ();
+	}
+}
+
+/* Called by the idle thread, with interrupts off, once it is
+   woken up.  If an interrupt other than the timer ended the idle
+   period, shortens the one-shot back to the next tick so that the
+   woken thread gets its time slice; ticks that passed while idle
+   are accounted for when it fires. */
+void
+timer_idle_exit (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (lapic_mode && idle_stretched && cpu_current () == &cpus[0]) {
+		idle_stretched = false;
+		lapic_rearm ();
+	}
+}
+
 /* Suspends execution for approximately MS milliseconds. */
 void
 timer_msleep (int64_t ms) {
@@ -123,7 +298,54 @@ timer_print_stats (void) {
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
-	ticks++;
+	__atomic_add_fetch (&ticks, 1, __ATOMIC_SEQ_CST);
+	timer_tick ();
+}
+
+/* Local APIC timer interrupt handler.  Accounts for every tick
+   that passed since the one-shot was armed, wakes sub-tick
+   sleepers that are due, and arms the next deadline. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED) {
+	uint64_t now = lapic_now ();
+
+	idle_stretched = false;
+	while (now >= next_tick_at) {
+		next_tick_at += lapic_per_tick;
+		__atomic_add_fetch (&ticks, 1, __ATOMIC_SEQ_CST);
+		timer_tick ();
+	}
+
+	while (!list_empty (&hr_sleepers)) {
+		struct hr_sleeper *s =
+			list_entry (list_front (&hr_sleepers), struct hr_sleeper, elem);
+		if (s->deadline > now)
+			break;
+		list_pop_front (&hr_sleepers);
+		sema_up (&s->sema);
+	}
+
+	lapic_rearm ();
+}
+
+/* Periodic tick of an application processor. */
+static void
+lapic_tick_interrupt (struct intr_frame *args UNUSED) {
+	struct cpu *cpu = cpu_current ();
+
+	cpu->ticks++;
+	thread_tick ();
+	if (thread_mlfqs) {
+		increase_recent_cpu ();
+		if (cpu->ticks % 4 == 0)
+			refresh_priority ();
+	}
+}
+
+/* Work done on every timer tick, whichever timer delivers it. */
+static void
+timer_tick (void) {
+	cpus[0].ticks++;
 	thread_tick ();
 	thread_wakeup (ticks);
 
@@ -141,37 +363,6 @@ timer_interrupt (struct intr_frame *args UNUSED) {
 	}
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
-static bool
-too_many_loops (unsigned loops) {
-	/* Wait for a timer tick. */
-	int64_t start = ticks;
-	while (ticks == start)
-		barrier ();
-
-	/* Run LOOPS loops. */
-	start = ticks;
-	busy_wait (loops);
-
-	/* If the tick count changed, we iterated too long. */
-	barrier ();
-	return start != ticks;
-}
-
-/* Iterates through a simple loop LOOPS times, for implementing
-   brief delays.
-
-   Marked NO_INLINE because code alignment can significantly
-   affect timings, so that if this function was inlined
-   differently in different places the results would be difficult
-   to predict. */
-static void NO_INLINE
-busy_wait (int64_t loops) {
-	while (loops-- > 0)
-		barrier ();
-}
-
 /* Sleep for approximately NUM/DENOM seconds. */
 static void
 real_time_sleep (int64_t num, int32_t denom) {
@@ -189,11 +380,97 @@ real_time_sleep (int64_t num, int32_t denom) {
 		   timer_sleep() because it will yield the CPU to other
 		   processes. */
 		timer_sleep (ticks);
-	} else {
-		/* Otherwise, use a busy-wait loop for more accurate
-		   sub-tick timing.  We scale the numerator and denominator
-		   down by 1000 to avoid the possibility of overflow. */
-		ASSERT (denom % 1000 == 0);
-		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+	} else if (!lapic_mode || !hr_sleep (num, denom)) {
+		/* Unless the local APIC can interrupt us in the middle of
+		   a tick, spin on the time stamp counter for more
+		   accurate sub-tick timing.  NUM / DENOM is under a tick,
+		   so the product cannot overflow. */
+		uint64_t start = rdtsc ();
+		uint64_t cycles = tsc_per_sec * num / denom;
+
+		while (rdtsc () - start < cycles)
+			barrier ();
+	}
+}
+
+/* Returns the number of local APIC counts elapsed since the
+   local APIC took over the timer tick.  Interrupts must be off. */
+static uint64_t
+lapic_now (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (lapic_armed == 0)
+		return lapic_clock;
+	return lapic_clock + (lapic_armed - lapic_timer_count ());
+}
+
+/* Arms the one-shot for the earliest of the next tick and the
+   first sub-tick sleeper.  While the idle thread has stretched
+   the one-shot, ticks that have no sleeping thread to wake are
+   skipped. */
+static void
+lapic_rearm (void) {
+	uint64_t now = lapic_now ();
+	uint64_t deadline = next_tick_at;
+	uint64_t count;
+
+	if (idle_stretched) {
+		int64_t wakeup = thread_next_wakeup ();
+		uint64_t skipped = wakeup == INT64_MAX
+			? UINT32_MAX / lapic_per_tick
+			: (uint64_t) (wakeup > ticks + 1 ? wakeup - ticks - 1 : 0);
+		deadline += skipped * lapic_per_tick;
+	}
+	if (!list_empty (&hr_sleepers)) {
+		struct hr_sleeper *s =
+			list_entry (list_front (&hr_sleepers), struct hr_sleeper, elem);
+		if (s->deadline < deadline)
+			deadline = s->deadline;
 	}
-}
\ No newline at end of file
+
+	count = deadline > now ? deadline - now : 1;
+	if (count > UINT32_MAX)
+		count = UINT32_MAX;
+	lapic_clock = now;
+	lapic_armed = count;
+	lapic_timer_oneshot (LAPIC_TIMER_VEC, count);
+}
+
+/* Blocks for approximately NUM/DENOM seconds, which is less than
+   one tick, using a local APIC one-shot deadline.  The one-shot
+   and HR_SLEEPERS belong to the bootstrap processor's local APIC,
+   so returns false, without sleeping, on any other CPU. */
+static bool
+hr_sleep (int64_t num, int32_t denom) {
+	struct hr_sleeper s;
+	enum intr_level old_level;
+
+	/* Scale down by 1000 to avoid overflow, as busy_wait() does. */
+	ASSERT (denom % 1000 == 0);
+	uint64_t counts = lapic_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000);
+	if (counts == 0)
+		return true;
+
+	sema_init (&s.sema, 0);
+	old_level = intr_disable ();
+	if (cpu_current () != &cpus[0]) {
+		intr_set_level (old_level);
+		return false;
+	}
+	s.deadline = lapic_now () + counts;
+	list_insert_ordered (&hr_sleepers, &s.elem, hr_less, NULL);
+	lapic_rearm ();
+	intr_set_level (old_level);
+
+	sema_down (&s.sema);
+	return true;
+}
+
+/* Orders sub-tick sleepers by deadline. */
+static bool
+hr_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct hr_sleeper *a = list_entry (a_, struct hr_sleeper, elem);
+	const struct hr_sleeper *b = list_entry (b_, struct hr_sleeper, elem);
+
+	return a->deadline < b->deadline;
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
 
 /* VGA text screen support.  See [FREEVGA] for more information. */
@@ -25,6 +26,9 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Protects the cursor and the framebuffer between CPUs. */
+static struct spinlock vga_lock = SPINLOCK_INITIALIZER ("vga");
+
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -48,9 +52,11 @@ init (void) {
 void
 vga_putc (int c) {
 	/* Disable interrupts to lock out interrupt handlers
-	   that might write to the console. */
+	   that might write to the console, and take the lock to
+	   lock out other CPUs. */
 	enum intr_level old_level = intr_disable ();
 
+	spinlock_acquire (&vga_lock);
 	init ();
 
 	switch (c) {
@@ -88,6 +94,7 @@ vga_putc (int c) {
 	/* Update cursor position. */
 	move_cursor ();
 
+	spinlock_release (&vga_lock);
 	intr_set_level (old_level);
 }
 
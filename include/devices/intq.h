@@ -2,6 +2,7 @@
 #define DEVICES_INTQ_H
 
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 
 /* An "interrupt queue", a circular buffer shared between
@@ -9,7 +10,9 @@
 
    Interrupt queue functions can be called from kernel threads or
    from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
+   interrupts must be off in either case.  Each queue also has a
+   spin lock, which keeps out threads and interrupt handlers on
+   other CPUs.
 
    The interrupt queue has the structure of a "monitor".  Locks
    and condition variables from threads/synch.h cannot be used in
@@ -22,6 +25,8 @@
 
 /* A circular queue of bytes. */
 struct intq {
+	struct spinlock spin;       /* Protects the rest. */
+
 	/* Waiting threads. */
 	struct lock lock;           /* Only one thread may wait at once. */
 	struct thread *not_full;    /* Thread waiting for not-full condition. */
@@ -0,0 +1,30 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  Vectors
+   0x30...0x3f are handled as external interrupts, like the PIC's
+   0x20...0x2f, but are acknowledged on the local APIC. */
+#define LAPIC_TIMER_VEC 0x30            /* Local APIC timer. */
+#define LAPIC_TICK_VEC 0x31             /* Periodic tick of an AP. */
+#define LAPIC_RESCHED_VEC 0x32          /* Reschedule IPI. */
+#define LAPIC_SPURIOUS_VEC 0x3f         /* Spurious interrupts. */
+
+bool lapic_init (void);
+void lapic_init_ap (void);
+bool lapic_enabled (void);
+uint32_t lapic_id (void);
+void lapic_eoi (void);
+
+void lapic_timer_oneshot (uint8_t vec, uint32_t count);
+void lapic_timer_periodic (uint8_t vec, uint32_t count);
+void lapic_timer_stop (void);
+uint32_t lapic_timer_count (void);
+
+void lapic_send_init (uint32_t apic_id);
+void lapic_send_startup (uint32_t apic_id, uint8_t page);
+void lapic_send_ipi (uint32_t apic_id, uint8_t vec);
+
+#endif /* devices/lapic.h */
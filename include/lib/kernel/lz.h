@@ -0,0 +1,33 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression of small blocks, such as pages.
+ *
+ * A byte-oriented format, quick to compress and decompress
+ * rather than tight.  Output is a sequence of groups of a flag
+ * byte followed by eight items, the Nth a literal byte if bit N
+ * of the flag is clear, or a match if it is set.  A match is two
+ * little-endian bytes: 4 bits of length less LZ_MIN_MATCH above
+ * 12 bits of backward offset, and one more byte of length if
+ * those 4 bits are all set.  Offsets of 12 bits limit blocks to
+ * LZ_MAX_SIZE bytes.
+ *
+ * The compressor finds matches through a hash table that the
+ * caller provides, so that it allocates no memory and callers
+ * with tables of their own may compress at the same time. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MAX_SIZE 4096        /* Largest block. */
+#define LZ_TABLE_SIZE 1024      /* Entries in the hash table. */
+
+/* Most bytes that compressing SIZE bytes can produce. */
+#define LZ_BOUND(SIZE) ((SIZE) + ((SIZE) + 7) / 8)
+
+size_t lz_compress (const void *src, size_t size, void *dst, size_t dst_max,
+		uint16_t table[LZ_TABLE_SIZE]);
+bool lz_decompress (const void *src, size_t src_len, void *dst, size_t size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,72 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+ *
+ * A mergeable max-heap: the element at the top is one that no
+ * other element is greater than, according to the heap's
+ * comparison function.  Insertion, merging two heaps and
+ * increasing an element's key take O(1) time; removing the
+ * maximum or any other element takes O(lg n) amortized time.
+ *
+ * Like lists and hash tables, pairing heaps do not allocate
+ * memory.  Each structure that can be in a heap embeds a struct
+ * pheap_elem member, and pheap_entry converts a struct
+ * pheap_elem back to the structure that contains it.  Refer to
+ * lib/kernel/list.h for a detailed explanation.
+ *
+ * The heap order is only maintained through its operations.  If
+ * an element's key grows while it is in a heap, call
+ * pheap_increase() on it; if it shrinks, remove the element and
+ * insert it again. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct pheap_elem {
+	struct pheap_elem *child;   /* First (leftmost) child. */
+	struct pheap_elem *next;    /* Next sibling. */
+	struct pheap_elem *prev;    /* Previous sibling, or parent if
+	                               this is its first child. */
+};
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+ * the structure that PHEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) (PHEAP_ELEM)             \
+		- offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+		const struct pheap_elem *b,
+		void *aux);
+
+/* Pairing heap. */
+struct pheap {
+	struct pheap_elem *root;    /* Maximum element, or NULL. */
+	size_t elem_cnt;            /* Number of elements in heap. */
+	pheap_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+/* Insertion, deletion. */
+void pheap_insert (struct pheap *, struct pheap_elem *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_pop_max (struct pheap *);
+void pheap_increase (struct pheap *, struct pheap_elem *);
+void pheap_merge (struct pheap *, struct pheap *);
+
+/* Information. */
+struct pheap_elem *pheap_max (struct pheap *);
+size_t pheap_size (struct pheap *);
+bool pheap_empty (struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
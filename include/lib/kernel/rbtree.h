@@ -0,0 +1,70 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree: insertion and removal take
+ * O(lg n) time, and the least element is cached so that finding
+ * it takes O(1).  Elements that compare equal are kept in the
+ * order they were inserted.
+ *
+ * Like lists and hash tables, red-black trees do not allocate
+ * memory.  Each structure that can be in a tree embeds a struct
+ * rbtree_elem member, and rbtree_entry converts a struct
+ * rbtree_elem back to the structure that contains it.  Refer to
+ * lib/kernel/list.h for a detailed explanation.
+ *
+ * An element's key must not change while it is in a tree;
+ * remove the element, change the key, and insert it again. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rbtree_elem {
+	struct rbtree_elem *parent; /* Parent, or NULL for the root. */
+	struct rbtree_elem *left;   /* Left child, or NULL. */
+	struct rbtree_elem *right;  /* Right child, or NULL. */
+	bool red;                   /* Red or black? */
+};
+
+/* Converts pointer to tree element RBTREE_ELEM into a pointer to
+ * the structure that RBTREE_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the tree element. */
+#define rbtree_entry(RBTREE_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) (RBTREE_ELEM)              \
+		- offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rbtree_less_func (const struct rbtree_elem *a,
+		const struct rbtree_elem *b,
+		void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+	struct rbtree_elem *root;   /* Root, or NULL if empty. */
+	struct rbtree_elem *min;    /* Least element, or NULL if empty. */
+	size_t elem_cnt;            /* Number of elements in tree. */
+	rbtree_less_func *less;     /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rbtree_init (struct rbtree *, rbtree_less_func *, void *aux);
+
+/* Insertion, deletion. */
+void rbtree_insert (struct rbtree *, struct rbtree_elem *);
+void rbtree_remove (struct rbtree *, struct rbtree_elem *);
+
+/* Traversal. */
+struct rbtree_elem *rbtree_min (struct rbtree *);
+struct rbtree_elem *rbtree_next (struct rbtree_elem *);
+
+/* Information. */
+size_t rbtree_size (struct rbtree *);
+bool rbtree_empty (struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
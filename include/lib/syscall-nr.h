@@ -36,6 +36,11 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extensions. */
+	SYS_CLOCK_GETTIME,          /* Read a clock. */
+	SYS_FUTEX_WAIT,             /* Wait on a word of a mapped file. */
+	SYS_FUTEX_WAKE,             /* Wake waiters on such a word. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -20,6 +20,15 @@ typedef int off_t;
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Clocks for clock_gettime(). */
+#define CLOCK_MONOTONIC 1       /* Time since boot, never set back. */
+
+/* A time, as read by clock_gettime(). */
+struct timespec {
+	long long tv_sec;           /* Seconds. */
+	long tv_nsec;               /* Nanoseconds, 0 to 999,999,999. */
+};
+
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
@@ -50,6 +59,11 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Extensions. */
+int clock_gettime (int clock, struct timespec *);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
@@ -0,0 +1,71 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 8
+
+/* Physical address that application processors start executing
+   at, in real mode.  Must be page aligned and below 1 MB. */
+#define AP_TRAMPOLINE 0x8000
+
+/* Offsets of the members of struct cpu used by syscall-entry.S. */
+#define CPU_SCRATCH 0
+#define CPU_TSS 16
+
+#ifndef __ASSEMBLER__
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+
+/* A CPU's run queue: EDF threads by deadline, ahead of one FIFO
+   queue per priority level, or of FAIR under -fair.  Bit P of
+   MASK is set iff QUEUES[P] is non-empty.  LOCK protects the rest
+   of the run queue, and is held across every thread switch on its
+   CPU. */
+struct runqueue {
+	struct spinlock lock;
+	struct pheap edf;           /* EDF threads, earliest deadline on top. */
+	struct list queues[PRI_MAX + 1];
+	uint64_t mask;
+	struct rbtree fair;         /* -fair threads by virtual runtime. */
+	int64_t min_vruntime;       /* Floor of FAIR's virtual runtimes. */
+	size_t cnt;                 /* # of threads in EDF and the rest. */
+};
+
+/* Per-CPU state.  A running thread finds its CPU through its
+   `cpu' member, which is only stable while interrupts are off. */
+struct cpu {
+	/* Used by syscall-entry.S; keep in sync with CPU_*. */
+	uint64_t scratch[2];        /* Saved user registers. */
+	struct task_state *tss;     /* This CPU's TSS. */
+
+	int id;                     /* Index in cpus[]. */
+	uint32_t lapic_id;          /* Local APIC ID. */
+	volatile bool online;       /* Scheduling threads? */
+	struct thread *idle;        /* Idle thread. */
+	struct thread *curr;        /* Running thread. */
+	struct thread *prev;        /* Thread being switched away from. */
+	struct runqueue rq;         /* Ready threads. */
+
+	unsigned thread_ticks;      /* # of timer ticks since last yield. */
+	int64_t ticks;              /* # of local timer ticks. */
+	bool in_external_intr;      /* Processing an external interrupt? */
+	bool yield_on_return;       /* Yield on interrupt return? */
+	struct thread *fpu_owner;   /* Thread whose FPU state is loaded. */
+
+	/* Statistics. */
+	long long idle_ticks;       /* # of timer ticks spent idle. */
+	long long steals;           /* # of threads stolen from others. */
+};
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+struct cpu *cpu_current (void);
+void smp_init (int cpus);
+void cpu_kick (struct cpu *);
+
+#endif /* __ASSEMBLER__ */
+#endif /* threads/cpu.h */
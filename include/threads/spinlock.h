@@ -0,0 +1,37 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cpu;
+struct lockstat;
+
+/* Spin lock.  Unlike struct lock, a spin lock never sleeps, so it
+   may be used from interrupt handlers and by code that runs with
+   interrupts off.  It must only be held with interrupts off, or a
+   timer interrupt could switch threads while it is held. */
+struct spinlock {
+	volatile int locked;        /* 1 while held. */
+	struct cpu *cpu;            /* Holder (for debugging). */
+	const char *name;           /* Name (for debugging and lockstat). */
+	struct lockstat *stat;      /* Statistics, once looked up. */
+	int64_t acquire_ns;         /* When acquired (for lockstat). */
+};
+
+/* Initializer for a spin lock named NAME, for spin locks that may
+   be used before any code could call spinlock_init(). */
+#define SPINLOCK_INITIALIZER(NAME) { 0, NULL, NAME, NULL, 0 }
+
+/* Maximum number of spin lock names that -lockstat tells apart. */
+#define SPINSTAT_MAX 32
+
+void spinlock_init (struct spinlock *, const char *name);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
+struct lockstat *spinlock_stats (size_t *cnt);
+
+#endif /* threads/spinlock.h */
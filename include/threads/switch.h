@@ -0,0 +1,32 @@
+#ifndef THREADS_SWITCH_H
+#define THREADS_SWITCH_H
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+/* switch_threads()'s stack frame: the callee-saved registers,
+   pushed in reverse order, followed by the return address. */
+struct switch_threads_frame {
+	uint64_t r15;               /*  0: Saved %r15. */
+	uint64_t r14;               /*  8: Saved %r14. */
+	uint64_t r13;               /* 16: Saved %r13. */
+	uint64_t r12;               /* 24: Saved %r12. */
+	uint64_t rbx;               /* 32: Saved %rbx. */
+	uint64_t rbp;               /* 40: Saved %rbp. */
+	void (*rip) (void);         /* 48: Return address. */
+};
+
+struct thread;
+
+/* Switches from CUR, which must be the running thread, to NEXT,
+   which must also be running switch_threads(), or be a new thread
+   set up by thread_create() to start in switch_entry(). */
+void switch_threads (struct thread *cur, struct thread *next);
+
+/* Start of a new kernel thread.  Calls the function in %r14 with
+   the arguments in %r12 and %r13, which thread_create() places in
+   the new thread's switch_threads_frame. */
+void switch_entry (void);
+#endif
+
+#endif /* threads/switch.h */
@@ -2,15 +2,51 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <pheap.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* What a struct lockstat counts. */
+enum lockstat_kind {
+	LOCKSTAT_SEMA,              /* Semaphores. */
+	LOCKSTAT_LOCK,              /* Locks. */
+	LOCKSTAT_SPIN,              /* Spin locks. */
+};
+
+/* Contention statistics, kept with -lockstat for all the
+   semaphores, locks or spin locks that share a name. */
+struct lockstat {
+	const char *name;           /* Name of the objects. */
+	enum lockstat_kind kind;    /* Kind of the objects. */
+	long long acquired;         /* # of downs or acquisitions. */
+	long long contended;        /* # of those that had to wait. */
+	int64_t wait_ns;            /* Total nanoseconds spent waiting. */
+	int64_t max_wait_ns;        /* Longest wait, in nanoseconds. */
+	int64_t hold_ns;            /* Total nanoseconds held (locks only). */
+	int64_t max_hold_ns;        /* Longest hold, in nanoseconds. */
+};
+
+/* If true, record contention statistics in struct lockstat.
+   Controlled by kernel command-line option "-lockstat". */
+extern bool lockstat_enabled;
+
+void lockstat_print_stats (void);
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct pheap waiters;       /* Waiting threads, by priority. */
+	const char *name;           /* Name (for lockstat). */
+	struct lockstat *stat;      /* Statistics, once looked up. */
+	bool is_lock;               /* Part of a struct lock? */
 };
 
-void sema_init (struct semaphore *, unsigned value);
+/* Semaphores and locks are named after the expression passed to
+   sema_init() or lock_init(), e.g. "&tid_lock".  Use the _named
+   variants to choose a better name; NAME must stay valid for as
+   long as the kernel runs. */
+#define sema_init(SEMA, VALUE) sema_init_named (SEMA, VALUE, #SEMA)
+void sema_init_named (struct semaphore *, unsigned value, const char *name);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
@@ -20,17 +56,63 @@ void sema_self_test (void);
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct pheap donors;        /* Waiting threads, by priority. */
+	struct pheap_elem elem;     /* Element in holder's `held_locks'. */
+	int64_t acquire_ns;         /* When acquired (for lockstat). */
 };
 
-void lock_init (struct lock *);
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+bool held_lock_less (const struct pheap_elem *, const struct pheap_elem *,
+		void *aux);
+void refresh_donated_priority (struct thread *);
+void synch_requeue_waiter (struct thread *, int old_priority);
+
+/* Reader-writer lock.  Any number of threads may hold it shared,
+   or one thread exclusively.  Once a writer is waiting, new
+   readers wait behind it, and a writer that releases the lock
+   hands it to all waiting readers before the next writer, so
+   neither side starves.  Waiters donate their priority to every
+   current holder. */
+struct rwlock {
+	struct thread *writer;      /* Exclusive holder, or NULL. */
+	unsigned readers;           /* # of shared holders. */
+	struct list holders;        /* struct rwlock_hold of all holders. */
+	struct list read_waiters;   /* Holds waiting for shared access. */
+	struct list write_waiters;  /* Holds waiting for exclusive access. */
+	const char *name;           /* Name (for debugging). */
+};
+
+/* One thread's hold on a rwlock, or its wait for one.  A thread
+   can hold any number of rwlocks at once.  Each thread has
+   RWLOCK_HOLD_SLOTS holds built in, and allocates more with
+   malloc() while it holds that many. */
+#define RWLOCK_HOLD_SLOTS 4
+struct rwlock_hold {
+	struct list_elem elem;      /* Element in rwlock's `holders', or in
+	                               a waiters list while waiting. */
+	struct list_elem thread_elem; /* Element in holder's `rwlock_holds'. */
+	struct rwlock *rwlock;      /* Rwlock held or waited for. */
+	struct thread *thread;      /* Holder, or NULL if unused. */
+};
+
+#define rwlock_init(RWLOCK) rwlock_init_named (RWLOCK, #RWLOCK)
+void rwlock_init_named (struct rwlock *, const char *name);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+bool rwlock_write_held_by_current_thread (const struct rwlock *);
 
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct pheap waiters;       /* Waiting threads, by priority. */
 };
 
 void cond_init (struct condition *);
@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "filesys/file.h"
 #include "threads/interrupt.h"
@@ -11,6 +12,9 @@
 #include "vm/vm.h"
 #endif
 
+struct cpu;
+struct spinlock;
+struct semaphore_elem;
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -84,11 +88,12 @@ typedef int tid_t;
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
+ * the run queue (thread.c), or it can be an element in an rwlock
+ * wait list (synch.c).  It can be used these two ways only
+ * because they are mutually exclusive: only a thread in the
  * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+ * blocked state is on a wait list.  Semaphores keep their
+ * waiters in a priority queue through `sema_elem' instead. */
 struct thread {
 	/* Owned by thread.c. */
 	tid_t tid;                          /* Thread identifier. */
@@ -100,13 +105,46 @@ struct thread {
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 
+	/* Owned by thread.c. */
+	struct cpu *cpu;                    /* CPU running it, or whose
+	                                       run queue it is on. */
+	struct cpu *rq_cpu;                 /* CPU whose run queue it is
+	                                       on, or null. */
+	int rq_priority;                    /* Ready queue it is on. */
+	volatile bool on_cpu;               /* Still on a CPU's stack? */
+
 	/* ************************ Project 1 ************************ */
 	int64_t wakeup_ticks;				/* Wake up Ticks */
+	bool sleeping;						/* On the sleep wheel? */
 	struct lock *wait_on_lock;			/* Information about what thread wait for */
 	int origin_priority;				/* Old priority */
-	struct list donation;				/* Record donated int */
-	struct list_elem donation_elem; 	/* Donation element */
+	struct pheap held_locks;			/* Locks held, by top donor's priority */
+	struct pheap_elem donor_elem;		/* Element in wait_on_lock's donors */
 	int recent_cpu;						/* Estimate of the CPU time the thread has used recently */
+	int64_t decay_epoch;				/* recent_cpu decays applied so far. */
+	struct rwlock *wait_on_rwlock;		/* Rwlock being waited for. */
+	struct semaphore *wait_on_sema;		/* Semaphore being waited for. */
+	struct pheap_elem sema_elem;		/* Element in its waiters. */
+	uint64_t wait_seq;					/* Arrival order among them. */
+	struct semaphore_elem *cond_waiter;	/* Condition variable wait. */
+	struct list rwlock_holds;			/* struct rwlock_hold of rwlocks held. */
+	struct rwlock_hold rwlock_hold_slots[RWLOCK_HOLD_SLOTS]; /* Spare holds. */
+
+	/* Earliest-deadline-first class, in timer ticks.  EDF_PERIOD
+	   is 0 for threads in the priority classes. */
+	int64_t edf_runtime;				/* Budget per period. */
+	int64_t edf_deadline_rel;			/* Deadline, from period start. */
+	int64_t edf_period;					/* Period. */
+	int edf_density;					/* Share of the CPU admitted. */
+	int64_t edf_release;				/* Start of current period. */
+	int64_t edf_deadline;				/* Deadline in current period. */
+	int64_t edf_job_deadline;			/* Deadline of current job. */
+	int64_t edf_used;					/* Budget used this period. */
+	struct pheap_elem edf_elem;			/* Element in run queue's `edf'. */
+
+	/* Completely fair class, under -fair. */
+	int64_t vruntime;					/* CPU time, weighted by nice. */
+	struct rbtree_elem fair_elem;		/* Element in run queue's `fair'. */
 
 	/* ************************ Project 2 ************************ */
 	struct list child_process;
@@ -129,16 +167,19 @@ struct thread {
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+
+	/* Owned by userprog/fpu.c. */
+	uint8_t *fpu;                       /* FPU save area, or NULL. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
 	struct list mmap_info_list;
-	struct list fcfs_cache;
 #endif
 
 	/* Owned by thread.c. */
-	struct intr_frame tf;               /* Information for switching */
+	uint8_t *stack;                     /* Saved stack pointer. */
+	struct intr_frame tf;               /* Frame for entering user mode. */
 	unsigned magic;                     /* Detects stack overflow. */
 };
 
@@ -147,16 +188,27 @@ struct thread {
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler instead of the
+   priority queues.  Controlled by kernel command-line option
+   "-fair". */
+extern bool thread_fair;
+
 void thread_init (void);
 void thread_start (void);
 
+void thread_init_ap (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
+
 void thread_tick (void);
 void thread_print_stats (void);
+size_t thread_cache_trim (size_t max);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_locked (struct spinlock *);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
@@ -167,10 +219,16 @@ void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 void thread_sleep (int64_t);
 void thread_wakeup (int64_t);
+bool thread_sleep_cancel (struct thread *);
+int64_t thread_next_wakeup (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
 
+bool thread_set_edf (int64_t runtime, int64_t deadline, int64_t period);
+void thread_clear_edf (void);
+bool thread_edf_wait (void);
+
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
@@ -180,9 +238,10 @@ void do_iret (struct intr_frame *tf);
 
 /* ************************ Project 1 ************************ */
 typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, struct list *, void *);
 
 void try_yield(void);
-void donate_priority (void);
+void thread_set_effective_priority (struct thread *, int);
 void increase_recent_cpu(void);
 void refresh_recent_cpu(void);
 void refresh_load_avg(void);
@@ -0,0 +1,16 @@
+#ifndef USERPROG_FPU_H
+#define USERPROG_FPU_H
+
+#include <stdbool.h>
+#include "threads/thread.h"
+
+void fpu_init (void);
+void fpu_init_ap (void);
+bool fpu_claim (void);
+void fpu_activate (struct thread *next);
+void fpu_flush (void);
+bool fpu_fork (struct thread *child, const struct thread *parent);
+void fpu_release (void);
+void fpu_print_stats (void);
+
+#endif /* userprog/fpu.h */
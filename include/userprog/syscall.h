@@ -20,7 +20,17 @@ typedef int off_t;
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Clocks for clock_gettime(). */
+#define CLOCK_MONOTONIC 1       /* Time since boot, never set back. */
+
+/* A time, as read by clock_gettime(). */
+struct timespec {
+	long long tv_sec;           /* Seconds. */
+	long tv_nsec;               /* Nanoseconds, 0 to 999,999,999. */
+};
+
 void syscall_init (void);
+void syscall_init_ap (void);
 
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
@@ -41,6 +51,10 @@ void close (int fd);
 int dup2(int oldfd, int newfd);
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 
-struct lock mutex;
+int clock_gettime (int clock, struct timespec *);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+
+extern struct rwlock filesys_lock;
 
 #endif /* userprog/syscall.h */
@@ -4,11 +4,21 @@
 struct page;
 enum vm_type;
 
+/* Most pages read ahead of a swap-in. */
+#define SWAP_READAHEAD 7
+
 struct anon_page {
     struct thread *thread;
+    size_t zswap_idx;       /* First chunk in the compressed pool,
+                               or BITMAP_ERROR if not in it. */
+    size_t zswap_len;       /* Compressed size there. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_print_stats (void);
+void anon_share_swapped (struct page *src, struct page *dst);
+size_t anon_swap_neighbours (struct page *page, struct page **pages, size_t max);
+void anon_swap_flush (void);
 
 #endif
@@ -4,11 +4,22 @@
 #include "vm/vm.h"
 
 struct page;
+struct inode;
+struct supplemental_page_table;
 enum vm_type;
 
+/* A file reopened for one mapping.  The pages of the mapping share
+   it, and the last of them to be destroyed closes it.  Only the
+   process that owns the mapping creates or destroys its pages, so
+   PAGE_CNT needs no lock. */
+struct mmap_file {
+	struct file *file;
+	int page_cnt;               /* Number of pages that refer to it. */
+};
+
 struct file_page {
 	struct page *page;
-	struct file *file;
+	struct mmap_file *mfile;
 	off_t ofs;
 	uint32_t read_bytes;
 	uint32_t length;
@@ -16,7 +27,7 @@ struct file_page {
 };
 
 struct mmap_info {
-	struct file *file;
+	struct mmap_file *mfile;
     off_t ofs;
     uint32_t read_bytes;
 	uint32_t length;
@@ -27,4 +38,9 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool file_backed_attach (struct page *page);
+bool file_backed_copy (struct supplemental_page_table *src_spt,
+		struct page *src);
+void file_backed_free_aux (struct mmap_info *aux);
+struct inode *file_backed_inode (struct page *page, off_t *ofs);
 #endif
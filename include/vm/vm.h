@@ -49,9 +49,9 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
-	struct hash_elem page_elem; /* Hash table element. */
 	size_t bitmap_idx;
 	bool writable;
+	struct list_elem share_elem; /* In its frame's sharers. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -68,8 +68,15 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
-	struct list_elem fcfs_elem;
+	struct page *page;          /* Page in it, or NULL if unowned. */
+	struct thread *owner;       /* Process whose PAGE it is. */
+	bool pinned;                /* Under I/O; not to be evicted. */
+	int share_cnt;              /* Pages mapping it, copy-on-write. */
+	struct list sharers;        /* Those pages other than PAGE. */
+	struct list_elem frame_elem; /* Element in vm.c's frame table. */
+	struct hash_elem ksm_elem;  /* Element in vm.c's merge table. */
+	uint64_t ksm_hash;          /* Hash of contents when listed. */
+	bool ksm_listed;            /* In the merge table? */
 };
 
 /* The function table for page operations.
@@ -89,10 +96,18 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * A radix tree indexed by virtual page number, SPT_BITS bits per
+ * level, with the pages at the last level.  SPT_LEVELS levels
+ * cover every user address, below KERN_BASE. */
+#define SPT_BITS 6
+#define SPT_LEVELS 5
+#define SPT_FANOUT (1 << SPT_BITS)
+struct spt_node {
+	void *slots[SPT_FANOUT];     /* Lower nodes, or pages. */
+};
+
 struct supplemental_page_table {
-	struct hash spt_ht;
+	struct spt_node *root;       /* Null if empty. */
 };
 
 #include "threads/thread.h"
@@ -103,7 +118,13 @@ void supplemental_page_table_kill (struct supplemental_page_table *spt);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_insert_range (struct supplemental_page_table *spt,
+		struct page **pages, size_t cnt);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct page *spt_first_page (struct supplemental_page_table *spt,
+		void *start, void *end);
+void spt_remove_range (struct supplemental_page_table *spt,
+		void *start, void *end);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -113,7 +134,22 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
+struct page *vm_new_page (enum vm_type type, void *upage, bool writable,
+		vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+
+void vm_frame_wait (struct page *page);
+void vm_frame_detach (struct frame *frame);
+bool vm_frame_put (struct frame *frame, struct page *page);
+void vm_frame_free (struct frame *frame);
+bool vm_unmap_victim (struct page *page, struct thread *owner);
+void vm_remap_victim (struct page *page, struct thread *owner);
+void vm_print_stats (void);
+
+extern size_t vm_wmark_low;
+extern size_t vm_wmark_high;
+extern size_t vm_ksm_pages;
+extern int64_t vm_ksm_interval;
 #endif  /* VM_VM_H */
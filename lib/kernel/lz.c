@@ -0,0 +1,128 @@
+/* LZ77 compression of small blocks.
+
+   See lz.h for the format.  The compressor looks up the next
+   LZ_MIN_MATCH bytes in a hash table of the positions where
+   those bytes were last seen, and extends the match at that one
+   position only, so a block is compressed in a single pass. */
+
+#include "lz.h"
+#include <string.h>
+#include "../debug.h"
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15 + 255)
+#define LZ_HASH_BITS 10
+
+static inline unsigned
+lz_hash (const uint8_t *p) {
+	uint32_t v = (uint32_t) p[0] << 16 | p[1] << 8 | p[2];
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the SIZE bytes at SRC into DST, which has room for
+   DST_MAX bytes, using TABLE, whose previous contents do not
+   matter.  Returns the compressed size, or 0 if it would not
+   fit.  LZ_BOUND (SIZE) bytes are always enough. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t dst_max,
+		uint16_t table[LZ_TABLE_SIZE]) {
+	const uint8_t *src = src_;
+	uint8_t *dst = dst_;
+	size_t in = 0, out = 0, flag_pos = 0;
+	int flag_bit = 8;
+
+	ASSERT (size <= LZ_MAX_SIZE);
+	ASSERT (1 << LZ_HASH_BITS == LZ_TABLE_SIZE);
+
+	memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+	while (in < size) {
+		size_t len = 0, ofs = 0;
+
+		if (flag_bit == 8) {
+			if (out >= dst_max)
+				return 0;
+			flag_pos = out++;
+			dst[flag_pos] = 0;
+			flag_bit = 0;
+		}
+
+		if (in + LZ_MIN_MATCH <= size) {
+			unsigned h = lz_hash (src + in);
+			size_t cand = table[h];     /* Position + 1, or 0. */
+
+			table[h] = in + 1;
+			if (cand-- != 0) {
+				ofs = in - cand;
+				while (len < LZ_MAX_MATCH && in + len < size
+						&& src[cand + len] == src[in + len])
+					len++;
+			}
+		}
+
+		if (len >= LZ_MIN_MATCH) {
+			size_t code = len - LZ_MIN_MATCH;
+			uint16_t token = (code < 15 ? code : 15) << 12 | ofs;
+
+			if (out + (code < 15 ? 2 : 3) > dst_max)
+				return 0;
+			dst[flag_pos] |= 1 << flag_bit;
+			dst[out++] = token & 0xff;
+			dst[out++] = token >> 8;
+			if (code >= 15)
+				dst[out++] = code - 15;
+			in += len;
+		} else {
+			if (out >= dst_max)
+				return 0;
+			dst[out++] = src[in++];
+		}
+		flag_bit++;
+	}
+	return out;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC into the SIZE bytes at
+   DST.  Returns false if SRC is corrupt or does not decompress to
+   SIZE bytes. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t size) {
+	const uint8_t *src = src_;
+	uint8_t *dst = dst_;
+	size_t in = 0, out = 0;
+
+	while (out < size) {
+		uint8_t flags;
+
+		if (in >= src_len)
+			return false;
+		flags = src[in++];
+		for (int bit = 0; bit < 8 && out < size; bit++) {
+			if (flags & (1 << bit)) {
+				uint16_t token;
+				size_t len, ofs;
+
+				if (in + 2 > src_len)
+					return false;
+				token = src[in] | src[in + 1] << 8;
+				in += 2;
+				len = (token >> 12) + LZ_MIN_MATCH;
+				ofs = token & 0xfff;
+				if ((token >> 12) == 15) {
+					if (in >= src_len)
+						return false;
+					len += src[in++];
+				}
+				if (ofs == 0 || ofs > out || out + len > size)
+					return false;
+				/* Byte by byte: the match may overlap its copy. */
+				for (; len > 0; len--, out++)
+					dst[out] = dst[out - ofs];
+			} else {
+				if (in >= src_len)
+					return false;
+				dst[out++] = src[in++];
+			}
+		}
+	}
+	return in == src_len;
+}
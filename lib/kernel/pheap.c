@@ -0,0 +1,190 @@
+/* Pairing heap.
+
+   See pheap.h for basic information.  The heap is a tree in
+   which no child is greater than its parent, stored as a list of
+   children per node.  Removing the root melds its children in
+   pairs from left to right, then melds the pairs together from
+   right to left, which is what makes the amortized bound
+   logarithmic.  See M. L. Fredman et al., "The Pairing Heap: A
+   New Form of Self-Adjusting Heap", Algorithmica 1 (1986). */
+
+#include "pheap.h"
+#include "../debug.h"
+
+static struct pheap_elem *meld (struct pheap *,
+		struct pheap_elem *, struct pheap_elem *);
+static struct pheap_elem *merge_pairs (struct pheap *, struct pheap_elem *);
+static void cut (struct pheap_elem *);
+
+/* Initializes H as an empty heap that compares elements using
+   LESS, given auxiliary data AUX. */
+void
+pheap_init (struct pheap *h, pheap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+pheap_insert (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = meld (h, h->root, e);
+	h->elem_cnt++;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+pheap_remove (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+	ASSERT (h->elem_cnt > 0);
+
+	if (e == h->root)
+		h->root = merge_pairs (h, e->child);
+	else {
+		cut (e);
+		h->root = meld (h, h->root, merge_pairs (h, e->child));
+	}
+	e->child = NULL;
+	h->elem_cnt--;
+}
+
+/* Removes and returns the maximum element of H, which must not be
+   empty. */
+struct pheap_elem *
+pheap_pop_max (struct pheap *h) {
+	struct pheap_elem *max = pheap_max (h);
+
+	pheap_remove (h, max);
+	return max;
+}
+
+/* Restores the heap order after the key of E, which must be in H,
+   has increased. */
+void
+pheap_increase (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	/* E's children were no greater than E before, so they are
+	   still not; only the link to its parent may be wrong. */
+	if (e != h->root) {
+		cut (e);
+		h->root = meld (h, h->root, e);
+	}
+}
+
+/* Moves all the elements of FROM into H, leaving FROM empty.  The
+   two heaps must use the same comparison function. */
+void
+pheap_merge (struct pheap *h, struct pheap *from) {
+	ASSERT (h != NULL);
+	ASSERT (from != NULL);
+	ASSERT (h->less == from->less && h->aux == from->aux);
+
+	h->root = meld (h, h->root, from->root);
+	h->elem_cnt += from->elem_cnt;
+	from->root = NULL;
+	from->elem_cnt = 0;
+}
+
+/* Returns the maximum element of H, which must not be empty. */
+struct pheap_elem *
+pheap_max (struct pheap *h) {
+	ASSERT (!pheap_empty (h));
+	return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+pheap_size (struct pheap *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+pheap_empty (struct pheap *h) {
+	return h->root == NULL;
+}
+
+/* Melds the trees rooted at A and B, either of which may be null,
+   and returns the root of the result.  A and B must not have
+   siblings. */
+static struct pheap_elem *
+meld (struct pheap *h, struct pheap_elem *a, struct pheap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+
+	if (h->less (a, b, h->aux)) {
+		struct pheap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	/* Make B the first child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Melds the list of siblings starting at FIRST into one tree and
+   returns its root, or a null pointer if FIRST is null. */
+static struct pheap_elem *
+merge_pairs (struct pheap *h, struct pheap_elem *first) {
+	struct pheap_elem *pairs = NULL;
+	struct pheap_elem *root = NULL;
+
+	/* Left to right, meld each pair and push it onto PAIRS. */
+	while (first != NULL) {
+		struct pheap_elem *a = first;
+		struct pheap_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL)
+			b->next = b->prev = NULL;
+		a = meld (h, a, b);
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Right to left, meld the pairs together. */
+	while (pairs != NULL) {
+		struct pheap_elem *next = pairs->next;
+
+		pairs->next = NULL;
+		root = meld (h, root, pairs);
+		pairs = next;
+	}
+	if (root != NULL)
+		root->prev = NULL;
+	return root;
+}
+
+/* Detaches the subtree rooted at E, which must not be a root,
+   from its parent and siblings. */
+static void
+cut (struct pheap_elem *e) {
+	ASSERT (e->prev != NULL);
+
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->next = e->prev = NULL;
+}
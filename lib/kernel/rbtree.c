@@ -0,0 +1,314 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The algorithms follow
+   [CLRS] chapter 13, with null pointers in place of the sentinel
+   leaf.  Every path from a node down to a null child passes
+   through the same number of black nodes, and no red node has a
+   red child, so no path is more than twice as long as any
+   other. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rbtree *, struct rbtree_elem *);
+static void rotate_right (struct rbtree *, struct rbtree_elem *);
+static void transplant (struct rbtree *,
+		struct rbtree_elem *, struct rbtree_elem *);
+static struct rbtree_elem *leftmost (struct rbtree_elem *);
+static bool is_red (const struct rbtree_elem *);
+static void insert_fixup (struct rbtree *, struct rbtree_elem *);
+static void remove_fixup (struct rbtree *, struct rbtree_elem *,
+		struct rbtree_elem *parent);
+
+/* Initializes T as an empty tree that compares elements using
+   LESS, given auxiliary data AUX. */
+void
+rbtree_init (struct rbtree *t, rbtree_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->min = NULL;
+	t->elem_cnt = 0;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rbtree_insert (struct rbtree *t, struct rbtree_elem *e) {
+	struct rbtree_elem **link = &t->root;
+	struct rbtree_elem *parent = NULL;
+	bool is_min = true;
+
+	ASSERT (t != NULL);
+	ASSERT (e != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (t->less (e, parent, t->aux))
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			is_min = false;
+		}
+	}
+
+	e->parent = parent;
+	e->left = e->right = NULL;
+	e->red = true;
+	*link = e;
+	if (is_min)
+		t->min = e;
+	t->elem_cnt++;
+
+	insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rbtree_remove (struct rbtree *t, struct rbtree_elem *e) {
+	struct rbtree_elem *x, *x_parent;
+	bool removed_red = e->red;
+
+	ASSERT (t != NULL);
+	ASSERT (e != NULL);
+	ASSERT (t->elem_cnt > 0);
+
+	if (t->min == e)
+		t->min = rbtree_next (e);
+
+	if (e->left == NULL) {
+		x = e->right;
+		x_parent = e->parent;
+		transplant (t, e, e->right);
+	} else if (e->right == NULL) {
+		x = e->left;
+		x_parent = e->parent;
+		transplant (t, e, e->left);
+	} else {
+		/* Replace E by its successor Y, which has no left child. */
+		struct rbtree_elem *y = leftmost (e->right);
+
+		removed_red = y->red;
+		x = y->right;
+		if (y->parent == e)
+			x_parent = y;
+		else {
+			x_parent = y->parent;
+			transplant (t, y, y->right);
+			y->right = e->right;
+			y->right->parent = y;
+		}
+		transplant (t, e, y);
+		y->left = e->left;
+		y->left->parent = y;
+		y->red = e->red;
+	}
+	t->elem_cnt--;
+
+	if (!removed_red)
+		remove_fixup (t, x, x_parent);
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rbtree_elem *
+rbtree_min (struct rbtree *t) {
+	return t->min;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest element. */
+struct rbtree_elem *
+rbtree_next (struct rbtree_elem *e) {
+	ASSERT (e != NULL);
+
+	if (e->right != NULL)
+		return leftmost (e->right);
+	while (e->parent != NULL && e == e->parent->right)
+		e = e->parent;
+	return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rbtree_size (struct rbtree *t) {
+	return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rbtree_empty (struct rbtree *t) {
+	return t->root == NULL;
+}
+
+/* Makes X's right child take X's place, with X as its left
+   child. */
+static void
+rotate_left (struct rbtree *t, struct rbtree_elem *x) {
+	struct rbtree_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	transplant (t, x, y);
+	y->left = x;
+	x->parent = y;
+}
+
+/* Makes X's left child take X's place, with X as its right
+   child. */
+static void
+rotate_right (struct rbtree *t, struct rbtree_elem *x) {
+	struct rbtree_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	transplant (t, x, y);
+	y->right = x;
+	x->parent = y;
+}
+
+/* Puts the subtree rooted at V, which may be null, in the place
+   of the subtree rooted at U. */
+static void
+transplant (struct rbtree *t, struct rbtree_elem *u, struct rbtree_elem *v) {
+	if (u->parent == NULL)
+		t->root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static struct rbtree_elem *
+leftmost (struct rbtree_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+/* Returns true if E is red.  Null leaves are black. */
+static bool
+is_red (const struct rbtree_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Restores the red-black properties after inserting red node E. */
+static void
+insert_fixup (struct rbtree *t, struct rbtree_elem *e) {
+	struct rbtree_elem *p;
+
+	while ((p = e->parent) != NULL && p->red) {
+		/* P is red, so it is not the root and G exists. */
+		struct rbtree_elem *g = p->parent;
+
+		if (p == g->left) {
+			struct rbtree_elem *u = g->right;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				e = g;
+			} else {
+				if (e == p->right) {
+					rotate_left (t, p);
+					e = p;
+					p = e->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_right (t, g);
+			}
+		} else {
+			struct rbtree_elem *u = g->left;
+
+			if (is_red (u)) {
+				p->red = u->red = false;
+				g->red = true;
+				e = g;
+			} else {
+				if (e == p->left) {
+					rotate_right (t, p);
+					e = p;
+					p = e->parent;
+				}
+				p->red = false;
+				g->red = true;
+				rotate_left (t, g);
+			}
+		}
+	}
+	t->root->red = false;
+}
+
+/* Restores the red-black properties after removing a black node
+   from the path to X, which may be null, whose parent is
+   PARENT. */
+static void
+remove_fixup (struct rbtree *t, struct rbtree_elem *x,
+		struct rbtree_elem *parent) {
+	while (x != t->root && !is_red (x)) {
+		/* X is one black short, so its sibling W exists. */
+		if (x == parent->left) {
+			struct rbtree_elem *w = parent->right;
+
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->right)) {
+					w->left->red = false;
+					w->red = true;
+					rotate_right (t, w);
+					w = parent->right;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->right->red = false;
+				rotate_left (t, parent);
+				x = t->root;
+			}
+		} else {
+			struct rbtree_elem *w = parent->left;
+
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!is_red (w->left)) {
+					w->right->red = false;
+					w->red = true;
+					rotate_left (t, w);
+					w = parent->left;
+				}
+				w->red = parent->red;
+				parent->red = false;
+				w->left->red = false;
+				rotate_right (t, parent);
+				x = t->root;
+			}
+		}
+	}
+	if (x != NULL)
+		x->red = false;
+}
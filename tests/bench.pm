@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks that a benchmark ran cleanly and printed a line matching
+# $RESULT.  The numbers it reports vary from run to run and are
+# not checked.
+sub check_bench {
+    my ($result) = @_;
+    our ($test);
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    fail "missing result line\n" if !grep (/$result/, @output);
+    pass;
+}
+
+1;
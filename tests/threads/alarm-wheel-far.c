@@ -0,0 +1,127 @@
+/* Puts threads to sleep for times that cross the boundaries of the
+   first levels of the sleep timing wheel, so that their slots are
+   cascaded down as the timer reaches them, and checks that each
+   thread wakes up at its wakeup tick, no earlier, and in order.
+   Meanwhile two more threads sleep on the last level and on the
+   overflow list, too far ahead to wait out; they must not wake up
+   on their own, and must wake up at once when their sleep is
+   cancelled. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Wakeup offsets, in increasing order, around the boundaries of
+   the wheel's levels at 64 and 4096 ticks. */
+static const int64_t offsets[] =
+  {
+    63, 64, 65, 100, 4095, 4096, 4097, 4200,
+  };
+#define WAKE_CNT (sizeof offsets / sizeof *offsets)
+
+/* Offsets of the two sleeps that get cancelled: on the last level,
+   past 262144 ticks, and on the overflow list, past 16777216. */
+static const int64_t cancel_offsets[] = { 300000, (1 << 25) + 100 };
+#define CANCEL_CNT (sizeof cancel_offsets / sizeof *cancel_offsets)
+
+#define THREAD_CNT (WAKE_CNT + CANCEL_CNT)
+
+/* Information about one sleeping thread. */
+struct far_sleeper
+  {
+    struct thread *thread;      /* The sleeper. */
+    int64_t wakeup;             /* Tick to wake up at. */
+    int64_t woke;               /* Tick actually woken up at. */
+    int order;                  /* Position in wake-up order. */
+  };
+
+static struct semaphore done;
+static struct lock order_lock;
+static int next_order;
+
+static void sleeper (void *);
+
+void
+test_alarm_wheel_far (void)
+{
+  struct far_sleeper *sleepers;
+  int64_t start;
+  size_t i, j;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sleepers = malloc (sizeof *sleepers * THREAD_CNT);
+  if (sleepers == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  sema_init (&done, 0);
+  lock_init (&order_lock);
+  next_order = 0;
+
+  /* The sleepers outrank us, so each is asleep by the time
+     thread_create() returns. */
+  start = timer_ticks () + 10;
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+
+      sleepers[i].wakeup = start + (i < WAKE_CNT
+                                    ? offsets[i]
+                                    : cancel_offsets[i - WAKE_CNT]);
+      sleepers[i].woke = -1;
+      snprintf (name, sizeof name, "sleeper %zu", i);
+      thread_create (name, PRI_DEFAULT + 1, sleeper, &sleepers[i]);
+    }
+
+  /* Wait out the near sleepers, about 42 seconds. */
+  for (i = 0; i < WAKE_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < WAKE_CNT; i++)
+    {
+      if (sleepers[i].woke < sleepers[i].wakeup)
+        fail ("thread %zu woke up at tick %lld, before tick %lld",
+              i, sleepers[i].woke - start, sleepers[i].wakeup - start);
+      for (j = 0; j < WAKE_CNT; j++)
+        if (sleepers[i].wakeup < sleepers[j].wakeup
+            && sleepers[i].order > sleepers[j].order)
+          fail ("thread %zu woke up after thread %zu", i, j);
+    }
+
+  for (i = WAKE_CNT; i < THREAD_CNT; i++)
+    {
+      if (sleepers[i].woke != -1)
+        fail ("thread %zu woke up at tick %lld, before tick %lld",
+              i, sleepers[i].woke - start, sleepers[i].wakeup - start);
+      if (!thread_sleep_cancel (sleepers[i].thread))
+        fail ("thread %zu was not asleep", i);
+      sema_down (&done);
+      if (sleepers[i].woke >= sleepers[i].wakeup)
+        fail ("cancelled thread %zu slept until tick %lld",
+              i, sleepers[i].woke - start);
+    }
+  free (sleepers);
+  pass ();
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *s_)
+{
+  struct far_sleeper *s = s_;
+
+  s->thread = thread_current ();
+  timer_sleep (s->wakeup - timer_ticks ());
+  s->woke = timer_ticks ();
+
+  lock_acquire (&order_lock);
+  s->order = next_order++;
+  lock_release (&order_lock);
+
+  sema_up (&done);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-wheel-far) begin
+(alarm-wheel-far) PASS
+(alarm-wheel-far) end
+EOF
+pass;
@@ -0,0 +1,95 @@
+/* Puts many threads to sleep with wakeup times that straddle the
+   slot and level boundaries of the sleep timing wheel, and checks
+   that every thread wakes up no earlier than requested and that
+   threads wake up in order of their wakeup times. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 48
+
+/* Information about one sleeping thread. */
+struct wheel_sleeper
+  {
+    int64_t wakeup;             /* Tick to wake up at. */
+    int64_t woke;               /* Tick actually woken up at. */
+    int order;                  /* Position in wake-up order. */
+  };
+
+static struct semaphore done;
+static struct lock order_lock;
+static int next_order;
+
+static void sleeper (void *);
+
+void
+test_alarm_wheel (void) 
+{
+  struct wheel_sleeper *sleepers;
+  int64_t start;
+  int i, j;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sleepers = malloc (sizeof *sleepers * THREAD_CNT);
+  if (sleepers == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  sema_init (&done, 0);
+  lock_init (&order_lock);
+  next_order = 0;
+
+  /* Wake up around every multiple of 64 ticks, plus a few
+     threads that share a tick. */
+  start = timer_ticks () + 10;
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      int64_t offset = (i / 3 + 1) * 64 + (i % 3) - 1;
+
+      if (i >= THREAD_CNT - 3)
+        offset = 100;
+      sleepers[i].wakeup = start + offset;
+      sleepers[i].woke = -1;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT + 1, sleeper, &sleepers[i]);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (sleepers[i].woke < sleepers[i].wakeup)
+        fail ("thread %d woke up at tick %lld, before tick %lld",
+              i, sleepers[i].woke - start, sleepers[i].wakeup - start);
+      for (j = 0; j < THREAD_CNT; j++)
+        if (sleepers[i].wakeup < sleepers[j].wakeup
+            && sleepers[i].order > sleepers[j].order)
+          fail ("thread %d woke up after thread %d", i, j);
+    }
+  free (sleepers);
+  pass ();
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *s_) 
+{
+  struct wheel_sleeper *s = s_;
+
+  timer_sleep (s->wakeup - timer_ticks ());
+  s->woke = timer_ticks ();
+
+  lock_acquire (&order_lock);
+  s->order = next_order++;
+  lock_release (&order_lock);
+
+  sema_up (&done);
+}
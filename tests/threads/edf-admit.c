@@ -0,0 +1,82 @@
+/* Checks admission control for the EDF class.  Threads join the
+   class as long as the densities (runtime / deadline) of all the
+   EDF threads add up to at most 90% of the CPU; a request that
+   would go over is rejected, and leaving the class frees the
+   thread's share. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct request
+  {
+    int64_t runtime, deadline, period;
+  };
+
+struct requests
+  {
+    const struct request *reqs;
+    size_t cnt;
+    struct semaphore done;
+  };
+
+static thread_func requester;
+static void try_request (const char *who, const struct request *);
+static void run_requester (const struct request *, size_t cnt);
+
+void
+test_edf_admit (void) 
+{
+  static const struct request main_40 = {4, 10, 10};
+  static const struct request main_75 = {3, 4, 8};
+  static const struct request a[] = {{4, 10, 10}, {6, 10, 10}};
+  static const struct request b[] = {{2, 10, 10}, {1, 10, 10}};
+  static const struct request c[] = {{9, 10, 10}};
+
+  try_request ("main", &main_40);
+  run_requester (a, 2);
+
+  try_request ("main", &main_75);
+  run_requester (b, 2);
+
+  thread_clear_edf ();
+  msg ("main left the EDF class");
+  run_requester (c, 1);
+}
+
+/* Has a new thread make the CNT requests in REQS, then leave the
+   EDF class, and waits for it to finish. */
+static void
+run_requester (const struct request *reqs, size_t cnt) 
+{
+  struct requests r;
+
+  r.reqs = reqs;
+  r.cnt = cnt;
+  sema_init (&r.done, 0);
+  thread_create ("requester", PRI_DEFAULT + 1, requester, &r);
+  sema_down (&r.done);
+}
+
+static void
+requester (void *r_) 
+{
+  struct requests *r = r_;
+  size_t i;
+
+  for (i = 0; i < r->cnt; i++)
+    try_request ("requester", &r->reqs[i]);
+  thread_clear_edf ();
+  sema_up (&r->done);
+}
+
+static void
+try_request (const char *who, const struct request *req) 
+{
+  msg ("%s: runtime %lld, deadline %lld, period %lld %s",
+       who, req->runtime, req->deadline, req->period,
+       thread_set_edf (req->runtime, req->deadline, req->period)
+       ? "admitted" : "rejected");
+}
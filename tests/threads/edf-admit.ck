@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admit) begin
+(edf-admit) main: runtime 4, deadline 10, period 10 admitted
+(edf-admit) requester: runtime 4, deadline 10, period 10 admitted
+(edf-admit) requester: runtime 6, deadline 10, period 10 rejected
+(edf-admit) main: runtime 3, deadline 4, period 8 admitted
+(edf-admit) requester: runtime 2, deadline 10, period 10 rejected
+(edf-admit) requester: runtime 1, deadline 10, period 10 admitted
+(edf-admit) main left the EDF class
+(edf-admit) requester: runtime 9, deadline 10, period 10 admitted
+(edf-admit) end
+EOF
+pass;
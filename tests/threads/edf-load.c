@@ -0,0 +1,87 @@
+/* Runs two periodic EDF threads against CPU-bound threads at the
+   highest priority and counts the deadlines they miss.  The EDF
+   threads come before every priority class, so they should miss
+   none, while their budgets leave the hogs most of the CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define HOG_CNT 3
+#define JOB_CNT 20
+
+struct periodic
+  {
+    const char *name;
+    int64_t runtime, deadline, period;  /* EDF parameters. */
+    int64_t work;                       /* Ticks of work per job. */
+    int misses;                         /* # of deadlines missed. */
+    struct semaphore done;
+  };
+
+static volatile bool stop;
+static volatile int64_t hog_loops;
+
+static thread_func hog;
+static thread_func periodic;
+
+void
+test_edf_load (void) 
+{
+  struct periodic p[2] = {
+    {"a", 3, 6, 10, 1, 0, {0}},
+    {"b", 2, 8, 12, 1, 0, {0}},
+  };
+  int i;
+
+  stop = false;
+  hog_loops = 0;
+
+  /* Share the CPU evenly with the hogs until the EDF threads have
+     run their jobs. */
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < HOG_CNT; i++)
+    thread_create ("hog", PRI_MAX, hog, NULL);
+  for (i = 0; i < 2; i++)
+    {
+      sema_init (&p[i].done, 0);
+      thread_create (p[i].name, PRI_MAX, periodic, &p[i]);
+    }
+  for (i = 0; i < 2; i++)
+    sema_down (&p[i].done);
+  stop = true;
+
+  for (i = 0; i < 2; i++)
+    msg ("%s: %d jobs, %d deadline misses", p[i].name, JOB_CNT, p[i].misses);
+  msg ("hogs ran: %s", hog_loops > 0 ? "yes" : "no");
+}
+
+static void
+hog (void *aux UNUSED) 
+{
+  while (!stop)
+    hog_loops++;
+}
+
+static void
+periodic (void *p_) 
+{
+  struct periodic *p = p_;
+  int i;
+
+  if (!thread_set_edf (p->runtime, p->deadline, p->period))
+    fail ("%s not admitted", p->name);
+  for (i = 0; i < JOB_CNT; i++)
+    {
+      int64_t start = timer_ticks ();
+      while (timer_elapsed (start) < p->work)
+        continue;
+      if (!thread_edf_wait ())
+        p->misses++;
+    }
+  thread_clear_edf ();
+  sema_up (&p->done);
+}
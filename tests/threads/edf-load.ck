@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-load) begin
+(edf-load) a: 20 jobs, 0 deadline misses
+(edf-load) b: 20 jobs, 0 deadline misses
+(edf-load) hogs ran: yes
+(edf-load) end
+EOF
+pass;
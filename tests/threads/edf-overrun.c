@@ -0,0 +1,52 @@
+/* An EDF thread with a budget of 2 ticks in every 10 runs for 30
+   ticks straight.  Each time it uses up its budget it should be
+   throttled until its next period, letting the main thread, in
+   the priority classes, run in between.  Its job misses its
+   deadline. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static volatile bool done;
+static volatile int64_t main_loops;
+static struct semaphore finished;
+
+static thread_func overrun;
+
+void
+test_edf_overrun (void) 
+{
+  done = false;
+  main_loops = 0;
+  sema_init (&finished, 0);
+  thread_create ("overrun", PRI_DEFAULT + 1, overrun, NULL);
+  while (!done)
+    main_loops++;
+  sema_down (&finished);
+}
+
+static void
+overrun (void *aux UNUSED) 
+{
+  int64_t before, start;
+
+  if (!thread_set_edf (2, 10, 10))
+    fail ("not admitted");
+
+  before = main_loops;
+  start = timer_ticks ();
+  while (timer_elapsed (start) < 30)
+    continue;
+  msg ("main thread ran while throttled: %s",
+       main_loops > before ? "yes" : "no");
+  msg ("overrunning job met its deadline: %s",
+       thread_edf_wait () ? "yes" : "no");
+
+  thread_clear_edf ();
+  done = true;
+  sema_up (&finished);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-overrun) begin
+(edf-overrun) main thread ran while throttled: yes
+(edf-overrun) overrunning job met its deadline: no
+(edf-overrun) end
+EOF
+pass;
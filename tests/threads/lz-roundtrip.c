@@ -0,0 +1,74 @@
+/* Compresses pages of zeros, random bytes, a repeating pattern
+   and long runs of single bytes with the LZ77 compressor that the
+   compressed swap pool uses, and checks that each decompresses
+   back to what it was.  Also checks that random bytes do not fit
+   in less room than they take and that a truncated block does
+   not decompress. */
+
+#include <lz.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+
+#define PAGE LZ_MAX_SIZE
+
+static uint8_t page[PAGE];
+static uint8_t packed[LZ_BOUND (PAGE)];
+static uint8_t unpacked[PAGE];
+static uint16_t table[LZ_TABLE_SIZE];
+
+static void round_trip (const char *name, size_t max_len);
+
+void
+test_lz_roundtrip (void)
+{
+  size_t i, len;
+
+  memset (page, 0, PAGE);
+  round_trip ("zero page", PAGE / 16);
+
+  random_init (0);
+  random_bytes (page, PAGE);
+  round_trip ("random page", LZ_BOUND (PAGE));
+  if (lz_compress (page, PAGE, packed, PAGE * 3 / 4, table) != 0)
+    fail ("random page fit in 3/4 page");
+  msg ("random page does not fit in 3/4 page");
+
+  for (i = 0; i < PAGE; i++)
+    page[i] = "pintos!"[i % 7];
+  round_trip ("repeating page", PAGE / 16);
+
+  /* Runs of up to 1000 bytes, longer than the longest match. */
+  for (i = 0; i < PAGE; i += len)
+    {
+      len = random_ulong () % 1000 + 1;
+      if (len > PAGE - i)
+        len = PAGE - i;
+      memset (page + i, random_ulong (), len);
+    }
+  round_trip ("long-run page", PAGE / 8);
+
+  len = lz_compress (page, PAGE, packed, sizeof packed, table);
+  if (lz_decompress (packed, len - 1, unpacked, PAGE))
+    fail ("truncated page decompressed");
+  msg ("truncated page does not decompress");
+}
+
+/* Compresses PAGE, which must compress to at most MAX_LEN bytes,
+   and checks that it decompresses back.  NAME describes it. */
+static void
+round_trip (const char *name, size_t max_len)
+{
+  size_t len = lz_compress (page, PAGE, packed, sizeof packed, table);
+
+  if (len == 0 || len > max_len)
+    fail ("%s compressed to %zu bytes, more than %zu", name, len, max_len);
+  memset (unpacked, 0xcc, PAGE);
+  if (!lz_decompress (packed, len, unpacked, PAGE))
+    fail ("%s does not decompress", name);
+  if (memcmp (page, unpacked, PAGE))
+    fail ("%s decompresses to different bytes", name);
+  msg ("%s round trip", name);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lz-roundtrip) begin
+(lz-roundtrip) zero page round trip
+(lz-roundtrip) random page round trip
+(lz-roundtrip) random page does not fit in 3/4 page
+(lz-roundtrip) repeating page round trip
+(lz-roundtrip) long-run page round trip
+(lz-roundtrip) truncated page does not decompress
+(lz-roundtrip) end
+EOF
+pass;
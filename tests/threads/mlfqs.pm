@@ -69,8 +69,29 @@ sub mlfqs_expected_ticks {
     return @slices;
 }
 
+# Ticks that the completely fair scheduler gives threads with the
+# given nice values over 3000 ticks: shares proportional to the
+# weights of the nice values, as in threads/thread.c.
+sub fair_expected_ticks {
+    my (@nice) = @_;
+    my (@weight) = map (1024 / 1.25 ** $_, @nice);
+    my ($total) = 0;
+    $total += $_ foreach @weight;
+    return map (3000 * $_ / $total, @weight);
+}
+
 sub check_mlfqs_fair {
     my ($nice, $maxdiff) = @_;
+    check_tick_counts ($nice, [mlfqs_expected_ticks (@$nice)], $maxdiff);
+}
+
+sub check_fair_share {
+    my ($nice, $maxdiff) = @_;
+    check_tick_counts ($nice, [fair_expected_ticks (@$nice)], $maxdiff);
+}
+
+sub check_tick_counts {
+    my ($nice, $expected, $maxdiff) = @_;
     our ($test);
     my (@output) = read_text_file ("$test.output");
     common_checks ("run", @output);
@@ -83,9 +104,8 @@ sub check_mlfqs_fair {
         $actual[$id] = $count;
     }
 
-    my (@expected) = mlfqs_expected_ticks (@$nice);
     mlfqs_compare ("thread", "%d",
-		   \@actual, \@expected, $maxdiff, [0, $#$nice, 1],
+		   \@actual, $expected, $maxdiff, [0, $#$nice, 1],
 		   "Some tick counts were missing or differed from those "
 		   . "expected by more than $maxdiff.");
     pass;
@@ -13,7 +13,13 @@
    They should receive 672, 588, 492, 408, 316, 232, 152, 92, 40,
    and 8 ticks, respectively, over 30 seconds.
 
-   (The above are computed via simulation in mlfqs.pm.) */
+   (The above are computed via simulation in mlfqs.pm.)
+
+   The fair-* tests run the same loads under -fair, which should
+   divide the ticks in proportion to the weights of the threads'
+   nice values: 1,500 each for fair-2, 2,260 and 740 for
+   fair-nice-2, and 672, 538, 430, 344, 275, 220, 176, 141, 113
+   and 90 for fair-nice-10. */
 
 #include <stdio.h>
 #include <inttypes.h>
@@ -51,6 +57,24 @@ test_mlfqs_nice_10 (void)
   test_mlfqs_fair (10, 0, 1);
 }
 
+void
+test_fair_2 (void) 
+{
+  test_mlfqs_fair (2, 0, 0);
+}
+
+void
+test_fair_nice_2 (void) 
+{
+  test_mlfqs_fair (2, 0, 5);
+}
+
+void
+test_fair_nice_10 (void) 
+{
+  test_mlfqs_fair (10, 0, 1);
+}
+
 #define MAX_THREAD_CNT 20
 
 struct thread_info 
@@ -70,7 +94,7 @@ test_mlfqs_fair (int thread_cnt, int nice_min, int nice_step)
   int nice;
   int i;
 
-  ASSERT (thread_mlfqs);
+  ASSERT (thread_mlfqs || thread_fair);
   ASSERT (thread_cnt <= MAX_THREAD_CNT);
   ASSERT (nice_min >= -10);
   ASSERT (nice_step >= 0);
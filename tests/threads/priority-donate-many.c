@@ -0,0 +1,69 @@
+/* The main thread acquires locks A, B and C, then creates twelve
+   threads of increasing priority, each of which blocks acquiring
+   one of the locks in turn and donates its priority to the main
+   thread.  The main thread then releases C, B and A.  Each
+   release should leave the main thread with the highest priority
+   still waiting on a lock it holds, and the waiters that are
+   left behind on a released lock should go on to acquire it in
+   priority order. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define LOCK_CNT 3
+#define THREAD_CNT 12
+
+static thread_func acquire_thread_func;
+
+static struct lock locks[LOCK_CNT];
+
+void
+test_priority_donate_many (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  for (i = 0; i < LOCK_CNT; i++)
+    {
+      lock_init (&locks[i]);
+      lock_acquire (&locks[i]);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "p%d", PRI_DEFAULT + 1 + i);
+      thread_create (name, PRI_DEFAULT + 1 + i, acquire_thread_func,
+                     (void *) (intptr_t) (i % LOCK_CNT));
+    }
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + THREAD_CNT, thread_get_priority ());
+
+  for (i = LOCK_CNT - 1; i >= 0; i--)
+    {
+      int expected = i > 0 ? PRI_DEFAULT + THREAD_CNT - LOCK_CNT + i
+                           : PRI_DEFAULT;
+      lock_release (&locks[i]);
+      msg ("Main thread should have priority %d.  Actual priority: %d.",
+           expected, thread_get_priority ());
+    }
+}
+
+static void
+acquire_thread_func (void *lock_idx_) 
+{
+  int lock_idx = (intptr_t) lock_idx_;
+
+  lock_acquire (&locks[lock_idx]);
+  msg ("Thread with priority %d acquired lock %c.",
+       thread_get_priority (), 'a' + lock_idx);
+  lock_release (&locks[lock_idx]);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-many) begin
+(priority-donate-many) Main thread should have priority 43.  Actual priority: 43.
+(priority-donate-many) Thread with priority 43 acquired lock c.
+(priority-donate-many) Main thread should have priority 42.  Actual priority: 42.
+(priority-donate-many) Thread with priority 42 acquired lock b.
+(priority-donate-many) Main thread should have priority 41.  Actual priority: 41.
+(priority-donate-many) Thread with priority 41 acquired lock a.
+(priority-donate-many) Thread with priority 40 acquired lock c.
+(priority-donate-many) Thread with priority 39 acquired lock b.
+(priority-donate-many) Thread with priority 38 acquired lock a.
+(priority-donate-many) Thread with priority 37 acquired lock c.
+(priority-donate-many) Thread with priority 36 acquired lock b.
+(priority-donate-many) Thread with priority 35 acquired lock a.
+(priority-donate-many) Thread with priority 34 acquired lock c.
+(priority-donate-many) Thread with priority 33 acquired lock b.
+(priority-donate-many) Thread with priority 32 acquired lock a.
+(priority-donate-many) Main thread should have priority 31.  Actual priority: 31.
+(priority-donate-many) end
+EOF
+pass;
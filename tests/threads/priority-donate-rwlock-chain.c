@@ -0,0 +1,89 @@
+/* The main thread holds more reader-writer locks shared than a
+   thread has built-in holds for.  A medium-priority thread takes
+   a lock and then waits to write the last rwlock, donating to the
+   main thread.  A high-priority thread then waits for the lock,
+   and its donation must follow the medium thread's rwlock wait
+   on to the main thread.  Releasing the other rwlocks must not
+   lose the donation; releasing the last hands it to the medium
+   thread, which then runs at the high thread's priority. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define RWLOCK_CNT (RWLOCK_HOLD_SLOTS * 2)
+
+struct locks
+  {
+    struct rwlock rwlocks[RWLOCK_CNT];
+    struct lock lock;
+  };
+
+static thread_func medium_thread_func;
+static thread_func high_thread_func;
+
+void
+test_priority_donate_rwlock_chain (void) 
+{
+  struct locks locks;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&locks.lock);
+  for (i = 0; i < RWLOCK_CNT; i++)
+    {
+      rwlock_init (&locks.rwlocks[i]);
+      rwlock_acquire_read (&locks.rwlocks[i]);
+    }
+
+  thread_create ("medium", PRI_DEFAULT + 1, medium_thread_func, &locks);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  thread_create ("high", PRI_DEFAULT + 2, high_thread_func, &locks);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+
+  for (i = 0; i < RWLOCK_CNT - 1; i++)
+    rwlock_release (&locks.rwlocks[i]);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+
+  rwlock_release (&locks.rwlocks[RWLOCK_CNT - 1]);
+  msg ("high, medium must already have finished, in that order.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+medium_thread_func (void *locks_) 
+{
+  struct locks *locks = locks_;
+  struct rwlock *last = &locks->rwlocks[RWLOCK_CNT - 1];
+
+  lock_acquire (&locks->lock);
+  msg ("medium: got the lock");
+  rwlock_acquire_write (last);
+  msg ("medium: got the last rwlock exclusively at priority %d",
+       thread_get_priority ());
+  rwlock_release (last);
+  lock_release (&locks->lock);
+  msg ("medium: done");
+}
+
+static void
+high_thread_func (void *locks_) 
+{
+  struct locks *locks = locks_;
+
+  lock_acquire (&locks->lock);
+  msg ("high: got the lock");
+  lock_release (&locks->lock);
+  msg ("high: done");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rwlock-chain) begin
+(priority-donate-rwlock-chain) medium: got the lock
+(priority-donate-rwlock-chain) This thread should have priority 32.  Actual priority: 32.
+(priority-donate-rwlock-chain) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-rwlock-chain) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-rwlock-chain) medium: got the last rwlock exclusively at priority 33
+(priority-donate-rwlock-chain) high: got the lock
+(priority-donate-rwlock-chain) high: done
+(priority-donate-rwlock-chain) medium: done
+(priority-donate-rwlock-chain) high, medium must already have finished, in that order.
+(priority-donate-rwlock-chain) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-rwlock-chain) end
+EOF
+pass;
@@ -0,0 +1,76 @@
+/* The main thread holds a reader-writer lock shared.  A reader
+   can still share it, but a writer blocks, and so does a reader
+   that arrives while the writer waits.  Both donate their
+   priorities to the main thread.  When the main thread releases
+   the lock, the writer gets it first, with the waiting reader's
+   priority donated to it, and the reader gets it next. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader1_thread_func;
+static thread_func writer_thread_func;
+static thread_func reader2_thread_func;
+
+void
+test_priority_donate_rwlock (void) 
+{
+  struct rwlock rwlock;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+  rwlock_acquire_read (&rwlock);
+  thread_create ("reader1", PRI_DEFAULT + 1, reader1_thread_func, &rwlock);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  thread_create ("reader2", PRI_DEFAULT + 2, reader2_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  rwlock_release (&rwlock);
+  msg ("writer, reader2 must already have finished, in that order.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+reader1_thread_func (void *rwlock_) 
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_read (rwlock);
+  msg ("reader1: got the lock shared");
+  rwlock_release (rwlock);
+  msg ("reader1: done");
+}
+
+static void
+writer_thread_func (void *rwlock_) 
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_write (rwlock);
+  msg ("writer: got the lock exclusively at priority %d",
+       thread_get_priority ());
+  rwlock_release (rwlock);
+  msg ("writer: done");
+}
+
+static void
+reader2_thread_func (void *rwlock_) 
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_read (rwlock);
+  msg ("reader2: got the lock shared");
+  rwlock_release (rwlock);
+  msg ("reader2: done");
+}
@@ -0,0 +1,72 @@
+/* Tests that threads of equal priority waiting on a semaphore
+   wake up in the order they started waiting, and that a thread
+   which receives a donation while waiting moves ahead of them. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func low_thread;
+static thread_func fifo_thread;
+static thread_func high_thread;
+static struct semaphore sema;
+static struct lock lock;
+
+void
+test_priority_sema_requeue (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  thread_set_priority (PRI_MIN);
+
+  /* Each of these runs at once, since it has a higher priority
+     than ours, and blocks on the semaphore. */
+  thread_create ("low", PRI_DEFAULT + 1, low_thread, NULL);
+  for (i = 0; i < 3; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "fifo %d", i);
+      thread_create (name, PRI_DEFAULT + 2, fifo_thread, NULL);
+    }
+
+  /* Donates to "low" while it waits on the semaphore. */
+  thread_create ("high", PRI_DEFAULT + 5, high_thread, NULL);
+
+  for (i = 0; i < 4; i++) 
+    {
+      sema_up (&sema);
+      msg ("Back in main thread.");
+    }
+}
+
+static void
+low_thread (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  sema_down (&sema);
+  msg ("Thread %s woke up.", thread_name ());
+  lock_release (&lock);
+  msg ("Thread %s finished.", thread_name ());
+}
+
+static void
+fifo_thread (void *aux UNUSED) 
+{
+  sema_down (&sema);
+  msg ("Thread %s woke up.", thread_name ());
+}
+
+static void
+high_thread (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  msg ("Thread %s acquired the lock.", thread_name ());
+  lock_release (&lock);
+}
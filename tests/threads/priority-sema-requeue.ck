@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-sema-requeue) begin
+(priority-sema-requeue) Thread low woke up.
+(priority-sema-requeue) Thread high acquired the lock.
+(priority-sema-requeue) Thread low finished.
+(priority-sema-requeue) Back in main thread.
+(priority-sema-requeue) Thread fifo 0 woke up.
+(priority-sema-requeue) Back in main thread.
+(priority-sema-requeue) Thread fifo 1 woke up.
+(priority-sema-requeue) Back in main thread.
+(priority-sema-requeue) Thread fifo 2 woke up.
+(priority-sema-requeue) Back in main thread.
+(priority-sema-requeue) end
+EOF
+pass;
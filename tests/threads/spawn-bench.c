@@ -0,0 +1,43 @@
+/* Measures the cost of creating a kernel thread, running it and
+   reaping it.  Each thread has a higher priority than the main
+   thread, so it runs and exits before thread_create() returns,
+   and the next thread_create() can reuse its page. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+
+#define SPAWNS 10000
+
+static thread_func exiter;
+
+void
+test_spawn_bench (void)
+{
+  uint64_t start_tsc, cycles;
+  int64_t start_ticks, ticks;
+  int i;
+
+  /* Warm up. */
+  thread_create ("exiter", PRI_DEFAULT + 1, exiter, NULL);
+
+  start_ticks = timer_ticks ();
+  start_tsc = rdtsc ();
+  for (i = 0; i < SPAWNS; i++)
+    if (thread_create ("exiter", PRI_DEFAULT + 1, exiter, NULL) == TID_ERROR)
+      fail ("thread_create failed after %d threads", i);
+  cycles = rdtsc () - start_tsc;
+  ticks = timer_elapsed (start_ticks);
+
+  msg ("%d spawns in %lld ticks, %llu cycles per spawn",
+       SPAWNS, ticks, (unsigned long long) (cycles / SPAWNS));
+}
+
+static void
+exiter (void *aux UNUSED)
+{
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench;
+check_bench (qr/^\(spawn-bench\) 10000 spawns in \d+ ticks, \d+ cycles per spawn$/);
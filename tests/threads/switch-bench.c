@@ -0,0 +1,58 @@
+/* Measures the cost of a kernel-to-kernel thread switch by
+   bouncing between two threads of equal priority through a pair
+   of semaphores, the way a disk wait or a semaphore handoff
+   does.  Each round trip is two switches. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+
+#define ROUND_TRIPS 10000
+
+static struct semaphore ping, pong;
+
+static void ponger (void *);
+
+void
+test_switch_bench (void)
+{
+  uint64_t start_tsc, cycles;
+  int64_t start_ticks, ticks;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("ponger", thread_get_priority (), ponger, NULL);
+
+  /* Warm up, so that the ponger is waiting on PING. */
+  sema_up (&ping);
+  sema_down (&pong);
+
+  start_ticks = timer_ticks ();
+  start_tsc = rdtsc ();
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  cycles = rdtsc () - start_tsc;
+  ticks = timer_elapsed (start_ticks);
+
+  msg ("%d switches in %lld ticks, %llu cycles per switch",
+       2 * ROUND_TRIPS, ticks,
+       (unsigned long long) (cycles / (2 * ROUND_TRIPS)));
+}
+
+static void
+ponger (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench;
+check_bench (qr/^\(switch-bench\) 20000 switches in \d+ ticks, \d+ cycles per switch$/);
@@ -11,6 +11,8 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_wheel;
+extern test_func test_alarm_wheel_far;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -19,9 +21,19 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_rwlock;
+extern test_func test_priority_donate_rwlock_chain;
+extern test_func test_priority_donate_many;
+extern test_func test_edf_admit;
+extern test_func test_edf_load;
+extern test_func test_edf_overrun;
+extern test_func test_switch_bench;
+extern test_func test_spawn_bench;
+extern test_func test_lz_roundtrip;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
+extern test_func test_priority_sema_requeue;
 extern test_func test_priority_condvar;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
@@ -32,6 +44,9 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_fair_2;
+extern test_func test_fair_nice_2;
+extern test_func test_fair_nice_10;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
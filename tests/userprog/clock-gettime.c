@@ -0,0 +1,43 @@
+/* Reads the monotonic clock with clock_gettime(), which must
+   never go backward and must advance in steps much finer than a
+   timer tick. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READS 10000
+
+static long long
+timespec_ns (const struct timespec *ts) 
+{
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void
+test_main (void) 
+{
+  struct timespec ts;
+  long long prev, now, min_step = -1;
+  int i;
+
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &ts) == 0, "read monotonic clock");
+  CHECK (ts.tv_nsec >= 0 && ts.tv_nsec < 1000000000, "tv_nsec in range");
+
+  prev = timespec_ns (&ts);
+  for (i = 0; i < READS; i++) 
+    {
+      clock_gettime (CLOCK_MONOTONIC, &ts);
+      now = timespec_ns (&ts);
+      if (now < prev)
+        fail ("clock went backward by %lld ns", prev - now);
+      if (now > prev && (min_step < 0 || now - prev < min_step))
+        min_step = now - prev;
+      prev = now;
+    }
+  if (min_step < 0 || min_step >= 1000000)
+    fail ("smallest step was %lld ns, not under 1 ms", min_step);
+  msg ("clock advances in sub-millisecond steps");
+
+  CHECK (clock_gettime (-1, &ts) == -1, "unknown clock fails");
+}
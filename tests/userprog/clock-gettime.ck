@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-gettime) begin
+(clock-gettime) read monotonic clock
+(clock-gettime) tv_nsec in range
+(clock-gettime) clock advances in sub-millisecond steps
+(clock-gettime) unknown clock fails
+(clock-gettime) end
+clock-gettime: exit(0)
+EOF
+pass;
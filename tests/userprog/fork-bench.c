@@ -0,0 +1,41 @@
+/* Measures the cost of fork(): forks a child that exits at once
+   and waits for it, FORKS times over, and reports the time per
+   fork by the monotonic clock.  Every child prints its exit
+   message, which is part of what is measured. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FORKS 100
+
+static long long
+timespec_ns (const struct timespec *ts) 
+{
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void
+test_main (void) 
+{
+  struct timespec start, end;
+  long long us;
+  int i;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < FORKS; i++) 
+    {
+      pid_t pid = fork ("child");
+
+      if (pid == 0)
+        exit (0);
+      if (pid < 0)
+        fail ("fork failed after %d children", i);
+      if (wait (pid) != 0)
+        fail ("child %d did not exit cleanly", i);
+    }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  us = (timespec_ns (&end) - timespec_ns (&start)) / 1000;
+  msg ("%d forks in %lld us, %lld us per fork", FORKS, us, us / FORKS);
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench;
+check_bench (qr/^\(fork-bench\) 100 forks in \d+ us, \d+ us per fork$/);
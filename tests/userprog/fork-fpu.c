@@ -0,0 +1,65 @@
+/* Forks a child, then has the parent and the child run with
+   different values in an SSE register, and checks that each sees
+   only its own value across context switches. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PARENT_VALUE 0x11111111
+#define CHILD_VALUE 0x22222222
+#define ITERATIONS 2000000
+
+/* Fills %xmm0 with copies of V. */
+static void
+set_xmm0 (uint32_t v)
+{
+  uint32_t buf[4] = { v, v, v, v };
+  asm volatile ("movdqu %0, %%xmm0" : : "m" (buf));
+}
+
+/* Returns true if every word of %xmm0 is V. */
+static bool
+xmm0_is (uint32_t v)
+{
+  uint32_t buf[4];
+  asm volatile ("movdqu %%xmm0, %0" : "=m" (buf));
+  return buf[0] == v && buf[1] == v && buf[2] == v && buf[3] == v;
+}
+
+/* Checks %xmm0 against V repeatedly, long enough to be preempted
+   several times. */
+static bool
+spin_check (uint32_t v)
+{
+  bool ok = true;
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    if (!xmm0_is (v))
+      ok = false;
+  return ok;
+}
+
+void
+test_main (void)
+{
+  bool ok;
+  int pid;
+
+  set_xmm0 (PARENT_VALUE);
+  if ((pid = fork ("child")))
+    {
+      ok = spin_check (PARENT_VALUE);
+      wait (pid);
+      CHECK (ok && xmm0_is (PARENT_VALUE), "parent keeps its own xmm0");
+    }
+  else
+    {
+      CHECK (xmm0_is (PARENT_VALUE), "child inherits parent's xmm0");
+      set_xmm0 (CHILD_VALUE);
+      CHECK (spin_check (CHILD_VALUE), "child keeps its own xmm0");
+      exit (81);
+    }
+}
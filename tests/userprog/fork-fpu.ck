@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-fpu) begin
+(fork-fpu) child inherits parent's xmm0
+(fork-fpu) child keeps its own xmm0
+child: exit(81)
+(fork-fpu) parent keeps its own xmm0
+(fork-fpu) end
+fork-fpu: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Forks a child that exits at once, then writes to a page the two
+   shared.  The parent is left alone on the frame, so it must write
+   to it in place instead of copying. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/large.inc"
+
+void
+test_main (void)
+{
+	pid_t child;
+	void *pa;
+	char *buf = "Lorem ipsum";
+
+	pa = get_phys_addr ((void *) large);
+	child = fork ("child");
+	if (child == 0)
+		return;
+
+	wait (child);
+	large[0] = '@';
+	CHECK (get_phys_addr ((void *) large) == pa, "parent writes in place");
+	CHECK (memcmp ("@orem ipsum", large, strlen (buf)) == 0,
+			"check data change");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-child-exit) begin
+(cow-child-exit) end
+(cow-child-exit) parent writes in place
+(cow-child-exit) check data change
+(cow-child-exit) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Forks, then writes to a shared page in the parent while the
+   child is still alive.  The parent must get a copy of its own,
+   leaving the child alone on the old frame, which the child then
+   gets to write in place. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/large.inc"
+
+#define WAIT_SECONDS 10
+
+/* Waits until the parent writes a nonzero byte to file FD. */
+static void
+wait_for_flag (int fd)
+{
+	struct timespec start, now;
+	char flag = 0;
+
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	for (;;) {
+		seek (fd, 0);
+		if (read (fd, &flag, 1) == 1 && flag != 0)
+			return;
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - start.tv_sec > WAIT_SECONDS)
+			fail ("parent did not write after %d seconds", WAIT_SECONDS);
+	}
+}
+
+void
+test_main (void)
+{
+	pid_t child;
+	void *pa;
+	char *buf = "Lorem ipsum";
+	char flag = 1;
+	int fd;
+
+	CHECK (create ("flag", 1), "create \"flag\"");
+	CHECK ((fd = open ("flag")) > 1, "open \"flag\"");
+	pa = get_phys_addr ((void *) large);
+
+	child = fork ("child");
+	if (child == 0) {
+		wait_for_flag (fd);
+		CHECK (memcmp (buf, large, strlen (buf)) == 0, "check data consistency");
+		CHECK (get_phys_addr ((void *) large) == pa,
+				"child keeps the old frame");
+		large[0] = '#';
+		CHECK (get_phys_addr ((void *) large) == pa,
+				"child writes it in place");
+		return;
+	}
+
+	large[0] = '@';
+	CHECK (get_phys_addr ((void *) large) != pa, "parent gets a copy");
+	CHECK (memcmp ("@orem ipsum", large, strlen (buf)) == 0,
+			"check data change");
+	CHECK (write (fd, &flag, 1) == 1, "tell child");
+	wait (child);
+	CHECK (large[0] == '@', "child's write not seen");
+}
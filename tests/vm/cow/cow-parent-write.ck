@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-parent-write) begin
+(cow-parent-write) create "flag"
+(cow-parent-write) open "flag"
+(cow-parent-write) parent gets a copy
+(cow-parent-write) check data change
+(cow-parent-write) tell child
+(cow-parent-write) check data consistency
+(cow-parent-write) child keeps the old frame
+(cow-parent-write) child writes it in place
+(cow-parent-write) end
+(cow-parent-write) child's write not seen
+(cow-parent-write) end
+EOF
+pass;
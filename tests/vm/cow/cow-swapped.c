@@ -0,0 +1,74 @@
+/* Fills more memory than there is, so that most of it is swapped
+   out, and forks.  The child, sharing the swapped out pages, checks
+   and rewrites every one of them; then the parent checks that its
+   own pages kept their contents.  Each page is filled with bytes
+   that do not compress, to get it out to the swap disk. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (16 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char chunk[CHUNK_SIZE];
+
+/* Fills page I of CHUNK with bytes that depend on I and SEED. */
+static void
+fill (size_t i, uint32_t seed)
+{
+	uint32_t x = i * 2654435761u + seed;
+	size_t j;
+
+	for (j = 0; j < PAGE_SIZE; j++) {
+		x = x * 1103515245 + 12345;
+		chunk[i * PAGE_SIZE + j] = x >> 24;
+	}
+}
+
+/* Fails unless page I of CHUNK is as fill (I, SEED) left it. */
+static void
+check (size_t i, uint32_t seed)
+{
+	uint32_t x = i * 2654435761u + seed;
+	size_t j;
+
+	for (j = 0; j < PAGE_SIZE; j++) {
+		x = x * 1103515245 + 12345;
+		if (chunk[i * PAGE_SIZE + j] != (char) (x >> 24))
+			fail ("byte %zu of page %zu is wrong", j, i);
+	}
+}
+
+void
+test_main (void)
+{
+	pid_t child;
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		fill (i, 1);
+	msg ("filled pages");
+
+	child = fork ("child");
+	if (child == 0) {
+		for (i = 0; i < PAGE_COUNT; i++)
+			check (i, 1);
+		msg ("child sees parent's pages");
+		for (i = 0; i < PAGE_COUNT; i++)
+			fill (i, 2);
+		for (i = 0; i < PAGE_COUNT; i++)
+			check (i, 2);
+		msg ("child rewrote its pages");
+		return;
+	}
+
+	wait (child);
+	for (i = 0; i < PAGE_COUNT; i++)
+		check (i, 1);
+	msg ("parent's pages intact");
+}
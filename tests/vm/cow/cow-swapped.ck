@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-swapped) begin
+(cow-swapped) filled pages
+(cow-swapped) child sees parent's pages
+(cow-swapped) child rewrote its pages
+(cow-swapped) end
+(cow-swapped) parent's pages intact
+(cow-swapped) end
+EOF
+pass;
@@ -0,0 +1,98 @@
+/* Shares a file mapping between a parent and a forked child, and
+   has both increment a counter in it many times under a mutex
+   built on futex_wait() and futex_wake().  The mutex enters the
+   kernel only when it is contended. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define ITERATIONS 2000
+
+/* Layout of the shared page. */
+struct shared
+  {
+    int mutex;          /* 0: unlocked, 1: locked, 2: contended. */
+    int counter;        /* Protected by MUTEX. */
+  };
+
+static void
+mutex_lock (int *m)
+{
+  int c = 0;
+
+  if (__atomic_compare_exchange_n (m, &c, 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  if (c != 2)
+    c = __atomic_exchange_n (m, 2, __ATOMIC_ACQUIRE);
+  while (c != 0)
+    {
+      futex_wait (m, 2);
+      c = __atomic_exchange_n (m, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void
+mutex_unlock (int *m)
+{
+  if (__atomic_fetch_sub (m, 1, __ATOMIC_RELEASE) != 1)
+    {
+      __atomic_store_n (m, 0, __ATOMIC_RELEASE);
+      futex_wake (m, 1);
+    }
+}
+
+static void
+count (struct shared *s)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      int c;
+
+      mutex_lock (&s->mutex);
+      c = s->counter;
+      /* Widen the window for a preemption inside the section. */
+      for (volatile int j = 0; j < 50; j++)
+        continue;
+      s->counter = c + 1;
+      mutex_unlock (&s->mutex);
+    }
+}
+
+void
+test_main (void)
+{
+  struct shared *s = ACTUAL;
+  int stack_word = 0;
+  int handle;
+  pid_t child;
+
+  CHECK (create ("futex", 4096), "create \"futex\"");
+  CHECK ((handle = open ("futex")) > 1, "open \"futex\"");
+  CHECK (mmap (ACTUAL, 4096, 1, handle, 0) != MAP_FAILED, "mmap \"futex\"");
+
+  CHECK (futex_wait (&s->mutex, 1) == -1,
+         "futex_wait on a word with another value");
+  CHECK (futex_wait (&stack_word, 0) == -1,
+         "futex_wait on a word outside a file mapping");
+  CHECK (futex_wake (&s->mutex, 1) == 0, "futex_wake with no waiters");
+
+  if ((child = fork ("child")) == 0)
+    {
+      count (s);
+      exit (0);
+    }
+  count (s);
+  CHECK (wait (child) == 0, "wait for child");
+
+  if (s->counter != 2 * ITERATIONS)
+    fail ("counter is %d, should be %d", s->counter, 2 * ITERATIONS);
+  msg ("counter is %d", s->counter);
+  munmap (ACTUAL);
+  close (handle);
+}
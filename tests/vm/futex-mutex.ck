@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(futex-mutex) begin
+(futex-mutex) create "futex"
+(futex-mutex) open "futex"
+(futex-mutex) mmap "futex"
+(futex-mutex) futex_wait on a word with another value
+(futex-mutex) futex_wait on a word outside a file mapping
+(futex-mutex) futex_wake with no waiters
+(futex-mutex) wait for child
+(futex-mutex) counter is 4000
+(futex-mutex) end
+EOF
+pass;
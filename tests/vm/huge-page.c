@@ -0,0 +1,81 @@
+/* Writes every page of a 2 MB-aligned region, which the kernel
+   places in one aligned block of memory and maps with a single
+   2 MB page.  Then forks, which splits it back into 4 kB pages to
+   write-protect them, and checks that the child gets a copy of
+   the page it writes while every page of the parent stays where
+   it was, with its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define HUGE_SIZE (2 * 1024 * 1024)
+#define PAGE_COUNT (HUGE_SIZE / PAGE_SIZE)
+
+static char buf[2 * HUGE_SIZE];
+
+/* Returns true if the pages of REGION are one 2 MB-aligned block
+   of physical memory. */
+static bool
+in_place (char *region)
+{
+	uintptr_t pa = (uintptr_t) get_phys_addr (region);
+	size_t i;
+
+	if (pa % HUGE_SIZE != 0)
+		return false;
+	for (i = 0; i < PAGE_COUNT; i++)
+		if ((uintptr_t) get_phys_addr (region + i * PAGE_SIZE)
+				!= pa + i * PAGE_SIZE)
+			return false;
+	return true;
+}
+
+/* Fails unless page I of REGION holds the byte written to it,
+   except page SKIP, which holds C. */
+static void
+check (char *region, size_t skip, char c)
+{
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		if (region[i * PAGE_SIZE] != (i == skip ? c : (char) i))
+			fail ("page %zu has the wrong contents", i);
+}
+
+void
+test_main (void)
+{
+	char *region = (char *) (((uintptr_t) buf + HUGE_SIZE - 1)
+			& ~(uintptr_t) (HUGE_SIZE - 1));
+	void *pa;
+	pid_t child;
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		region[i * PAGE_SIZE] = i;
+	msg ("write every page of an aligned 2 MB region");
+	CHECK (in_place (region), "region is one aligned block");
+	pa = get_phys_addr (region + 5 * PAGE_SIZE);
+
+	child = fork ("child");
+	if (child == 0) {
+		check (region, PAGE_COUNT, 0);
+		msg ("child sees the region");
+		region[5 * PAGE_SIZE] = 'x';
+		CHECK (get_phys_addr (region + 5 * PAGE_SIZE) != pa,
+				"child's write gets a copy");
+		check (region, 5, 'x');
+		return;
+	}
+
+	wait (child);
+	CHECK (in_place (region), "parent's pages did not move");
+	region[7 * PAGE_SIZE] = 'y';
+	CHECK (in_place (region), "parent writes in place");
+	check (region, 7, 'y');
+	msg ("contents intact");
+}
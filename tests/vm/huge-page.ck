@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(huge-page) begin
+(huge-page) write every page of an aligned 2 MB region
+(huge-page) region is one aligned block
+(huge-page) child sees the region
+(huge-page) child's write gets a copy
+(huge-page) end
+(huge-page) parent's pages did not move
+(huge-page) parent writes in place
+(huge-page) contents intact
+(huge-page) end
+EOF
+
+# The region must really have been mapped with a 2 MB page.
+my (@output) = read_text_file ("$test.output");
+my ($huge) = map (/VM: (\d+) 2 MB pages mapped/ ? $1 : (), @output);
+fail "no region was mapped with a 2 MB page\n" if !$huge;
+pass;
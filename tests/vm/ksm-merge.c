@@ -0,0 +1,62 @@
+/* Fills several pages with the same bytes and waits for the merge
+   daemon, enabled with -ksm-pages, to map them all to one frame.
+   Then writes to one of them, which must get a frame of its own,
+   and checks that no page lost its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_COUNT 4
+#define WAIT_SECONDS 10
+
+static char buf[PAGE_COUNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns true if every page of BUF maps the same frame, except
+   page SKIP. */
+static bool
+merged (size_t skip)
+{
+	size_t i;
+
+	for (i = 1; i < PAGE_COUNT; i++)
+		if (i != skip && get_phys_addr (&buf[i * PAGE_SIZE]) != get_phys_addr (buf))
+			return false;
+	return true;
+}
+
+void
+test_main (void)
+{
+	struct timespec start, now;
+	size_t i, j;
+
+	msg ("fill pages");
+	memset (buf, 0x5a, sizeof buf);
+
+	/* The daemon runs in the background; spin until it gets to
+	   every page. */
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	while (!merged (PAGE_COUNT)) {
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - start.tv_sec > WAIT_SECONDS)
+			fail ("pages not merged after %d seconds", WAIT_SECONDS);
+	}
+	msg ("pages merged");
+
+	buf[PAGE_SIZE] = 0x33;
+	CHECK (get_phys_addr (&buf[PAGE_SIZE]) != get_phys_addr (buf),
+			"written page unshared");
+	CHECK (merged (1), "other pages still merged");
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++) {
+			char expected = i == 1 && j == 0 ? 0x33 : 0x5a;
+			if (buf[i * PAGE_SIZE + j] != expected)
+				fail ("byte %zu of page %zu changed", j, i);
+		}
+	msg ("contents intact");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm-merge) begin
+(ksm-merge) fill pages
+(ksm-merge) pages merged
+(ksm-merge) written page unshared
+(ksm-merge) other pages still merged
+(ksm-merge) contents intact
+(ksm-merge) end
+EOF
+pass;
@@ -0,0 +1,43 @@
+/* Verifies that a mapping may not overlap an existing one only in
+   its middle: neither a small mapping inside a larger one, nor a
+   larger one whose first and last pages are free but whose middle
+   page is mapped already.  Then checks that the first mapping
+   still reads the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  char *big = (char *) 0x10000000;
+  char *small = (char *) 0x20000000;
+  const char tag[] = "middle page";
+  int fd[4];
+
+  CHECK (create ("three", 3 * PAGE_SIZE), "create \"three\"");
+  CHECK ((fd[0] = open ("three")) > 1, "open \"three\"");
+  seek (fd[0], PAGE_SIZE);
+  CHECK (write (fd[0], tag, sizeof tag) == (int) sizeof tag,
+         "write \"three\"");
+  CHECK (mmap (big, 3 * PAGE_SIZE, 0, fd[0], 0) != MAP_FAILED,
+         "mmap \"three\"");
+
+  CHECK ((fd[1] = open ("three")) > 1, "open \"three\" again");
+  CHECK (mmap (big + PAGE_SIZE, PAGE_SIZE, 0, fd[1], 0) == MAP_FAILED,
+         "try to mmap over its middle page");
+
+  CHECK ((fd[2] = open ("three")) > 1, "open \"three\" again");
+  CHECK (mmap (small + PAGE_SIZE, PAGE_SIZE, 0, fd[2], 0) != MAP_FAILED,
+         "mmap one page elsewhere");
+  CHECK ((fd[3] = open ("three")) > 1, "open \"three\" again");
+  CHECK (mmap (small, 3 * PAGE_SIZE, 0, fd[3], 0) == MAP_FAILED,
+         "try to mmap around it");
+
+  CHECK (!memcmp (big + PAGE_SIZE, tag, sizeof tag),
+         "first mapping intact");
+}
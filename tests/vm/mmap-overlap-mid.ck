@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-overlap-mid) begin
+(mmap-overlap-mid) create "three"
+(mmap-overlap-mid) open "three"
+(mmap-overlap-mid) write "three"
+(mmap-overlap-mid) mmap "three"
+(mmap-overlap-mid) open "three" again
+(mmap-overlap-mid) try to mmap over its middle page
+(mmap-overlap-mid) open "three" again
+(mmap-overlap-mid) mmap one page elsewhere
+(mmap-overlap-mid) open "three" again
+(mmap-overlap-mid) try to mmap around it
+(mmap-overlap-mid) first mapping intact
+(mmap-overlap-mid) end
+EOF
+pass;
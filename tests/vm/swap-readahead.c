@@ -0,0 +1,49 @@
+/* Writes more memory than there is to pages that do not compress,
+   so that most go out to the swap disk, next to each other in the
+   order they were evicted.  Then reads them back, last page first,
+   so that each swap-in fault should bring in the pages in the
+   slots before its own too, and checks every page. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (16 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char chunk[CHUNK_SIZE];
+
+/* Fills page I of CHUNK with bytes that depend on I, or checks
+   that it holds them if CHECK. */
+static void
+fill (size_t i, bool check)
+{
+	uint32_t x = i * 2654435761u + 1;
+	size_t j;
+
+	for (j = 0; j < PAGE_SIZE; j++) {
+		x = x * 1103515245 + 12345;
+		if (!check)
+			chunk[i * PAGE_SIZE + j] = x >> 24;
+		else if (chunk[i * PAGE_SIZE + j] != (char) (x >> 24))
+			fail ("byte %zu of page %zu is wrong", j, i);
+	}
+}
+
+void
+test_main (void)
+{
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		fill (i, false);
+	msg ("wrote every page");
+
+	for (i = PAGE_COUNT; i-- > 0; )
+		fill (i, true);
+	msg ("read every page back in reverse");
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-readahead) begin
+(swap-readahead) wrote every page
+(swap-readahead) read every page back in reverse
+(swap-readahead) end
+EOF
+
+# Walking backward, pages must still have been read ahead.
+my (@output) = read_text_file ("$test.output");
+my ($ahead) = map (/VM: .* (\d+) read ahead/ ? $1 : (), @output);
+fail "no VM statistics\n" if !defined $ahead;
+fail "no page was read ahead\n" if $ahead == 0;
+
+# Runs of slots must have moved in fewer requests than pages.
+my ($written, $read) = map (/Swap: .* (\d+) written to disk; .* (\d+) from disk/
+			    ? ($1, $2) : (), @output);
+my ($reads, $writes) = map (/Swap: (\d+) disk reads, (\d+) disk writes/
+			    ? ($1, $2) : (), @output);
+fail "no swap statistics\n" if !defined $reads || !defined $read;
+fail "$read pages read from swap in $reads requests\n" if $reads >= $read;
+fail "$written pages written to swap in $writes requests\n"
+  if $writes >= $written;
+pass;
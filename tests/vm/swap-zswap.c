@@ -0,0 +1,45 @@
+/* Writes more memory than there is to pages that compress well,
+   with a swap disk too small to take what does not fit, so that
+   evicted pages must go to the compressed pool.  Then checks that
+   every page reads back as written, which swaps most of them in
+   from the pool. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (16 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char chunk[CHUNK_SIZE];
+
+/* Returns byte J of page I: an 8-byte pattern that differs from
+   page to page. */
+static char
+pattern (size_t i, size_t j)
+{
+	static const char tag[] = "pgXX-vm";
+
+	return j % 8 < 2 ? (char) (i >> (j % 8 * 8)) : tag[j % 8 - 1];
+}
+
+void
+test_main (void)
+{
+	size_t i, j;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++)
+			chunk[i * PAGE_SIZE + j] = pattern (i, j);
+	msg ("wrote every page");
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++)
+			if (chunk[i * PAGE_SIZE + j] != pattern (i, j))
+				fail ("byte %zu of page %zu is wrong", j, i);
+	msg ("read every page back");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-zswap) begin
+(swap-zswap) wrote every page
+(swap-zswap) read every page back
+(swap-zswap) end
+EOF
+
+# Pages must have come back from the compressed pool.
+my (@output) = read_text_file ("$test.output");
+my ($hits) = map (/Swap: .* (\d+) swap-ins from RAM/ ? $1 : (), @output);
+fail "no swap statistics\n" if !defined $hits;
+fail "no page was swapped in from the compressed pool\n" if $hits == 0;
+pass;
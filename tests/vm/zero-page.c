@@ -0,0 +1,43 @@
+/* Reads every page of a buffer larger than memory and swap
+   together, without writing any.  Pages that were never written
+   all map the one zero frame, so this needs no memory and nothing
+   is swapped out.  Then writes one page, which must get a frame
+   of its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (32 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char buf[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+	void *pa;
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		if (buf[i * PAGE_SIZE] != 0)
+			fail ("page %zu does not read as zero", i);
+	msg ("read every page");
+
+	pa = get_phys_addr (buf);
+	for (i = 1; i < PAGE_COUNT; i++)
+		if (get_phys_addr (&buf[i * PAGE_SIZE]) != pa)
+			fail ("page %zu is not on the zero frame", i);
+	msg ("all pages share one frame");
+
+	buf[PAGE_SIZE] = 1;
+	CHECK (get_phys_addr (&buf[PAGE_SIZE]) != pa, "written page gets a copy");
+	CHECK (get_phys_addr (&buf[2 * PAGE_SIZE]) == pa,
+			"other pages still share the zero frame");
+	CHECK (buf[PAGE_SIZE] == 1 && buf[PAGE_SIZE + 1] == 0 && buf[0] == 0,
+			"contents as written");
+}
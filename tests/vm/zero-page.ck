@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) read every page
+(zero-page) all pages share one frame
+(zero-page) written page gets a copy
+(zero-page) other pages still share the zero frame
+(zero-page) contents as written
+(zero-page) end
+EOF
+
+# Pages on the zero frame must never have been evicted.
+my (@output) = read_text_file ("$test.output");
+my ($evictions) = map (/VM: .* (\d+) evictions/ ? $1 : (), @output);
+fail "no VM statistics\n" if !defined $evictions;
+fail "$evictions frames evicted\n" if $evictions != 0;
+pass;
@@ -0,0 +1,337 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+#ifdef USERPROG
+#include "userprog/fpu.h"
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#include "userprog/tss.h"
+#endif
+
+/* Per-CPU state.  cpus[0] is the bootstrap processor, the one
+   that runs init.c:main().  Application processors are numbered
+   in the order they are started. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs in cpus[].  A CPU is counted from just before it
+   is started, so check its `online' member before using it. */
+int cpu_cnt = 1;
+
+/* Application processor boot code, in trampoline.S.  It is copied
+   to AP_TRAMPOLINE before the processors are started. */
+extern char ap_trampoline[], ap_trampoline_end[];
+extern char ap_cr3[], ap_stack[], ap_apic_id[];
+
+/* Page map with both identity and kernel mappings, in start.S. */
+extern uint64_t boot_pml4e[];
+
+/* Address of SYM in the copy of the trampoline at AP_TRAMPOLINE. */
+#define TRAMPOLINE_VA(SYM) \
+	((void *) ((uint8_t *) ptov (AP_TRAMPOLINE) + ((SYM) - ap_trampoline)))
+
+/* Time to wait for an application processor to come online. */
+#define AP_TIMEOUT (TIMER_FREQ / 10)
+
+/* ACPI Root System Description Pointer.  See [ACPI] 5.2.5
+   "Root System Description Pointer (RSDP)". */
+struct acpi_rsdp {
+	char signature[8];          /* "RSD PTR ". */
+	uint8_t checksum;           /* Sum of first 20 bytes is 0. */
+	char oem_id[6];
+	uint8_t revision;           /* 2 or more if XSDT_ADDR is valid. */
+	uint32_t rsdt_addr;         /* Physical address of the RSDT. */
+	uint32_t length;
+	uint64_t xsdt_addr;         /* Physical address of the XSDT. */
+} __attribute__((packed));
+
+/* Header of every ACPI System Description Table.  See [ACPI]
+   5.2.6 "System Description Table Header". */
+struct acpi_sdt {
+	char signature[4];
+	uint32_t length;            /* Including this header. */
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed));
+
+/* The MADT ("APIC") lists its interrupt controllers after the
+   header, the local APIC address and a flags word.  A processor
+   local APIC entry is type 0, 8 bytes long, and gives the APIC ID
+   in byte 3 and an "enabled" flag in bit 0 of byte 4.  See [ACPI]
+   5.2.12 "Multiple APIC Description Table (MADT)". */
+#define MADT_ENTRIES 44
+#define MADT_LAPIC 0
+#define MADT_LAPIC_ENABLED 0x1
+
+static intr_handler_func resched_interrupt;
+static int madt_find_cpus (uint32_t self, uint32_t ids[], int max);
+void ap_main (void) NO_RETURN;
+
+/* Returns the CPU that the running thread runs on.  Works even
+   before thread_init(), as long as there is only one CPU. */
+struct cpu *
+cpu_current (void) {
+	struct thread *t;
+
+	if (cpu_cnt == 1)
+		return &cpus[0];
+	t = pg_round_down (rrsp ());
+	return t->cpu;
+}
+
+/* Starts the application processors that the ACPI MADT lists,
+   up to CNT CPUs in total, and waits for each of them to start
+   scheduling threads.  From here on, turning interrupts off only
+   keeps out the running CPU's interrupt handlers; shared data
+   needs a spin lock. */
+void
+smp_init (int cnt) {
+	uint32_t ids[CPU_MAX - 1];
+	uint64_t *stack;
+	uint32_t *apic_id;
+	uint32_t self;
+	int id_cnt;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	ASSERT (cpu_cnt == 1);
+
+	if (cnt > CPU_MAX)
+		cnt = CPU_MAX;
+	if (cnt <= 1)
+		return;
+	if (!lapic_init () || !timer_lapic_init ()) {
+		printf ("No local APIC, running on one CPU.\n");
+		return;
+	}
+	self = lapic_id ();
+	id_cnt = madt_find_cpus (self, ids, cnt - 1);
+	if (id_cnt < 0) {
+		printf ("No ACPI MADT, running on one CPU.\n");
+		return;
+	}
+	cpus[0].lapic_id = self;
+	intr_register_ext (LAPIC_RESCHED_VEC, resched_interrupt,
+			"Reschedule IPI");
+
+	memcpy (ptov (AP_TRAMPOLINE), ap_trampoline,
+			ap_trampoline_end - ap_trampoline);
+	*(uint32_t *) TRAMPOLINE_VA (ap_cr3) = vtop (boot_pml4e);
+	stack = TRAMPOLINE_VA (ap_stack);
+	apic_id = TRAMPOLINE_VA (ap_apic_id);
+
+	for (int i = 0; i < id_cnt; i++) {
+		struct cpu *cpu = &cpus[cpu_cnt];
+		uint32_t apic = ids[i];
+		struct thread *t;
+		int64_t start;
+
+		cpu->id = cpu_cnt;
+		cpu->lapic_id = apic;
+		t = thread_create_idle (cpu);
+		if (t == NULL)
+			break;
+		*apic_id = apic;
+		*stack = (uint64_t) t + PGSIZE;
+		cpu_cnt++;
+
+		/* INIT-SIPI-SIPI.  See [IA32-v3a] 8.4.4.1 "Typical BSP
+		   Initialization Sequence". */
+		lapic_send_init (apic);
+		timer_msleep (10);
+		lapic_send_startup (apic, AP_TRAMPOLINE >> 12);
+		timer_usleep (200);
+		lapic_send_startup (apic, AP_TRAMPOLINE >> 12);
+
+		start = timer_ticks ();
+		while (!cpu->online && timer_elapsed (start) < AP_TIMEOUT)
+			barrier ();
+		if (!cpu->online) {
+			/* Make the processor halt if it turns up late. */
+			*stack = 0;
+			cpu_cnt--;
+			palloc_free_page (t);
+			memset (cpu, 0, sizeof *cpu);
+			break;
+		}
+	}
+	printf ("%d CPUs online.\n", cpu_cnt);
+}
+
+/* Returns the kernel virtual address of the SIZE bytes of ACPI
+   table memory at physical address PA, first mapping the pages
+   that paging_init() left out, or a null pointer if a page table
+   cannot be allocated.  ACPI tables usually sit in reserved memory
+   just below the top of RAM, beyond the memory that is mapped. */
+static void *
+acpi_map (uint64_t pa, size_t size) {
+	for (uint64_t p = pa & ~PGMASK; p < pa + size; p += PGSIZE) {
+		uint64_t *pte = pml4e_walk (base_pml4, (uint64_t) ptov (p), 1);
+
+		if (pte == NULL)
+			return NULL;
+		if (!(*pte & PTE_P))
+			*pte = p | PTE_P;
+	}
+	return ptov (pa);
+}
+
+/* Returns true if the SIZE bytes at P sum to 0 modulo 256, as
+   every ACPI structure's do. */
+static bool
+acpi_checksum_ok (const void *p, size_t size) {
+	const uint8_t *bytes = p;
+	uint8_t sum = 0;
+
+	while (size-- > 0)
+		sum += *bytes++;
+	return sum == 0;
+}
+
+/* Searches the SIZE bytes of low memory at physical address PA for
+   the RSDP, which is on a 16-byte boundary. */
+static struct acpi_rsdp *
+acpi_scan_rsdp (uint64_t pa, size_t size) {
+	for (uint64_t p = pa; p + sizeof (struct acpi_rsdp) <= pa + size; p += 16) {
+		struct acpi_rsdp *rsdp = ptov (p);
+
+		if (!memcmp (rsdp->signature, "RSD PTR ", 8)
+				&& acpi_checksum_ok (rsdp, 20))
+			return rsdp;
+	}
+	return NULL;
+}
+
+/* Maps and returns the System Description Table at physical
+   address PA, or a null pointer if it is not a valid table. */
+static struct acpi_sdt *
+acpi_map_sdt (uint64_t pa) {
+	struct acpi_sdt *sdt = acpi_map (pa, sizeof *sdt);
+
+	if (sdt == NULL || sdt->length < sizeof *sdt
+			|| acpi_map (pa, sdt->length) == NULL
+			|| !acpi_checksum_ok (sdt, sdt->length))
+		return NULL;
+	return sdt;
+}
+
+/* Returns the MADT, or a null pointer if the firmware has none.
+   See [ACPI] 5.2.5.1 "Finding the RSDP on IA-PC Systems". */
+static struct acpi_sdt *
+acpi_find_madt (void) {
+	struct acpi_rsdp *rsdp;
+	struct acpi_sdt *root;
+	size_t entry_size, entry_cnt;
+	uint64_t ebda = (uint64_t) *(uint16_t *) ptov (0x40e) << 4;
+
+	/* First 1 kB of the Extended BIOS Data Area, then the BIOS
+	   read-only memory. */
+	rsdp = ebda != 0 ? acpi_scan_rsdp (ebda, 1024) : NULL;
+	if (rsdp == NULL)
+		rsdp = acpi_scan_rsdp (0xe0000, 0x20000);
+	if (rsdp == NULL)
+		return NULL;
+
+	/* The XSDT holds 64-bit pointers, the older RSDT 32-bit ones. */
+	if (rsdp->revision >= 2 && rsdp->xsdt_addr != 0) {
+		root = acpi_map_sdt (rsdp->xsdt_addr);
+		entry_size = 8;
+	} else {
+		root = acpi_map_sdt (rsdp->rsdt_addr);
+		entry_size = 4;
+	}
+	if (root == NULL)
+		return NULL;
+
+	entry_cnt = (root->length - sizeof *root) / entry_size;
+	for (size_t i = 0; i < entry_cnt; i++) {
+		uint8_t *entry = (uint8_t *) (root + 1) + i * entry_size;
+		uint64_t pa = entry_size == 8
+			? *(uint64_t *) entry : *(uint32_t *) entry;
+		struct acpi_sdt *sdt = acpi_map_sdt (pa);
+
+		if (sdt != NULL && !memcmp (sdt->signature, "APIC", 4))
+			return sdt;
+	}
+	return NULL;
+}
+
+/* Stores in IDS the local APIC IDs of up to MAX enabled processors
+   other than the one with APIC ID SELF, in the order the MADT
+   lists them.  Returns the number stored, or -1 if there is no
+   MADT. */
+static int
+madt_find_cpus (uint32_t self, uint32_t ids[], int max) {
+	struct acpi_sdt *madt = acpi_find_madt ();
+	uint8_t *p, *end;
+	int cnt = 0;
+
+	if (madt == NULL)
+		return -1;
+
+	p = (uint8_t *) madt + MADT_ENTRIES;
+	end = (uint8_t *) madt + madt->length;
+	while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end && cnt < max) {
+		if (p[0] == MADT_LAPIC && p[1] >= 8
+				&& (p[4] & MADT_LAPIC_ENABLED) && p[3] != self)
+			ids[cnt++] = p[3];
+		p += p[1];
+	}
+	return cnt;
+}
+
+/* Makes CPU reschedule soon: wakes it up if it is idle, or
+   preempts its running thread.  Has no effect on the running
+   CPU, which should yield itself. */
+void
+cpu_kick (struct cpu *cpu) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (cpu != cpu_current () && cpu->online)
+		lapic_send_ipi (cpu->lapic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Reschedule IPI handler. */
+static void
+resched_interrupt (struct intr_frame *args UNUSED) {
+	intr_yield_on_return ();
+}
+
+/* First C code run by an application processor.  trampoline.S
+   calls it on the stack of the CPU's idle thread, with interrupts
+   off and the boot page map loaded.  The idle thread must never
+   block, which holds here because smp_init() keeps the rest of the
+   kernel waiting until this CPU is online. */
+void
+ap_main (void) {
+	/* Leave the trampoline's GDT and page map, which only live in
+	   low memory. */
+	thread_init_ap ();
+	pml4_activate (NULL);
+#ifdef USERPROG
+	tss_init ();
+	gdt_init ();
+#endif
+	intr_init_ap ();
+	lapic_init_ap ();
+#ifdef USERPROG
+	syscall_init_ap ();
+	fpu_init_ap ();
+#endif
+	timer_start_ap ();
+
+	thread_start_ap ();
+}
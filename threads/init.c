@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -20,10 +21,12 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -51,6 +54,9 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -smp: Number of CPUs to run on. */
+static int smp_cpus = 1;
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
@@ -100,11 +106,13 @@ main (void) {
 #ifdef USERPROG
 	exception_init ();
 	syscall_init ();
+	fpu_init ();
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	smp_init (smp_cpus);
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -221,15 +229,35 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-fair"))
+			thread_fair = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-smp"))
+			smp_cpus = atoi (value);
+		else if (!strcmp (name, "-lockstat"))
+			lockstat_enabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-wmark-low"))
+			vm_wmark_low = atoi (value);
+		else if (!strcmp (name, "-wmark-high"))
+			vm_wmark_high = atoi (value);
+		else if (!strcmp (name, "-ksm-pages"))
+			vm_ksm_pages = atoi (value);
+		else if (!strcmp (name, "-ksm-interval"))
+			vm_ksm_interval = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
 	}
+	if (thread_mlfqs && thread_fair)
+		PANIC ("-mlfqs and -fair are mutually exclusive");
 
 	return argv;
 }
@@ -326,8 +354,20 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -fair              Use completely fair scheduler.\n"
+			"  -tickless          Use a one-shot local APIC timer, idle without ticks.\n"
+			"  -smp=CPUS          Run on up to CPUS processors (QEMU -smp).\n"
+			"  -lockstat          Print lock contention statistics at power off.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -wmark-low=PAGES   Reclaim frames when fewer than PAGES are free\n"
+			"                     (0 disables the reclaim daemon).\n"
+			"  -wmark-high=PAGES  Reclaim until PAGES frames are free.\n"
+			"  -ksm-pages=PAGES   Compare PAGES frames per merging pass\n"
+			"                     (default 0, which disables same-page merging).\n"
+			"  -ksm-interval=TICKS  Run a merging pass every TICKS ticks.\n"
 #endif
 			);
 	power_off ();
@@ -354,12 +394,18 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	if (lockstat_enabled)
+		lockstat_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	fpu_print_stats ();
 #endif
 }
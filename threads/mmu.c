@@ -8,11 +8,54 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces the 2 MB page that PDE maps by a page table of 4 kB
+ * pages with the same permissions and accessed and dirty bits.
+ * The TLB needs no flush: the translations are unchanged.
+ * Returns false if no page table could be allocated. */
+static bool
+pde_split (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < HUGE_PGPAGES; i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
+/* Returns the page directory entry for VA in PML4, or a null
+ * pointer if there is no page directory for it.  Creates
+ * nothing. */
+static uint64_t *
+pde_lookup (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pdpe, *pd;
+
+	if (!(pml4[PML4 (va)] & PTE_P))
+		return NULL;
+	pdpe = ptov (PTE_ADDR (pml4[PML4 (va)]));
+	if (!(pdpe[PDPE (va)] & PTE_P))
+		return NULL;
+	pd = ptov (PTE_ADDR (pdpe[PDPE (va)]));
+	return &pd[PDX (va)];
+}
+
+/* A 2 MB page is its own page table entry: the walk returns its
+ * PDE, so that the dirty and accessed bits act on the whole 2 MB.
+ * A walk that CREATEs splits it into 4 kB pages first. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		if (((uint64_t) pte & PTE_P) && ((uint64_t) pte & PTE_PS)) {
+			if (!create)
+				return &pdp[idx];
+			if (!pde_split (&pdp[idx]))
+				return NULL;
+		}
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -122,7 +165,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -169,7 +212,8 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* The owner of a 2 MB page frees its frames. */
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -216,6 +260,8 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & (HUGE_PGSIZE - 1));
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -243,16 +289,59 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of user virtual memory at UPAGE to the 2 MB of
+ * physical memory at kernel virtual address KPAGE with a single
+ * page directory entry, in place of whatever page table mapped
+ * it before.  Both must be 2 MB aligned.  The frames stay the
+ * caller's to free, as with pml4_set_page().  Any later change to
+ * one 4 kB page of it splits it again.
+ * Returns true if successful, false if memory allocation
+ * failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde;
+	ASSERT (((uint64_t) upage & (HUGE_PGSIZE - 1)) == 0);
+	ASSERT (((uint64_t) kpage & (HUGE_PGSIZE - 1)) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	if (pml4e_walk (pml4, (uint64_t) upage, 1) == NULL)
+		return false;
+	pde = pde_lookup (pml4, (uint64_t) upage);
+	if (!(*pde & PTE_PS))
+		palloc_free_page (ptov (PTE_ADDR (*pde)));
+	*pde = vtop (kpage) | PTE_P | PTE_PS | (rw ? PTE_W : 0) | PTE_U;
+
+	/* The old 4 kB translations may each sit in the TLB. */
+	if (rcr3 () == vtop (pml4))
+		lcr3 (vtop (pml4));
+	return true;
+}
+
+/* Returns true if user virtual page UPAGE in PML4 is part of a
+ * 2 MB page. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *upage) {
+	uint64_t *pde = pde_lookup (pml4, (uint64_t) upage);
+	return pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
+ * bits in the page table entry are preserved.  A 2 MB page
+ * around UPAGE is split first; returns false, leaving UPAGE
+ * mapped, if there is no memory to do so.
  * UPAGE need not be mapped. */
-void
+bool
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
+	if (pml4_is_huge (pml4, upage)
+			&& !pde_split (pde_lookup (pml4, (uint64_t) upage)))
+		return false;
+
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
@@ -260,6 +349,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 		if (rcr3 () == vtop (pml4))
 			invlpg ((uint64_t) upage);
 	}
+	return true;
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -26,9 +28,11 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
-/* A memory pool. */
+/* A memory pool.  The lock is a spin lock, held with interrupts
+   off, so that pages can be freed from any context, including the
+   scheduler's, on any CPU. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
+	struct spinlock lock;           /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
 };
@@ -38,8 +42,12 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Free pages in the user pool, under its lock. */
+static size_t user_free_cnt;
 static void
-init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
+init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end,
+		const char *name);
 
 static bool page_from_pool (const struct pool *, void *page);
 
@@ -159,7 +167,8 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 					}
 					// generate kernel pool
 					init_pool (&kernel_pool,
-							&free_start, region_start, start + rem * PGSIZE);
+							&free_start, region_start, start + rem * PGSIZE,
+							"kernel pool");
 					// Transition to the next state
 					if (rem == size_in_pg) {
 						rem = user_pages;
@@ -188,7 +197,7 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 	}
 
 	// generate the user pool
-	init_pool(&user_pool, &free_start, region_start, end);
+	init_pool(&user_pool, &free_start, region_start, end, "user pool");
 
 	// Iterate over the e820_entry. Setup the usable.
 	uint64_t usable_bound = (uint64_t) free_start;
@@ -250,6 +259,8 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	user_free_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 	return ext_mem.end;
 }
 
@@ -262,10 +273,26 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	enum intr_level old_level;
 
-	lock_acquire (&pool->lock);
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
 	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	if (page_idx != BITMAP_ERROR && pool == &user_pool)
+		user_free_cnt -= page_cnt;
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
+
+	/* Out of kernel pages: give back the pages of dead threads
+	   that the thread cache keeps, and try again. */
+	if (page_idx == BITMAP_ERROR && pool == &kernel_pool
+			&& thread_cache_trim (0) > 0) {
+		old_level = intr_disable ();
+		spinlock_acquire (&pool->lock);
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+		spinlock_release (&pool->lock);
+		intr_set_level (old_level);
+	}
 	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
@@ -284,6 +311,81 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Obtains the page at kernel virtual address PAGE, from the pool
+   FLAGS selects, if it is free, and returns it.  Returns a null
+   pointer if it is in use or not in the pool; PAL_ASSERT is
+   ignored. */
+void *
+palloc_get_at (enum palloc_flags flags, void *page) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx;
+	bool got = false;
+	enum intr_level old_level;
+
+	if (pg_ofs (page) != 0 || !page_from_pool (pool, page))
+		return NULL;
+	page_idx = pg_no (page) - pg_no (pool->base);
+
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
+	if (page_idx < bitmap_size (pool->used_map)
+			&& !bitmap_test (pool->used_map, page_idx)) {
+		bitmap_mark (pool->used_map, page_idx);
+		if (pool == &user_pool)
+			user_free_cnt--;
+		got = true;
+	}
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
+
+	if (!got)
+		return NULL;
+	if (flags & PAL_ZERO)
+		memset (page, 0, PGSIZE);
+	return page;
+}
+
+/* Obtains page IDX of the first group of ALIGN_CNT pages, a power
+   of 2, that is aligned to a multiple of ALIGN_CNT pages and all
+   free, leaving the rest of the group free, and returns it.
+   Returns a null pointer if no group is free; PAL_ASSERT is
+   ignored.  Kernel virtual addresses are aligned as their
+   physical ones are, as long as ALIGN_CNT pages divide
+   KERN_BASE. */
+void *
+palloc_get_in_block (enum palloc_flags flags, size_t align_cnt,
+		size_t idx) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx, first;
+	void *page = NULL;
+	enum intr_level old_level;
+
+	ASSERT (align_cnt > 0 && (align_cnt & (align_cnt - 1)) == 0);
+	ASSERT (idx < align_cnt);
+
+	/* First index whose page is aligned. */
+	first = (align_cnt - pg_no (pool->base) % align_cnt) % align_cnt;
+
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
+	for (page_idx = first;
+			page_idx + align_cnt <= bitmap_size (pool->used_map);
+			page_idx += align_cnt)
+		if (bitmap_none (pool->used_map, page_idx, align_cnt)) {
+			bitmap_mark (pool->used_map, page_idx + idx);
+			if (pool == &user_pool)
+				user_free_cnt--;
+			page = pool->base + PGSIZE * (page_idx + idx);
+			break;
+		}
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
+
+	if (page != NULL && (flags & PAL_ZERO))
+		memset (page, 0, PGSIZE);
+	return page;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -301,6 +403,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
 	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -318,8 +421,20 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	old_level = intr_disable ();
+	spinlock_acquire (&pool->lock);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (pool == &user_pool)
+		user_free_cnt += page_cnt;
+	spinlock_release (&pool->lock);
+	intr_set_level (old_level);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_free_cnt;
 }
 
 /* Frees the page at PAGE. */
@@ -328,16 +443,18 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END */
+/* Initializes pool P as starting at START and ending at END,
+   naming its lock NAME. */
 static void
-init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
+init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end,
+		const char *name) {
   /* We'll put the pool's used_map at its base.
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
+	spinlock_init (&p->lock, name);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
 
@@ -0,0 +1,178 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include <stddef.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Statistics for -lockstat, one entry per spin lock name.  They
+   cannot go in synch.c's table, which synch_lock, itself a spin
+   lock, protects.  Entries are added under spinstat_busy, a bare
+   flag rather than a struct spinlock, and spin locks that share a
+   name may be held on several CPUs at once, so the counters are
+   updated atomically.  Once the table is full, further names
+   share the last entry. */
+static struct lockstat spinstats[SPINSTAT_MAX];
+static size_t spinstat_cnt;
+static volatile int spinstat_busy;
+
+static void spinstat_acquired (struct spinlock *, int64_t wait_start);
+static struct lockstat *spinstat_lookup (struct spinlock *);
+static void atomic_max (int64_t *, int64_t);
+
+/* Atomically stores NEW in *P and returns the old value. */
+static inline int
+xchg (volatile int *p, int new) {
+	asm volatile ("lock; xchgl %0, %1"
+			: "+r" (new), "+m" (*p) : : "memory");
+	return new;
+}
+
+/* Initializes LOCK, named NAME for debugging purposes. */
+void
+spinlock_init (struct spinlock *lock, const char *name) {
+	ASSERT (lock != NULL);
+
+	lock->locked = 0;
+	lock->cpu = NULL;
+	lock->name = name;
+	lock->stat = NULL;
+	lock->acquire_ns = 0;
+}
+
+/* Acquires LOCK, spinning until it is available.  Interrupts must
+   be off, and LOCK must not already be held by this CPU. */
+void
+spinlock_acquire (struct spinlock *lock) {
+	int64_t wait_start = -1;
+
+	ASSERT (lock != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spinlock_held_by_current_cpu (lock));
+
+	if (xchg (&lock->locked, 1) != 0) {
+		if (lockstat_enabled)
+			wait_start = timer_ns ();
+		do
+			while (lock->locked)
+				asm volatile ("pause" : : : "memory");
+		while (xchg (&lock->locked, 1) != 0);
+	}
+	lock->cpu = cpu_current ();
+	if (lockstat_enabled)
+		spinstat_acquired (lock, wait_start);
+}
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+   successful, false on failure.  Interrupts must be off. */
+bool
+spinlock_try_acquire (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (xchg (&lock->locked, 1) != 0)
+		return false;
+	lock->cpu = cpu_current ();
+	if (lockstat_enabled)
+		spinstat_acquired (lock, -1);
+	return true;
+}
+
+/* Releases LOCK, which must be held by this CPU. */
+void
+spinlock_release (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (spinlock_held_by_current_cpu (lock));
+
+	if (lock->stat != NULL) {
+		struct lockstat *stat = lock->stat;
+		int64_t held = timer_ns () - lock->acquire_ns;
+
+		__atomic_add_fetch (&stat->hold_ns, held, __ATOMIC_RELAXED);
+		atomic_max (&stat->max_hold_ns, held);
+	}
+
+	lock->cpu = NULL;
+	xchg (&lock->locked, 0);
+}
+
+/* Returns true if this CPU holds LOCK, false otherwise.  Only
+   meaningful with interrupts off, since otherwise the running
+   thread may move to another CPU at any time. */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *lock) {
+	ASSERT (lock != NULL);
+
+	return lock->locked && lock->cpu == cpu_current ();
+}
+
+/* Returns the spin lock statistics and stores their number in
+   *CNT. */
+struct lockstat *
+spinlock_stats (size_t *cnt) {
+	*cnt = spinstat_cnt;
+	return spinstats;
+}
+
+/* Records an acquisition of LOCK, which this CPU now holds.
+   WAIT_START is the timer_ns() time at which the acquirer started
+   spinning, or -1 if it did not have to spin. */
+static void
+spinstat_acquired (struct spinlock *lock, int64_t wait_start) {
+	struct lockstat *stat =
+		lock->stat != NULL ? lock->stat : spinstat_lookup (lock);
+
+	__atomic_add_fetch (&stat->acquired, 1, __ATOMIC_RELAXED);
+	if (wait_start >= 0) {
+		int64_t waited = timer_ns () - wait_start;
+
+		__atomic_add_fetch (&stat->contended, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch (&stat->wait_ns, waited, __ATOMIC_RELAXED);
+		atomic_max (&stat->max_wait_ns, waited);
+	}
+	lock->acquire_ns = timer_ns ();
+}
+
+/* Returns the statistics entry for the spin locks that have
+   LOCK's name, creating it if necessary, and caches it in LOCK. */
+static struct lockstat *
+spinstat_lookup (struct spinlock *lock) {
+	const char *name = lock->name != NULL ? lock->name : "(unnamed)";
+	size_t i;
+
+	while (xchg (&spinstat_busy, 1) != 0)
+		while (spinstat_busy)
+			asm volatile ("pause" : : : "memory");
+	for (i = 0; i < spinstat_cnt; i++)
+		if (!strcmp (spinstats[i].name, name))
+			break;
+	if (i == spinstat_cnt) {
+		if (spinstat_cnt < SPINSTAT_MAX - 1) {
+			spinstats[i].name = name;
+			spinstats[i].kind = LOCKSTAT_SPIN;
+			spinstat_cnt++;
+		} else {
+			i = SPINSTAT_MAX - 1;
+			spinstats[i].name = "(other)";
+			spinstats[i].kind = LOCKSTAT_SPIN;
+			spinstat_cnt = SPINSTAT_MAX;
+		}
+	}
+	xchg (&spinstat_busy, 0);
+
+	lock->stat = &spinstats[i];
+	return lock->stat;
+}
+
+/* Raises *MAX to VALUE, atomically, if VALUE is larger. */
+static void
+atomic_max (int64_t *max, int64_t value) {
+	int64_t old = __atomic_load_n (max, __ATOMIC_RELAXED);
+
+	while (value > old
+			&& !__atomic_compare_exchange_n (max, &old, value, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		continue;
+}
@@ -28,15 +28,75 @@
 
 #include "threads/synch.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 
+/* If true, record contention statistics.
+   Controlled by kernel command-line option "-lockstat". */
+bool lockstat_enabled;
+
+/* Statistics, one entry per distinct name of locks and one per
+   distinct name of plain semaphores.  Keying by name rather than
+   by object keeps the table bounded by the names in the source,
+   however many per-thread or per-file locks come and go, and
+   locks that must be told apart, like the disk channels', are
+   given distinct names.  Once the table is full, further names
+   share the last entry.  Spin locks keep their own table in
+   spinlock.c. */
+#define LOCKSTAT_MAX 64
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static size_t lockstat_cnt;
+
+/* Protects the state of every semaphore, lock, rwlock and
+   condition variable, and the priority donations that link them
+   through the threads holding and waiting on them.  A donation
+   walks a chain of these objects and threads, so they share one
+   spin lock instead of each having its own.  It is only held for
+   a few heap and list operations at a time, never while a thread
+   sleeps: a thread that has to wait blocks with
+   thread_block_locked(). */
+static struct spinlock synch_lock = SPINLOCK_INITIALIZER ("synch");
+
+static void sema_down_locked (struct semaphore *);
+static bool sema_try_down_locked (struct semaphore *);
+static void sema_up_locked (struct semaphore *);
+static void update_donated_priority (struct thread *);
+
+static struct lockstat *lockstat_lookup (struct semaphore *);
+static void lockstat_acquired (struct lockstat *, int64_t wait_start);
+
 /* ************************ Project 1 ************************ */
-static bool dec_pri_function(const struct list_elem *, const struct list_elem *, void *);
-static bool dec_pri_in_sema_function (const struct list_elem *, const struct list_elem *, void *);
-static bool dec_pri_in_donate_function (const struct list_elem *, const struct list_elem *, void *);
-static void remove_waiting_lock(struct lock *);
+static bool rwlock_waiter_more (const struct list_elem *,
+		const struct list_elem *, void *);
+static bool sema_waiter_less (const struct pheap_elem *, const struct pheap_elem *, void *);
+static bool cond_waiter_less (const struct pheap_elem *, const struct pheap_elem *, void *);
+static void cond_requeue (struct semaphore_elem *);
+static bool donor_less (const struct pheap_elem *, const struct pheap_elem *, void *);
+static int lock_donor_priority (struct lock *);
+
+static struct rwlock_hold *rwlock_hold_get (void);
+static void rwlock_hold_put (struct rwlock_hold *);
+static struct rwlock_hold *rwlock_find_hold (struct thread *,
+		const struct rwlock *);
+static void rwlock_add_holder (struct rwlock *, struct rwlock_hold *);
+static void rwlock_grant (struct rwlock *, bool writer_released);
+static void rwlock_donate (struct rwlock *, int priority, int depth);
+static void donate_to_thread (struct thread *, int priority, int depth);
+static int rwlock_waiter_priority (struct rwlock *);
+
+/* Maximum depth of nested priority donation. */
+#define DONATE_DEPTH_MAX 8
+
+/* Semaphores and condition variables wake their highest-priority
+   waiter first, and among waiters of equal priority the one that
+   has waited longest.  Each waiter is stamped from this counter
+   when it starts waiting.  Protected by synch_lock. */
+static uint64_t waiter_seq;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,11 +108,14 @@ static void remove_waiting_lock(struct lock *);
    - up or "V": increment the value (and wake up one waiting
    thread, if any). */
 void
-sema_init (struct semaphore *sema, unsigned value) {
+sema_init_named (struct semaphore *sema, unsigned value, const char *name) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	pheap_init (&sema->waiters, sema_waiter_less, NULL);
+	sema->name = name;
+	sema->stat = NULL;
+	sema->is_lock = false;
 }
 
 
@@ -85,12 +148,36 @@ sema_down (struct semaphore *sema) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	sema_down_locked (sema);
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+}
+
+/* sema_down() with synch_lock held. */
+static void
+sema_down_locked (struct semaphore *sema) {
+	struct lockstat *stat = NULL;
+	int64_t wait_start = -1;
+
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (lockstat_enabled) {
+		stat = lockstat_lookup (sema);
+		if (sema->value == 0)
+			wait_start = timer_ns ();
+	}
 	while (sema->value == 0) {
-		list_push_back (&sema->waiters, &thread_current ()->elem);
-		thread_block ();
+		struct thread *curr = thread_current ();
+
+		curr->wait_on_sema = sema;
+		curr->wait_seq = waiter_seq++;
+		pheap_insert (&sema->waiters, &curr->sema_elem);
+		thread_block_locked (&synch_lock);
 	}
 	sema->value--;
-	intr_set_level (old_level);
+	if (stat != NULL)
+		lockstat_acquired (stat, wait_start);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -106,18 +193,27 @@ sema_try_down (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (sema->value > 0)
-	{
-		sema->value--;
-		success = true;
-	}
-	else
-		success = false;
+	spinlock_acquire (&synch_lock);
+	success = sema_try_down_locked (sema);
+	spinlock_release (&synch_lock);
 	intr_set_level (old_level);
 
 	return success;
 }
 
+/* sema_try_down() with synch_lock held. */
+static bool
+sema_try_down_locked (struct semaphore *sema) {
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (sema->value == 0)
+		return false;
+	sema->value--;
+	if (lockstat_enabled)
+		lockstat_acquired (lockstat_lookup (sema), -1);
+	return true;
+}
+
 
 /*
 	주어진 세마포어(SEMA)의 값을 증가시키고, 만약 세마포어를 기다리는 스레드 중 하나가 있다면 깨움
@@ -138,16 +234,29 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters)) {
-		list_sort(&sema->waiters, dec_pri_function, NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
-	}
-	sema->value++;
+	spinlock_acquire (&synch_lock);
+	sema_up_locked (sema);
+	spinlock_release (&synch_lock);
 	try_yield();
 	intr_set_level (old_level);
 }
 
+/* sema_up() with synch_lock held, except that it leaves yielding
+   to a woken thread to the caller. */
+static void
+sema_up_locked (struct semaphore *sema) {
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (!pheap_empty (&sema->waiters)) {
+		struct thread *t = pheap_entry (pheap_pop_max (&sema->waiters),
+				struct thread, sema_elem);
+
+		t->wait_on_sema = NULL;
+		thread_unblock (t);
+	}
+	sema->value++;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -205,11 +314,14 @@ sema_test_helper (void *sema_) {
    해당 락의 보유자(holder)를 NULL로, 세마포어를 1로 초기화합니다.
 */
 void
-lock_init (struct lock *lock) {
+lock_init_named (struct lock *lock, const char *name) {
 	ASSERT (lock != NULL);
 
 	lock->holder = NULL;
-	sema_init (&lock->semaphore, 1);
+	sema_init_named (&lock->semaphore, 1, name);
+	lock->semaphore.is_lock = true;
+	pheap_init (&lock->donors, donor_less, NULL);
+	lock->acquire_ns = 0;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -230,29 +342,40 @@ lock_init (struct lock *lock) {
 void
 lock_acquire (struct lock *lock) {
 	struct thread *curr = thread_current();
-	
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	if (!thread_mlfqs) {
-		if (lock->semaphore.value == 0) {
-			curr->wait_on_lock = lock;
-			if (lock->holder->priority < curr->priority) {
-				list_insert_ordered(&lock->holder->donation, &curr->donation_elem, dec_pri_in_donate_function, NULL);
-				donate_priority ();
-			}
-		}
+	/* Keep synch_lock until LOCK is in our `held_locks', so that a
+	   lock with a holder is always in its heap. */
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	if (!thread_mlfqs && lock->holder != NULL) {
+		curr->wait_on_lock = lock;
+		pheap_insert (&lock->donors, &curr->donor_elem);
+		pheap_increase (&lock->holder->held_locks, &lock->elem);
+		donate_to_thread (lock->holder, curr->priority, 0);
 	}
-	
 
-	sema_down (&lock->semaphore);
+	sema_down_locked (&lock->semaphore);
 
 	if (!thread_mlfqs) {
-		curr->wait_on_lock = NULL;
+		if (curr->wait_on_lock != NULL) {
+			pheap_remove (&lock->donors, &curr->donor_elem);
+			curr->wait_on_lock = NULL;
+		}
+		/* The remaining waiters now donate to us. */
+		pheap_insert (&curr->held_locks, &lock->elem);
+		donate_to_thread (curr, lock_donor_priority (lock), 0);
 	}
 	
 	lock->holder = curr;
+	if (lockstat_enabled)
+		lock->acquire_ns = timer_ns ();
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -263,14 +386,24 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) { 
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	success = sema_try_down (&lock->semaphore);
-	if (success)
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	success = sema_try_down_locked (&lock->semaphore);
+	if (success) {
 		lock->holder = thread_current ();
+		if (!thread_mlfqs)
+			pheap_insert (&lock->holder->held_locks, &lock->elem);
+		if (lockstat_enabled)
+			lock->acquire_ns = timer_ns ();
+	}
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
 	return success;
 }
 
@@ -283,24 +416,32 @@ lock_try_acquire (struct lock *lock) {
 void
 lock_release (struct lock *lock) {
 	struct thread *curr = thread_current();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
 	if (!thread_mlfqs) {
-		remove_waiting_lock(lock);
-
-		curr->priority = curr->origin_priority;
-		if (!list_empty(&curr->donation)) {
-			struct thread *top_thread = list_entry(list_front(&curr->donation),
-												struct thread, donation_elem);
-			if (top_thread->priority > curr->priority)
-				curr->priority = top_thread->priority;
-		}
+		pheap_remove (&curr->held_locks, &lock->elem);
+		update_donated_priority (curr);
+	}
+
+	if (lock->semaphore.stat != NULL) {
+		struct lockstat *stat = lock->semaphore.stat;
+		int64_t held = timer_ns () - lock->acquire_ns;
+
+		stat->hold_ns += held;
+		if (held > stat->max_hold_ns)
+			stat->max_hold_ns = held;
 	}
-	
 
 	lock->holder = NULL;
-	sema_up (&lock->semaphore);
+	sema_up_locked (&lock->semaphore);
+	spinlock_release (&synch_lock);
+	try_yield ();
+	intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -313,10 +454,424 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* Initializes RWLOCK, named NAME for debugging purposes, as
+   held by nobody. */
+void
+rwlock_init_named (struct rwlock *rw, const char *name) {
+	ASSERT (rw != NULL);
+
+	rw->writer = NULL;
+	rw->readers = 0;
+	list_init (&rw->holders);
+	list_init (&rw->read_waiters);
+	list_init (&rw->write_waiters);
+	rw->name = name;
+}
+
+/* Acquires RW for shared access, sleeping until it is available
+   if necessary.  RW must not already be held by the current
+   thread.  Waits if another thread holds RW exclusively or is
+   waiting to do so.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	hold = rwlock_hold_get ();
+	if (hold == NULL)
+		PANIC ("rwlock_acquire_read: out of memory");
+
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	hold->rwlock = rw;
+	if (rw->writer == NULL && list_empty (&rw->write_waiters)) {
+		rw->readers++;
+		rwlock_add_holder (rw, hold);
+	} else {
+		/* rwlock_grant() makes us a holder before waking us up. */
+		curr->wait_on_rwlock = rw;
+		list_push_back (&rw->read_waiters, &hold->elem);
+		if (!thread_mlfqs)
+			rwlock_donate (rw, curr->priority, 0);
+		thread_block_locked (&synch_lock);
+	}
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for exclusive access, sleeping until it is
+   available if necessary.  RW must not already be held by the
+   current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	hold = rwlock_hold_get ();
+	if (hold == NULL)
+		PANIC ("rwlock_acquire_write: out of memory");
+
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	hold->rwlock = rw;
+	if (rw->writer == NULL && rw->readers == 0) {
+		rw->writer = curr;
+		rwlock_add_holder (rw, hold);
+	} else {
+		curr->wait_on_rwlock = rw;
+		list_push_back (&rw->write_waiters, &hold->elem);
+		if (!thread_mlfqs)
+			rwlock_donate (rw, curr->priority, 0);
+		thread_block_locked (&synch_lock);
+	}
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for shared access without sleeping.
+   Returns true if successful, false on failure, including if
+   memory to record the hold cannot be allocated. */
+bool
+rwlock_try_acquire_read (struct rwlock *rw) {
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (rw != NULL);
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	hold = rwlock_hold_get ();
+	if (hold == NULL)
+		return false;
+
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	success = rw->writer == NULL && list_empty (&rw->write_waiters);
+	if (success) {
+		rw->readers++;
+		hold->rwlock = rw;
+		rwlock_add_holder (rw, hold);
+	}
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+
+	if (!success)
+		rwlock_hold_put (hold);
+	return success;
+}
+
+/* Tries to acquire RW for exclusive access without sleeping.
+   Returns true if successful, false on failure, including if
+   memory to record the hold cannot be allocated. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw) {
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (rw != NULL);
+	ASSERT (!rwlock_held_by_current_thread (rw));
+
+	hold = rwlock_hold_get ();
+	if (hold == NULL)
+		return false;
+
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	success = rw->writer == NULL && rw->readers == 0;
+	if (success) {
+		rw->writer = thread_current ();
+		hold->rwlock = rw;
+		rwlock_add_holder (rw, hold);
+	}
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+
+	if (!success)
+		rwlock_hold_put (hold);
+	return success;
+}
+
+/* Releases RW, which the current thread must hold, shared or
+   exclusively.  A writer hands RW to all waiting readers if there
+   are any, otherwise to the highest-priority waiting writer; the
+   last reader hands it to the highest-priority waiting writer. */
+void
+rwlock_release (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+	enum intr_level old_level;
+	bool writer_released;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	hold = rwlock_find_hold (curr, rw);
+	ASSERT (hold != NULL);
+	list_remove (&hold->elem);
+	list_remove (&hold->thread_elem);
+
+	writer_released = rw->writer == curr;
+	if (writer_released)
+		rw->writer = NULL;
+	else
+		rw->readers--;
+	if (rw->readers == 0)
+		rwlock_grant (rw, writer_released);
+
+	if (!thread_mlfqs)
+		update_donated_priority (curr);
+	spinlock_release (&synch_lock);
+	try_yield ();
+	intr_set_level (old_level);
+
+	rwlock_hold_put (hold);
+}
+
+/* Returns true if the current thread holds RW, shared or
+   exclusively, false otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rwlock_find_hold (thread_current (), rw) != NULL;
+}
+
+/* Returns true if the current thread holds RW exclusively, false
+   otherwise. */
+bool
+rwlock_write_held_by_current_thread (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rw->writer == thread_current ();
+}
+
+/* Returns an unused hold for the current thread: one of its
+   built-in ones if any is free, otherwise a newly allocated one,
+   or a null pointer if memory is exhausted.  May sleep, so it
+   must be called before taking synch_lock. */
+static struct rwlock_hold *
+rwlock_hold_get (void) {
+	struct thread *curr = thread_current ();
+	struct rwlock_hold *hold;
+
+	/* Only the current thread takes or returns its own holds. */
+	for (int i = 0; i < RWLOCK_HOLD_SLOTS; i++)
+		if (curr->rwlock_hold_slots[i].thread == NULL) {
+			hold = &curr->rwlock_hold_slots[i];
+			hold->thread = curr;
+			return hold;
+		}
+
+	hold = malloc (sizeof *hold);
+	if (hold != NULL)
+		hold->thread = curr;
+	return hold;
+}
+
+/* Returns HOLD, which rwlock_hold_get() gave the current thread
+   and is no longer in any list. */
+static void
+rwlock_hold_put (struct rwlock_hold *hold) {
+	struct thread *curr = thread_current ();
+
+	ASSERT (hold->thread == curr);
+	if (hold >= curr->rwlock_hold_slots
+			&& hold < curr->rwlock_hold_slots + RWLOCK_HOLD_SLOTS)
+		hold->thread = NULL;
+	else
+		free (hold);
+}
+
+/* Returns T's hold on RW, or a null pointer if T does not hold
+   RW. */
+static struct rwlock_hold *
+rwlock_find_hold (struct thread *t, const struct rwlock *rw) {
+	struct list_elem *e;
+
+	for (e = list_begin (&t->rwlock_holds); e != list_end (&t->rwlock_holds);
+			e = list_next (e)) {
+		struct rwlock_hold *hold = list_entry (e, struct rwlock_hold,
+				thread_elem);
+		if (hold->rwlock == rw)
+			return hold;
+	}
+	return NULL;
+}
+
+/* Makes HOLD's thread a holder of RW.  synch_lock must be held. */
+static void
+rwlock_add_holder (struct rwlock *rw, struct rwlock_hold *hold) {
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+	ASSERT (hold->rwlock == rw);
+
+	list_push_back (&rw->holders, &hold->elem);
+	list_push_back (&hold->thread->rwlock_holds, &hold->thread_elem);
+}
+
+/* Hands RW, which nobody holds, to its waiters: all of the
+   waiting readers if WRITER_RELEASED or no writer is waiting,
+   otherwise the highest-priority waiting writer.  The remaining
+   waiters then donate to the new holders.  synch_lock must be
+   held. */
+static void
+rwlock_grant (struct rwlock *rw, bool writer_released) {
+	struct rwlock_hold *hold;
+
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+	ASSERT (rw->writer == NULL && rw->readers == 0);
+
+	if (!list_empty (&rw->read_waiters)
+			&& (writer_released || list_empty (&rw->write_waiters))) {
+		while (!list_empty (&rw->read_waiters)) {
+			hold = list_entry (list_pop_front (&rw->read_waiters),
+					struct rwlock_hold, elem);
+			hold->thread->wait_on_rwlock = NULL;
+			rw->readers++;
+			rwlock_add_holder (rw, hold);
+			thread_unblock (hold->thread);
+		}
+	} else if (!list_empty (&rw->write_waiters)) {
+		/* rwlock_waiter_more() sorts higher priorities first. */
+		struct list_elem *e = list_min (&rw->write_waiters,
+				rwlock_waiter_more, NULL);
+
+		list_remove (e);
+		hold = list_entry (e, struct rwlock_hold, elem);
+		hold->thread->wait_on_rwlock = NULL;
+		rw->writer = hold->thread;
+		rwlock_add_holder (rw, hold);
+		thread_unblock (hold->thread);
+	}
+
+	if (!thread_mlfqs)
+		rwlock_donate (rw, rwlock_waiter_priority (rw), 0);
+}
+
+/* Donates PRIORITY to every holder of RW.  DEPTH is the current
+   nesting depth of donation. */
+static void
+rwlock_donate (struct rwlock *rw, int priority, int depth) {
+	struct list_elem *e;
+
+	for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+			e = list_next (e))
+		donate_to_thread (list_entry (e, struct rwlock_hold, elem)->thread,
+				priority, depth);
+}
+
+/* Raises T's priority to PRIORITY, if it is lower, and passes the
+   donation on to whatever T is waiting for.  synch_lock must be
+   held. */
+static void
+donate_to_thread (struct thread *t, int priority, int depth) {
+	if (depth >= DONATE_DEPTH_MAX || t->priority >= priority)
+		return;
+
+	thread_set_effective_priority (t, priority);
+	if (t->wait_on_lock != NULL && t->wait_on_lock->holder != NULL) {
+		struct lock *lock = t->wait_on_lock;
+
+		pheap_increase (&lock->donors, &t->donor_elem);
+		pheap_increase (&lock->holder->held_locks, &lock->elem);
+		donate_to_thread (lock->holder, priority, depth + 1);
+	}
+	else if (t->wait_on_rwlock != NULL)
+		rwlock_donate (t->wait_on_rwlock, priority, depth + 1);
+}
+
+/* Returns the highest priority among RW's waiters, or PRI_MIN if
+   there are none. */
+static int
+rwlock_waiter_priority (struct rwlock *rw) {
+	int priority = PRI_MIN;
+	struct list *lists[] = { &rw->read_waiters, &rw->write_waiters };
+
+	for (int i = 0; i < 2; i++) {
+		struct list_elem *e;
+
+		for (e = list_begin (lists[i]); e != list_end (lists[i]);
+				e = list_next (e)) {
+			struct thread *t = list_entry (e, struct rwlock_hold, elem)->thread;
+			if (t->priority > priority)
+				priority = t->priority;
+		}
+	}
+	return priority;
+}
+
+/* Returns the highest priority among the threads waiting for
+   LOCK, or PRI_MIN if there are none. */
+static int
+lock_donor_priority (struct lock *lock) {
+	if (pheap_empty (&lock->donors))
+		return PRI_MIN;
+	return pheap_entry (pheap_max (&lock->donors), struct thread,
+			donor_elem)->priority;
+}
+
+/* Recomputes T's priority from its base priority and the
+   priorities donated to it through the locks and rwlocks it
+   holds.  T must be the running thread. */
+void
+refresh_donated_priority (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+
+	spinlock_acquire (&synch_lock);
+	update_donated_priority (t);
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+}
+
+/* refresh_donated_priority() with synch_lock held. */
+static void
+update_donated_priority (struct thread *t) {
+	int priority = t->origin_priority;
+	struct list_elem *e;
+
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (!pheap_empty (&t->held_locks)) {
+		struct lock *top = pheap_entry (pheap_max (&t->held_locks),
+				struct lock, elem);
+		if (lock_donor_priority (top) > priority)
+			priority = lock_donor_priority (top);
+	}
+	for (e = list_begin (&t->rwlock_holds); e != list_end (&t->rwlock_holds);
+			e = list_next (e)) {
+		struct rwlock *rw = list_entry (e, struct rwlock_hold,
+				thread_elem)->rwlock;
+		if (rwlock_waiter_priority (rw) > priority)
+			priority = rwlock_waiter_priority (rw);
+	}
+	t->priority = priority;
+}
+
+/* One thread waiting on a condition variable. */
 struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
+	struct pheap_elem elem;             /* Element in `waiters'. */
 	struct semaphore semaphore;         /* This semaphore. */
+	struct condition *cond;             /* Condition waited on. */
+	struct thread *thread;              /* Waiting thread. */
+	int priority;                       /* Its priority when filed. */
+	uint64_t seq;                       /* Arrival order. */
 };
 
 /*
@@ -329,7 +884,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	pheap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* 
@@ -340,14 +895,16 @@ cond_init (struct condition *cond) {
    현재 스레드가 주어진 락을 보유하고 있어야 합니다.
    
    기다리는 동안 세마포어 요소의 세마포어를 0으로 초기화하고,
-   대기 리스트에는 스레드들을 우선순위 기준으로 정렬하여 삽입합니다.
+   대기 큐에는 스레드들을 우선순위 기준으로 삽입합니다.
    
    락을 해제하고 대기 상태로 들어간 후, 실제로 깨어나려면 다른 스레드에서
    조건 변수에 signal 또는 broadcast를 호출해야 합니다.
 */
 void
 cond_wait (struct condition *cond, struct lock *lock) {
+	struct thread *curr = thread_current ();
 	struct semaphore_elem waiter;
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
@@ -355,15 +912,34 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
-	list_insert_ordered (&cond->waiters, &waiter.elem, dec_pri_in_sema_function, NULL);
+	waiter.cond = cond;
+	waiter.thread = curr;
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	waiter.priority = curr->priority;
+	waiter.seq = waiter_seq++;
+	pheap_insert (&cond->waiters, &waiter.elem);
+	curr->cond_waiter = &waiter;
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+
 	lock_release (lock);
+
+	/* Releasing LOCK may have cost us a donated priority. */
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	if (curr->cond_waiter != NULL)
+		cond_requeue (curr->cond_waiter);
+	spinlock_release (&synch_lock);
+	intr_set_level (old_level);
+
 	sema_down (&waiter.semaphore);
 	lock_acquire (lock);
 }
 
 /*
    Condition Variable에서 대기 중인 스레드 중 하나를 깨웁니다.
-   대기 중인 스레드가 있을 경우, 대기 리스트를 우선순위 기준으로 정렬하고,
+   대기 중인 스레드가 있을 경우, 대기 큐에서
    가장 우선순위가 높은 스레드를 깨워서 대기 상태에서 깨어나게 합니다.
    
    주어진 락이 현재 스레드에 의해 보유되고 있어야 하며,
@@ -371,16 +947,25 @@ cond_wait (struct condition *cond, struct lock *lock) {
 */
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) {
+	enum intr_level old_level;
+
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters)) {
-		list_sort(&cond->waiters, dec_pri_in_sema_function, NULL);
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
+	old_level = intr_disable ();
+	spinlock_acquire (&synch_lock);
+	if (!pheap_empty (&cond->waiters)) {
+		struct semaphore_elem *waiter = pheap_entry (
+				pheap_pop_max (&cond->waiters), struct semaphore_elem, elem);
+
+		waiter->thread->cond_waiter = NULL;
+		sema_up_locked (&waiter->semaphore);
 	}
+	spinlock_release (&synch_lock);
+	try_yield ();
+	intr_set_level (old_level);
 }
 
 /*
@@ -395,57 +980,196 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!pheap_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
-/*
-   리스트 정렬에서 사용되는 스레드 우선순위에 따른 비교 함수입니다.
-   이 함수는 두 리스트 요소 간의 비교를 수행하고, 정렬 순서를 결정합니다.
-*/
-static bool 
-dec_pri_function(const struct list_elem *a, const struct list_elem *b, void *aux) {
-    return list_entry(a, struct thread, elem)->priority > list_entry(b, struct thread, elem)->priority;
+
+/* Orders the holds waiting on a rwlock by decreasing priority of
+   their threads. */
+static bool
+rwlock_waiter_more (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct rwlock_hold, elem)->thread->priority
+		> list_entry (b, struct rwlock_hold, elem)->thread->priority;
 }
 
-/*
-   세마포어의 대기 리스트에서 스레드 우선순위에 따른 비교 함수입니다.
-   이 함수는 두 세마포어 요소의 대기 스레드 중 가장 높은 우선순위를 비교하여 정렬합니다.
-*/
-static bool 
-dec_pri_in_sema_function (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
-	struct semaphore_elem *sema_a = list_entry(a, struct semaphore_elem, elem);
-	struct semaphore_elem *sema_b = list_entry(b, struct semaphore_elem, elem);
+/* Orders the threads waiting on a semaphore by priority, then by
+   arrival, earliest on top. */
+static bool
+sema_waiter_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = pheap_entry (a_, struct thread, sema_elem);
+	const struct thread *b = pheap_entry (b_, struct thread, sema_elem);
+
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return a->wait_seq > b->wait_seq;
+}
+
+/* Orders the waiters on a condition variable the same way. */
+static bool
+cond_waiter_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct semaphore_elem *a = pheap_entry (a_, struct semaphore_elem, elem);
+	const struct semaphore_elem *b = pheap_entry (b_, struct semaphore_elem, elem);
 
-	return list_entry(list_begin(&sema_a->semaphore.waiters), struct thread, elem)->priority 
-	> list_entry(list_begin(&sema_b->semaphore.waiters), struct thread, elem)->priority;
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return a->seq > b->seq;
 }
 
-static bool 
-dec_pri_in_donate_function (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
-	return list_entry(a, struct thread, donation_elem)->priority > list_entry(b, struct thread, donation_elem)->priority;
+/* Moves condition variable waiter W to the place its thread's
+   current priority calls for.  synch_lock must be held. */
+static void
+cond_requeue (struct semaphore_elem *w) {
+	int priority = w->thread->priority;
+
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (priority > w->priority) {
+		w->priority = priority;
+		pheap_increase (&w->cond->waiters, &w->elem);
+	} else if (priority < w->priority) {
+		pheap_remove (&w->cond->waiters, &w->elem);
+		w->priority = priority;
+		pheap_insert (&w->cond->waiters, &w->elem);
+	}
 }
 
-/*
- * 현재 스레드의 기부 리스트에서 지정된 락을 기다리는 스레드를 제거
-*/
+/* Moves T, whose priority has just changed from OLD_PRIORITY, to
+   its new place among the waiters of the semaphore or condition
+   variable it is waiting on, if any.  synch_lock must be held,
+   which it is whenever thread_set_effective_priority() is
+   called. */
+void
+synch_requeue_waiter (struct thread *t, int old_priority) {
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (t->wait_on_sema != NULL) {
+		struct pheap *waiters = &t->wait_on_sema->waiters;
+
+		if (t->priority > old_priority)
+			pheap_increase (waiters, &t->sema_elem);
+		else if (t->priority < old_priority) {
+			pheap_remove (waiters, &t->sema_elem);
+			pheap_insert (waiters, &t->sema_elem);
+		}
+	}
+	if (t->cond_waiter != NULL)
+		cond_requeue (t->cond_waiter);
+}
+
+/* Orders donors, the threads waiting for a lock, by priority. */
+static bool
+donor_less (const struct pheap_elem *a, const struct pheap_elem *b,
+		void *aux UNUSED) {
+	return pheap_entry (a, struct thread, donor_elem)->priority
+		< pheap_entry (b, struct thread, donor_elem)->priority;
+}
+
+/* Orders the locks in a thread's `held_locks' by the priority of
+   their highest-priority donor. */
+bool
+held_lock_less (const struct pheap_elem *a, const struct pheap_elem *b,
+		void *aux UNUSED) {
+	return lock_donor_priority (pheap_entry (a, struct lock, elem))
+		< lock_donor_priority (pheap_entry (b, struct lock, elem));
+}
+
+/* Returns the statistics entry for SEMA, creating it if
+   necessary: the entry for the locks or for the plain semaphores
+   that have SEMA's name.  synch_lock must be held. */
+static struct lockstat *
+lockstat_lookup (struct semaphore *sema) {
+	enum lockstat_kind kind = sema->is_lock ? LOCKSTAT_LOCK : LOCKSTAT_SEMA;
+	const char *name;
+	size_t i;
+
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	if (sema->stat != NULL)
+		return sema->stat;
+
+	name = sema->name != NULL ? sema->name : "(unnamed)";
+	for (i = 0; i < lockstat_cnt; i++)
+		if (lockstats[i].kind == kind && !strcmp (lockstats[i].name, name))
+			break;
+	if (i == lockstat_cnt) {
+		if (lockstat_cnt < LOCKSTAT_MAX - 1) {
+			lockstats[i].name = name;
+			lockstats[i].kind = kind;
+			lockstat_cnt++;
+		} else {
+			i = LOCKSTAT_MAX - 1;
+			lockstats[i].name = "(other)";
+			lockstats[i].kind = LOCKSTAT_SEMA;
+			lockstat_cnt = LOCKSTAT_MAX;
+		}
+	}
+	sema->stat = &lockstats[i];
+	return sema->stat;
+}
+
+/* Records an acquisition in STAT.  WAIT_START is the timer_ns()
+   time at which the acquirer started waiting, or -1 if it did not have
+   to wait.  synch_lock must be held. */
 static void
-remove_waiting_lock(struct lock *lock) {
-	struct list *donation = &(thread_current()->donation); 
-    struct list_elem *donor_elem;	
-    struct thread *donor_thread;
-
-    if (list_empty(donation))
-        return;
-
-    donor_elem = list_front(donation);
-
-    while (1)
-    {
-        donor_thread = list_entry(donor_elem, struct thread, donation_elem);
-        if (donor_thread->wait_on_lock == lock)		   
-            list_remove(&donor_thread->donation_elem); 
-        donor_elem = list_next(donor_elem);
-        if (donor_elem == list_end(donation))
-            return;
-    }
-}
\ No newline at end of file
+lockstat_acquired (struct lockstat *stat, int64_t wait_start) {
+	ASSERT (spinlock_held_by_current_cpu (&synch_lock));
+
+	stat->acquired++;
+	if (wait_start >= 0) {
+		int64_t waited = timer_ns () - wait_start;
+
+		stat->contended++;
+		stat->wait_ns += waited;
+		if (waited > stat->max_wait_ns)
+			stat->max_wait_ns = waited;
+	}
+}
+
+/* Orders lockstat pointers by decreasing total wait, then by
+   decreasing number of contended acquisitions. */
+static int
+lockstat_compare (const void *a_, const void *b_) {
+	const struct lockstat *a = *(const struct lockstat **) a_;
+	const struct lockstat *b = *(const struct lockstat **) b_;
+
+	if (a->wait_ns != b->wait_ns)
+		return a->wait_ns > b->wait_ns ? -1 : 1;
+	if (a->contended != b->contended)
+		return a->contended > b->contended ? -1 : 1;
+	return 0;
+}
+
+/* Prints lock contention statistics of semaphores, locks and
+   spin locks, most contended first.  Times are in microseconds. */
+void
+lockstat_print_stats (void) {
+	static const char *kinds[] = { "sema", "lock", "spin" };
+	struct lockstat *sorted[LOCKSTAT_MAX + SPINSTAT_MAX];
+	struct lockstat *spinstats;
+	size_t spin_cnt;
+	size_t cnt, i;
+
+	cnt = 0;
+	for (i = 0; i < lockstat_cnt; i++)
+		sorted[cnt++] = &lockstats[i];
+	spinstats = spinlock_stats (&spin_cnt);
+	for (i = 0; i < spin_cnt; i++)
+		sorted[cnt++] = &spinstats[i];
+	qsort (sorted, cnt, sizeof *sorted, lockstat_compare);
+
+	printf ("Lockstat: %-20s %4s %10s %10s %10s %8s %10s %8s\n", "name",
+			"kind", "acquired", "contended", "wait us", "max", "hold us", "max");
+	for (i = 0; i < cnt; i++) {
+		const struct lockstat *s = sorted[i];
+
+		if (s->acquired == 0)
+			continue;
+		printf ("Lockstat: %-20s %4s %10lld %10lld %10lld %8lld %10lld %8lld\n",
+				s->name, kinds[s->kind], s->acquired, s->contended,
+				s->wait_ns / 1000, s->max_wait_ns / 1000, s->hold_ns / 1000,
+				s->max_hold_ns / 1000);
+	}
+}
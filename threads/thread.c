@@ -2,13 +2,17 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/spinlock.h"
+#include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
@@ -25,12 +29,30 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, wait in the run queue of
+   a CPU (struct runqueue in cpu.h).  There is one FIFO queue per
+   priority level; bit P of a run queue's mask is set iff its
+   queue P is non-empty, so the highest ready priority is found
+   with a single bit scan.  A ready thread's `cpu' member names the
+   CPU whose run queue it is on.  A CPU whose run queue is empty
+   steals from the others before it goes idle.
+
+   Turning interrupts off only keeps out the running CPU's own
+   interrupt handlers, so the state shared between CPUs here has
+   spin locks of its own: each run queue has its `lock', and the
+   sleep wheel, the thread cache and the EDF load have the locks
+   declared with them below.  Locks are taken in this order:
+   synch.c's lock, then sleep_lock, then a run queue lock.  A CPU
+   that holds its own run queue lock only try-acquires another's.
+
+   A CPU holds its run queue lock across each thread switch.  The
+   thread switched to finishes the switch in schedule_tail(): it
+   clears the `on_cpu' member of the thread switched away from and
+   releases the lock.  A thread that blocks is marked blocked under
+   the lock that protects whatever it waits on, and whoever wakes
+   it up waits for `on_cpu' to clear before queuing it, so that no
+   CPU resumes a thread whose registers are still being saved. */
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -38,8 +60,19 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
-/* Thread destruction requests */
-static struct list destruction_req;
+/* Pages of dead threads, kept for reuse by thread_create() so
+   that spawning a thread usually takes neither the page
+   allocator's lock nor a page of zeroing.  schedule() only files
+   pages here.  thread_create() trims the cache back to
+   THREAD_CACHE_MAX once it has grown past that, and the page
+   allocator empties it when it runs out of kernel pages. */
+#define THREAD_CACHE_MAX 16
+static struct spinlock thread_cache_lock =
+	SPINLOCK_INITIALIZER ("thread_cache");
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;     /* # of pages reused. */
+static long long thread_cache_misses;   /* # of pages allocated. */
 
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
@@ -48,30 +81,126 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+
+/* Offset of `stack' member within `struct thread'.
+   Used by switch.S, which can't figure it out on its own. */
+const size_t thread_stack_ofs = offsetof (struct thread, stack);
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler instead of the
+   priority queues.  Controlled by kernel command-line option
+   "-fair". */
+bool thread_fair;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static void do_schedule(int status);
+static struct thread *thread_page_alloc (void);
 static void schedule (void);
+static void schedule_tail (void);
 static tid_t allocate_tid (void);
-static void thread_launch (struct thread *);
+
+static void ready_queue_push (struct thread *);
+static struct thread *ready_queue_pop (struct cpu *);
+static void ready_queue_remove (struct thread *);
+static struct thread *runqueue_peek (struct runqueue *);
+static void ready_queue_rebuild (thread_action_func *, void *aux);
+static struct thread *ready_queue_steal (struct cpu *);
+static struct cpu *ready_queue_place (struct thread *);
+static bool thread_is_idle (const struct thread *);
+
+/* Earliest-deadline-first scheduling.  EDF threads run ahead of
+   every priority class, earliest absolute deadline first.  Each
+   is given a budget of CPU time per period; a thread that uses up
+   its budget is throttled, that is, it sleeps until its next
+   period begins, so that an overrunning EDF thread cannot starve
+   the priority classes.  Admission control keeps the sum of the
+   EDF threads' densities, runtime / deadline, at or below
+   EDF_LOAD_MAX out of EDF_SCALE, which on one CPU lets every
+   admitted thread meet its deadlines and leaves the rest of the
+   CPU to the priority classes. */
+#define EDF_SCALE 1000
+#define EDF_LOAD_MAX 900
+static struct spinlock edf_lock = SPINLOCK_INITIALIZER ("edf");
+static int edf_load;                /* Sum of admitted densities. */
+static long long edf_jobs;          /* # of EDF jobs completed. */
+static long long edf_misses;        /* # of them that missed their deadline. */
+static long long edf_throttles;     /* # of times a budget ran out. */
+
+static bool thread_is_edf (const struct thread *);
+static bool thread_more_urgent (const struct thread *, const struct thread *);
+static bool edf_less (const struct pheap_elem *, const struct pheap_elem *,
+		void *aux);
+static void edf_replenish (struct thread *, int64_t now);
+static bool edf_throttle (struct thread *);
+
+/* Completely fair scheduling, selected by -fair in place of the
+   priority classes.  Each thread accumulates virtual runtime, its
+   CPU time scaled down by the weight its nice value maps to, and
+   the ready thread with the least virtual runtime runs next, so
+   that over time every thread receives CPU in proportion to its
+   weight.  A run queue keeps its threads in a red-black tree keyed
+   by virtual runtime, and tracks MIN_VRUNTIME, a lower bound that
+   only moves forward, to place threads that join it.  A waking
+   thread is placed no more than FAIR_SLEEPER_CREDIT behind it, so
+   sleeping does not bank CPU time.  A thread preempts another only
+   once it is behind by more than FAIR_WAKEUP_GRAN, which keeps
+   equally weighted threads from switching on every tick. */
+#define FAIR_TICK ((int64_t) 1 << 20)           /* One tick at nice 0. */
+#define FAIR_WAKEUP_GRAN FAIR_TICK
+#define FAIR_SLEEPER_CREDIT (3 * FAIR_TICK)
+#define NICE_0_WEIGHT 1024
+
+static bool fair_less (const struct rbtree_elem *,
+		const struct rbtree_elem *, void *aux);
+static int64_t fair_delta (const struct thread *);
+static void fair_update_min (struct runqueue *, const struct thread *curr);
+static void fair_place (struct thread *, struct cpu *from, struct cpu *to);
 
 /* ************************ Project 1 ************************ */
-static struct list sleeping_list;
-static bool inc_function(const struct list_elem *, const struct list_elem *, void *);
-static bool dec_function(const struct list_elem *, const struct list_elem *, void *);
+
+/* Sleeping threads live on a hierarchical timing wheel.  Level L
+   has WHEEL_SLOTS slots, each covering WHEEL_SLOTS^L ticks, so a
+   thread is filed in O(1) by the distance to its wakeup tick and
+   the timer interrupt only drains one level-0 slot per tick.
+   Entries of a higher-level slot are cascaded down when the wheel
+   reaches the start of the range that slot covers.  Wakeups beyond
+   the top level wait on sleep_overflow.  All of it is protected by
+   sleep_lock. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+static struct list sleep_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static struct list sleep_overflow;
+static int64_t wheel_now;           /* Last tick processed by the wheel. */
+static struct spinlock sleep_lock = SPINLOCK_INITIALIZER ("sleep");
+
+static void sleep_wheel_add (struct thread *, int64_t ticks);
+static void sleep_wheel_insert (struct thread *);
+static void sleep_wheel_cascade (int level);
 static int fixed_point_round(int32_t, int);
 static int32_t load_avg;
+
+/* recent_cpu is decayed once a second, but only the running and
+   ready threads are decayed on the spot.  Blocked threads keep the
+   epoch of their last decay and catch up from decay_history when
+   they are unblocked.  A thread blocked for longer than the history
+   covers has its oldest missed decays approximated by the oldest
+   recorded coefficient. */
+#define DECAY_HISTORY 128
+static int32_t decay_history[DECAY_HISTORY];
+static int64_t decay_epoch;         /* Decays performed so far. */
+
 static void calculate_recent_cpu(struct thread *, void *);
+static void mlfqs_update(struct thread *, void *);
 static void calculate_priority(struct thread *, void *);
 
 #define FP_SHIFT 14
@@ -95,6 +224,10 @@ static void calculate_priority(struct thread *, void *);
 // Because the gdt will be setup after the thread_init, we should
 // setup temporal gdt first.
 static uint64_t gdt[3] = { 0, 0x00af9a000000ffff, 0x00cf92000000ffff };
+static struct desc_ptr gdt_ds = {
+	.size = sizeof (gdt) - 1,
+	.address = (uint64_t) gdt
+};
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -116,23 +249,81 @@ thread_init (void) {
 	/* Reload the temporal gdt for the kernel
 	 * This gdt does not include the user context.
 	 * The kernel will rebuild the gdt with user context, in gdt_init (). */
-	struct desc_ptr gdt_ds = {
-		.size = sizeof (gdt) - 1,
-		.address = (uint64_t) gdt
-	};
 	lgdt (&gdt_ds);
 
 	/* Init the globla thread context */
-	lock_init (&tid_lock);
-	list_init (&ready_list);
-	list_init (&sleeping_list);
-	list_init (&destruction_req);
+	lock_init_named (&tid_lock, "tid_lock");
+	for (int i = 0; i < CPU_MAX; i++) {
+		struct runqueue *rq = &cpus[i].rq;
+
+		pheap_init (&rq->edf, edf_less, NULL);
+		for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+			list_init (&rq->queues[pri]);
+		rq->mask = 0;
+		rbtree_init (&rq->fair, fair_less, NULL);
+		rq->min_vruntime = 0;
+		rq->cnt = 0;
+		spinlock_init (&rq->lock, "runqueue");
+	}
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+		for (int slot = 0; slot < WHEEL_SLOTS; slot++)
+			list_init (&sleep_wheel[level][slot]);
+	list_init (&sleep_overflow);
+	wheel_now = 0;
+	list_init (&thread_cache);
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
 	initial_thread->tid = allocate_tid ();
+	initial_thread->on_cpu = true;
+	initial_thread->cpu = &cpus[0];
+	cpus[0].curr = initial_thread;
+	cpus[0].online = true;
+}
+
+/* Loads the temporary GDT on an application processor, which is
+   still running on the trampoline's. */
+void
+thread_init_ap (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lgdt (&gdt_ds);
+}
+
+/* Allocates the idle thread of application processor CPU.  The
+   processor starts up on this thread's stack, then idles on it.
+   Returns a null pointer if memory is exhausted. */
+struct thread *
+thread_create_idle (struct cpu *cpu) {
+	struct thread *t;
+	char name[16];
+
+	t = palloc_get_page (PAL_ZERO);
+	if (t == NULL)
+		return NULL;
+
+	snprintf (name, sizeof name, "idle%d", cpu->id);
+	init_thread (t, name, PRI_MIN);
+	t->status = THREAD_RUNNING;
+	t->tid = allocate_tid ();
+	t->on_cpu = true;
+	t->cpu = cpu;
+	cpu->idle = cpu->curr = t;
+	return t;
+}
+
+/* Puts the running application processor into service: it starts
+   taking threads from the run queues and becomes its idle thread
+   whenever there is nothing to run. */
+void
+thread_start_ap (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	cpu_current ()->online = true;
+	idle (NULL);
+	NOT_REACHED ();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -149,7 +340,7 @@ thread_start (void) {
 	/* Start preemptive thread scheduling. */
 	intr_enable ();
 
-	/* Wait for the idle thread to initialize idle_thread. */
+	/* Wait for the idle thread to register itself. */
 	sema_down (&idle_started);
 }
 
@@ -158,10 +349,13 @@ thread_start (void) {
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *cpu = t->cpu;
 
 	/* Update statistics. */
-	if (t == idle_thread)
+	if (t == cpu->idle) {
 		idle_ticks++;
+		cpu->idle_ticks++;
+	}
 
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
@@ -170,8 +364,30 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+	/* Charge EDF threads for the tick.  One whose budget has run
+	   out is throttled when it yields. */
+	if (thread_is_edf (t)) {
+		edf_replenish (t, timer_ticks ());
+		if (++t->edf_used >= t->edf_runtime)
+			intr_yield_on_return ();
+	}
+
+	/* Charge -fair threads for the tick, and give way to a ready
+	   thread that has fallen far enough behind. */
+	else if (thread_fair && t != cpu->idle) {
+		struct thread *next;
+
+		t->vruntime += fair_delta (t);
+		spinlock_acquire (&cpu->rq.lock);
+		fair_update_min (&cpu->rq, t);
+		next = runqueue_peek (&cpu->rq);
+		if (next != NULL && thread_more_urgent (next, t))
+			intr_yield_on_return ();
+		spinlock_release (&cpu->rq.lock);
+	}
+
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++cpu->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
@@ -180,6 +396,14 @@ void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	if (cpu_cnt > 1)
+		for (int i = 0; i < cpu_cnt; i++)
+			printf ("CPU %d: %lld ticks, %lld idle ticks, %lld steals\n",
+					i, cpus[i].ticks, cpus[i].idle_ticks, cpus[i].steals);
+	printf ("Thread cache: %lld hits, %lld misses\n",
+			thread_cache_hits, thread_cache_misses);
+	printf ("EDF: %lld jobs, %lld deadline misses, %lld throttles\n",
+			edf_jobs, edf_misses, edf_throttles);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -200,35 +424,46 @@ thread_print_stats (void) {
 tid_t
 thread_create (const char *name, int priority,
 		thread_func *function, void *aux) {
+	struct switch_threads_frame *sf;
 	struct thread *t;
 	tid_t tid;
 
 	ASSERT (function != NULL);
 
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = thread_page_alloc ();
 	if (t == NULL)
 		return TID_ERROR;
+	/* Unlocked peek; thread_cache_trim() rechecks under the lock. */
+	if (thread_cache_cnt > THREAD_CACHE_MAX)
+		thread_cache_trim (THREAD_CACHE_MAX);
 
 	/* Initialize thread. */
 	init_thread (t, name, priority);
 
 	tid = t->tid = allocate_tid ();
 
-	/* Call the kernel_thread if it scheduled.
-	 * Note) rdi is 1st argument, and rsi is 2nd argument. */
-	t->tf.rip = (uintptr_t) kernel_thread;
-	t->tf.R.rdi = (uint64_t) function;
-	t->tf.R.rsi = (uint64_t) aux;
-	t->tf.ds = SEL_KDSEG;
-	t->tf.es = SEL_KDSEG;
-	t->tf.ss = SEL_KDSEG;
-	t->tf.cs = SEL_KCSEG;
-	t->tf.eflags = FLAG_IF;
+	/* Call the kernel_thread when it is first switched to.  The
+	 * frame sits 16 bytes below the top of the stack, so that
+	 * switch_entry() calls kernel_thread with the stack aligned as
+	 * the ABI requires. */
+	sf = (struct switch_threads_frame *) ((uint8_t *) t + PGSIZE - 16) - 1;
+	sf->r12 = (uint64_t) function;
+	sf->r13 = (uint64_t) aux;
+	sf->r14 = (uint64_t) kernel_thread;
+	sf->rbp = 0;
+	sf->rip = switch_entry;
+	t->stack = (uint8_t *) sf;
 
 	/* Inherit parent's recent_cpu value. */
     struct thread *parent_thread = thread_current ();
     t->recent_cpu = parent_thread->recent_cpu;
+	t->decay_epoch = parent_thread->decay_epoch;
+
+	/* Start out on the creating thread's CPU, level with the
+	   threads already there. */
+	t->cpu = parent_thread->cpu;
+	t->vruntime = t->cpu->rq.min_vruntime;
 
 	/* Initialize load, exit flag, load_semaphore */
 	t->exit_status = NULL;
@@ -237,20 +472,24 @@ thread_create (const char *name, int priority,
 	sema_init(&t->wait_sema, 0);
 	sema_init(&t->free_sema, 0);
 
-	/* Add info about parent & child process */
-	t->parent_process = parent_thread;
-	list_push_back(&parent_thread->child_process, &t->child_elem);
-
+#ifdef USERPROG
 	// Initialize fd_table
 	t->fd_table = palloc_get_page(PAL_ZERO);
-	if (t->fd_table == NULL)
+	if (t->fd_table == NULL) {
+		palloc_free_page (t);
 		return TID_ERROR;
+	}
 
 	t->run_file = NULL;
 	
 	t->fd_table[0] = 0;	// std_in
 	t->fd_table[1] = 1;	// std_out
 	t->fd_idx = 2;
+#endif
+
+	/* Add info about parent & child process */
+	t->parent_process = parent_thread;
+	list_push_back(&parent_thread->child_process, &t->child_elem);
 
 	/* Add to run queue. */
 	thread_unblock (t);
@@ -265,13 +504,35 @@ thread_create (const char *name, int priority,
 
    This function must be called with interrupts turned off.  It
    is usually a better idea to use one of the synchronization
-   primitives in synch.h. */
+   primitives in synch.h.  With more than one CPU, a thread that
+   waits for another to wake it up should use
+   thread_block_locked() instead. */
 void
 thread_block (void) {
+	thread_block_locked (NULL);
+}
+
+/* Like thread_block(), but releases spin lock LOCK, which the
+   caller holds, once the current thread is marked blocked, and
+   reacquires it before returning.  A thread that queues itself on
+   some object under LOCK and then blocks this way cannot miss a
+   wakeup from another CPU that takes it off the object under
+   LOCK.  LOCK may be null. */
+void
+thread_block_locked (struct spinlock *lock) {
+	struct thread *curr = thread_current ();
+	struct cpu *cpu = curr->cpu;
+
 	ASSERT (!intr_context ());
 	ASSERT (intr_get_level () == INTR_OFF);
-	thread_current ()->status = THREAD_BLOCKED;
+
+	spinlock_acquire (&cpu->rq.lock);
+	curr->status = THREAD_BLOCKED;
+	if (lock != NULL)
+		spinlock_release (lock);
 	schedule ();
+	if (lock != NULL)
+		spinlock_acquire (lock);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -285,16 +546,57 @@ thread_block (void) {
 void
 thread_unblock (struct thread *t) {
 	enum intr_level old_level;
+	struct cpu *cpu, *last_cpu;
+	bool kick;
 
 	ASSERT (is_thread (t));
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
 
-	list_insert_ordered (&ready_list, &(t->elem), dec_function, NULL);
+	/* T may have blocked on another CPU that is still switching
+	   away from it. */
+	while (t->on_cpu)
+		asm volatile ("pause" : : : "memory");
+
+	/* A throttled EDF thread sleeps on until its next period. */
+	if (thread_is_edf (t)) {
+		bool throttled;
+
+		spinlock_acquire (&sleep_lock);
+		throttled = edf_throttle (t);
+		spinlock_release (&sleep_lock);
+		if (throttled) {
+			intr_set_level (old_level);
+			return;
+		}
+	}
 
+	/* Apply the recent_cpu decays missed while blocked. */
+	if (thread_mlfqs)
+		mlfqs_update (t, NULL);
+
+	last_cpu = t->cpu;
+	cpu = ready_queue_place (t);
+	spinlock_acquire (&cpu->rq.lock);
+	if (thread_fair)
+		fair_place (t, last_cpu, cpu);
+	t->cpu = cpu;
+	ready_queue_push (t);
 	t->status = THREAD_READY;
-	intr_set_level (old_level);	
+	kick = thread_more_urgent (t, cpu->curr) || cpu->curr == cpu->idle;
+	spinlock_release (&cpu->rq.lock);
+
+	/* Another CPU preempts for T, or wakes up to run it, at once.
+	   An EDF thread woken by an interrupt on this CPU preempts on
+	   return from the interrupt rather than at the next time
+	   slice. */
+	if (kick) {
+		if (thread_is_edf (t) && intr_context () && cpu == cpu_current ())
+			intr_yield_on_return ();
+		cpu_kick (cpu);
+	}
+	intr_set_level (old_level);
 }
 
 /* Returns the name of the running thread. */
@@ -340,6 +642,9 @@ thread_exit (void) {
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	spinlock_acquire (&edf_lock);
+	edf_load -= thread_current ()->edf_density;
+	spinlock_release (&edf_lock);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -354,43 +659,190 @@ thread_yield (void) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_insert_ordered (&ready_list, &(curr->elem), dec_function, NULL);
-	do_schedule (THREAD_READY);
+	if (thread_is_edf (curr)) {
+		spinlock_acquire (&sleep_lock);
+		if (edf_throttle (curr)) {
+			thread_block_locked (&sleep_lock);
+			spinlock_release (&sleep_lock);
+			intr_set_level (old_level);
+			return;
+		}
+		spinlock_release (&sleep_lock);
+	}
+
+	spinlock_acquire (&curr->cpu->rq.lock);
+	if (!thread_is_idle (curr))
+		ready_queue_push (curr);
+	curr->status = THREAD_READY;
+	schedule ();
 	intr_set_level (old_level);
 }
 
+/* Blocks the current thread until the timer reaches tick TICKS.
+   A wakeup tick that has already passed wakes the thread on the
+   next tick. */
 void
 thread_sleep (int64_t ticks) {
 	enum intr_level old_level;
 	struct thread *curr = thread_current ();
 
-	ASSERT(curr != idle_thread);
+	ASSERT(!thread_is_idle (curr));
 
 	old_level = intr_disable ();
-
-	curr->wakeup_ticks = ticks;
-
-	list_insert_ordered (&sleeping_list, &(curr->elem), inc_function, NULL);
-	thread_block ();
-	
+	spinlock_acquire (&sleep_lock);
+	sleep_wheel_add (curr, ticks);
+	thread_block_locked (&sleep_lock);
+	spinlock_release (&sleep_lock);
 	intr_set_level (old_level);
 }
 
+/* Advances the sleep wheel up to tick TICKS and unblocks every
+   thread whose wakeup tick has been reached.  Called from the timer
+   interrupt. */
 void
 thread_wakeup(int64_t ticks) {
-	if (list_empty(&sleeping_list))
-		return;
-	
-    while (!list_empty(&sleeping_list)) {
-		struct thread *curr = list_entry(list_front(&sleeping_list), struct thread, elem);
-        if (curr->wakeup_ticks <= ticks) {
-			list_remove(list_front(&sleeping_list));
-			thread_unblock(curr);
-        } else {
-            break;
-        }
-    }
+	struct list due;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* Unblocking may take sleep_lock again, for a throttled EDF
+	   thread, so collect the due threads first. */
+	list_init (&due);
+	spinlock_acquire (&sleep_lock);
+	while (wheel_now < ticks) {
+		struct list *slot;
+
+		wheel_now++;
+
+		/* Cascade from the top so that entries dropping into a
+		   lower level slot that is due now are cascaded again. */
+		if ((wheel_now & ((1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0) {
+			struct list overflow;
+
+			list_init (&overflow);
+			while (!list_empty (&sleep_overflow))
+				list_push_back (&overflow, list_pop_front (&sleep_overflow));
+			while (!list_empty (&overflow))
+				sleep_wheel_insert (list_entry (list_pop_front (&overflow),
+							struct thread, elem));
+		}
+		for (int level = WHEEL_LEVELS - 1; level > 0; level--)
+			if ((wheel_now & ((1LL << (WHEEL_BITS * level)) - 1)) == 0)
+				sleep_wheel_cascade (level);
+
+		slot = &sleep_wheel[0][wheel_now & WHEEL_MASK];
+		while (!list_empty (slot)) {
+			struct thread *t = list_entry (list_pop_front (slot), struct thread, elem);
+			ASSERT (t->wakeup_ticks == wheel_now);
+			t->sleeping = false;
+			list_push_back (&due, &t->elem);
+		}
+	}
+	spinlock_release (&sleep_lock);
+
+	while (!list_empty (&due))
+		thread_unblock (list_entry (list_pop_front (&due), struct thread, elem));
+}
+
+/* Returns the earliest tick at which the sleep wheel needs the
+   timer: a thread's wakeup tick or the start of a higher-level
+   slot that must be cascaded.  Returns INT64_MAX if no thread is
+   sleeping.  Used to skip ticks while the CPU is idle. */
+int64_t
+thread_next_wakeup (void) {
+	int64_t next = INT64_MAX;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	spinlock_acquire (&sleep_lock);
+	for (int level = 0; level < WHEEL_LEVELS; level++) {
+		int shift = WHEEL_BITS * level;
+
+		for (int64_t i = 1; i <= WHEEL_SLOTS; i++) {
+			int64_t at = ((wheel_now >> shift) + i) << shift;
+			if (at >= next)
+				break;
+			if (!list_empty (&sleep_wheel[level][(at >> shift) & WHEEL_MASK])) {
+				next = at;
+				break;
+			}
+		}
+	}
+	if (!list_empty (&sleep_overflow)) {
+		int shift = WHEEL_BITS * WHEEL_LEVELS;
+		int64_t at = ((wheel_now >> shift) + 1) << shift;
+		if (at < next)
+			next = at;
+	}
+	spinlock_release (&sleep_lock);
+	return next;
+}
+
+/* Wakes up sleeping thread T before its wakeup tick.  Returns
+   false if T is not sleeping. */
+bool
+thread_sleep_cancel (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	bool sleeping;
+
+	spinlock_acquire (&sleep_lock);
+	sleeping = t->sleeping;
+	if (sleeping) {
+		list_remove (&t->elem);
+		t->sleeping = false;
+	}
+	spinlock_release (&sleep_lock);
+
+	if (sleeping)
+		thread_unblock (t);
+	intr_set_level (old_level);
+	return sleeping;
+}
+
+/* Files T on the sleep wheel to wake up at tick TICKS, or at the
+   next tick if TICKS has already been processed.  sleep_lock must
+   be held. */
+static void
+sleep_wheel_add (struct thread *t, int64_t ticks) {
+	ASSERT (spinlock_held_by_current_cpu (&sleep_lock));
+
+	t->wakeup_ticks = ticks > wheel_now ? ticks : wheel_now + 1;
+	sleep_wheel_insert (t);
+}
+
+/* Files sleeping thread T in the wheel slot that covers its
+   wakeup tick, relative to the current wheel position. */
+static void
+sleep_wheel_insert (struct thread *t) {
+	int64_t delta = t->wakeup_ticks - wheel_now;
+	struct list *slot = &sleep_overflow;
+
+	ASSERT (spinlock_held_by_current_cpu (&sleep_lock));
+	ASSERT (delta >= 0);
+
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+		if (delta < (1LL << (WHEEL_BITS * (level + 1)))) {
+			int idx = (t->wakeup_ticks >> (WHEEL_BITS * level)) & WHEEL_MASK;
+			slot = &sleep_wheel[level][idx];
+			break;
+		}
+	list_push_back (slot, &t->elem);
+	t->sleeping = true;
+}
+
+/* Moves the entries of the LEVEL slot that starts at the current
+   wheel position down to the lower levels. */
+static void
+sleep_wheel_cascade (int level) {
+	struct list *slot =
+		&sleep_wheel[level][(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	struct list due;
+
+	list_init (&due);
+	while (!list_empty (slot))
+		list_push_back (&due, list_pop_front (slot));
+	while (!list_empty (&due))
+		sleep_wheel_insert (list_entry (list_pop_front (&due), struct thread, elem));
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
@@ -400,13 +852,7 @@ thread_set_priority (int new_priority) {
 	struct thread *curr = thread_current();
 	if (!thread_mlfqs) {
 		curr->origin_priority = new_priority;
-
-		if (list_empty(&curr->donation)) {
-			curr->priority = new_priority;
-		}
-		else if (curr->priority < new_priority){
-			curr->priority = new_priority;
-		}
+		refresh_donated_priority (curr);
 		try_yield();
 	}
 	intr_set_level(old_level);
@@ -418,6 +864,97 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
+/* Moves the running thread into the EDF class.  From now on, in
+   every PERIOD timer ticks starting now, it is given RUNTIME ticks
+   of CPU time ahead of all the priority classes, to be done within
+   DEADLINE ticks of the period's start.  The thread should call
+   thread_edf_wait() at the end of each period's work.  A thread
+   already in the EDF class is given the new parameters.
+
+   Returns false, leaving the thread as it was, if admitting it
+   would take the EDF threads' load above EDF_LOAD_MAX.  Requires
+   0 < RUNTIME <= DEADLINE <= PERIOD. */
+bool
+thread_set_edf (int64_t runtime, int64_t deadline, int64_t period) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	int density;
+
+	ASSERT (0 < runtime && runtime <= deadline && deadline <= period);
+
+	density = DIV_ROUND_UP (runtime * EDF_SCALE, deadline);
+	old_level = intr_disable ();
+	spinlock_acquire (&edf_lock);
+	if (edf_load - curr->edf_density + density > EDF_LOAD_MAX) {
+		spinlock_release (&edf_lock);
+		intr_set_level (old_level);
+		return false;
+	}
+	edf_load += density - curr->edf_density;
+	spinlock_release (&edf_lock);
+	curr->edf_density = density;
+	curr->edf_runtime = runtime;
+	curr->edf_deadline_rel = deadline;
+	curr->edf_period = period;
+	curr->edf_release = timer_ticks ();
+	curr->edf_deadline = curr->edf_release + deadline;
+	curr->edf_job_deadline = curr->edf_deadline;
+	curr->edf_used = 0;
+	try_yield ();
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Returns the running thread to its priority class. */
+void
+thread_clear_edf (void) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level = intr_disable ();
+
+	spinlock_acquire (&edf_lock);
+	edf_load -= curr->edf_density;
+	spinlock_release (&edf_lock);
+	curr->edf_density = 0;
+	curr->edf_period = 0;
+	try_yield ();
+	intr_set_level (old_level);
+}
+
+/* Ends the running EDF thread's work for its current period and
+   sleeps until the next period begins.  A thread that finishes
+   late starts the period it is in at once.  Returns false if the
+   work missed its deadline. */
+bool
+thread_edf_wait (void) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	int64_t now, next;
+	bool met;
+
+	ASSERT (thread_is_edf (curr));
+
+	old_level = intr_disable ();
+	now = timer_ticks ();
+	met = now <= curr->edf_job_deadline;
+	spinlock_acquire (&edf_lock);
+	edf_jobs++;
+	if (!met)
+		edf_misses++;
+	spinlock_release (&edf_lock);
+
+	next = curr->edf_release + curr->edf_period;
+	if (now < next) {
+		spinlock_acquire (&sleep_lock);
+		sleep_wheel_add (curr, next);
+		thread_block_locked (&sleep_lock);
+		spinlock_release (&sleep_lock);
+	}
+	edf_replenish (curr, timer_ticks ());
+	curr->edf_job_deadline = curr->edf_deadline;
+	intr_set_level (old_level);
+	return met;
+}
+
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int new_nice UNUSED) {
@@ -471,23 +1008,31 @@ void  thread_foreach (thread_action_func *func, struct list *li, void *aux) {
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it registers itself as its CPU's idle thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty.  Application processors enter here from
+   thread_start_ap() with IDLE_STARTED_ null. */
 static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
-	sema_up (idle_started);
+	if (idle_started != NULL) {
+		cpu_current ()->idle = thread_current ();
+		sema_up (idle_started);
+	}
 
 	for (;;) {
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
 
+		/* Nothing else to run, so let a tickless timer stay quiet
+		   until the next sleeping thread is due. */
+		timer_idle_enter ();
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -501,6 +1046,9 @@ idle (void *idle_started_ UNUSED) {
 		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
 		   7.11.1 "HLT Instruction". */
 		asm volatile ("sti; hlt" : : : "memory");
+
+		intr_disable ();
+		timer_idle_exit ();
 	}
 }
 
@@ -509,6 +1057,7 @@ static void
 kernel_thread (thread_func *function, void *aux) {
 	ASSERT (function != NULL);
 
+	schedule_tail ();     /* Finish the switch to us. */
 	intr_enable ();       /* The scheduler runs with interrupts off. */
 	function (aux);       /* Execute the thread function. */
 	thread_exit ();       /* If function() returns, kill the thread. */
@@ -528,7 +1077,6 @@ init_thread (struct thread *t, const char *name, int priority) {
 	
 	strlcpy (t->name, name, sizeof t->name);
 
-	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
 	t->priority = priority;
 	t->magic = THREAD_MAGIC;
 	/* project 1 */
@@ -536,7 +1084,9 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->wait_on_lock = NULL;
 	t->nice = 0;
 	t->recent_cpu = 0;
-	list_init(&t->donation);
+	t->decay_epoch = decay_epoch;
+	pheap_init (&t->held_locks, held_lock_less, NULL);
+	list_init (&t->rwlock_holds);
 
 	/* project 2 */
 	list_init(&t->child_process);
@@ -546,21 +1096,398 @@ init_thread (struct thread *t, const char *name, int priority) {
 	/* project 3 */
 	t->user_rsp = NULL;
 	list_init(&t->mmap_info_list);
-	list_init(&t->fcfs_cache);
 	#endif
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in the run queue.)  If the run queue is empty, steal
+   from another CPU, or return the idle thread.  The running CPU's
+   run queue lock must be held. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *cpu = cpu_current ();
+	struct thread *t;
+
+	if (cpu->rq.cnt != 0)
+		return ready_queue_pop (cpu);
+	t = ready_queue_steal (cpu);
+	return t != NULL ? t : cpu->idle;
+}
+
+/* Returns true if T is the idle thread of some CPU. */
+static bool
+thread_is_idle (const struct thread *t) {
+	return t->cpu != NULL && t == t->cpu->idle;
+}
+
+/* Returns the highest priority in run queue RQ, or -1 if RQ is
+   empty. */
+static inline int
+runqueue_max_priority (const struct runqueue *rq) {
+	if (rq->mask == 0)
+		return -1;
+	return 63 - __builtin_clzll (rq->mask);
+}
+
+/* Adds T to the run queue of T's CPU, whose lock must be held: to
+   the EDF threads if T is one, to the -fair tree by T's virtual
+   runtime, or else at the back of the ready queue of its current
+   priority. */
+static void
+ready_queue_push (struct thread *t) {
+	struct runqueue *rq = &t->cpu->rq;
+
+	ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+
+	/* Pairs with the fence in thread_set_effective_priority(): a
+	   priority change made while we file T either shows up below
+	   or finds T already on the run queue. */
+	t->rq_cpu = t->cpu;
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	t->rq_priority = t->priority;
+
+	if (thread_is_edf (t))
+		pheap_insert (&rq->edf, &t->edf_elem);
+	else if (thread_fair)
+		rbtree_insert (&rq->fair, &t->fair_elem);
+	else {
+		ASSERT (PRI_MIN <= t->rq_priority && t->rq_priority <= PRI_MAX);
+		list_push_back (&rq->queues[t->rq_priority], &t->elem);
+		rq->mask |= 1ULL << t->rq_priority;
+	}
+	rq->cnt++;
+}
+
+/* Removes and returns the thread that should run next from CPU's
+   run queue, which must not be empty and whose lock must be held:
+   the EDF thread with the earliest deadline, or else the -fair
+   thread with the least virtual runtime or the first thread of the
+   highest non-empty ready queue. */
+static struct thread *
+ready_queue_pop (struct cpu *cpu) {
+	struct runqueue *rq = &cpu->rq;
+	struct thread *t;
+
+	ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+	ASSERT (rq->cnt > 0);
+
+	if (!pheap_empty (&rq->edf))
+		t = pheap_entry (pheap_pop_max (&rq->edf), struct thread, edf_elem);
+	else if (thread_fair) {
+		t = rbtree_entry (rbtree_min (&rq->fair), struct thread, fair_elem);
+		rbtree_remove (&rq->fair, &t->fair_elem);
+	} else {
+		int pri = runqueue_max_priority (rq);
+
+		t = list_entry (list_pop_front (&rq->queues[pri]), struct thread, elem);
+		if (list_empty (&rq->queues[pri]))
+			rq->mask &= ~(1ULL << pri);
+	}
+	rq->cnt--;
+	t->rq_cpu = NULL;
+	return t;
+}
+
+/* Removes ready thread T from its run queue, whose lock must be
+   held, e.g. before changing T's priority. */
+static void
+ready_queue_remove (struct thread *t) {
+	struct runqueue *rq = &t->rq_cpu->rq;
+
+	ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+
+	if (thread_is_edf (t))
+		pheap_remove (&rq->edf, &t->edf_elem);
+	else if (thread_fair)
+		rbtree_remove (&rq->fair, &t->fair_elem);
+	else {
+		list_remove (&t->elem);
+		if (list_empty (&rq->queues[t->rq_priority]))
+			rq->mask &= ~(1ULL << t->rq_priority);
+	}
+	rq->cnt--;
+	t->rq_cpu = NULL;
+}
+
+/* Returns the thread that ready_queue_pop() would take from RQ,
+   without removing it, or a null pointer if RQ is empty.  RQ's
+   lock must be held. */
+static struct thread *
+runqueue_peek (struct runqueue *rq) {
+	if (!pheap_empty (&rq->edf))
+		return pheap_entry (pheap_max (&rq->edf), struct thread, edf_elem);
+	if (thread_fair)
+		return rbtree_empty (&rq->fair) ? NULL
+			: rbtree_entry (rbtree_min (&rq->fair), struct thread, fair_elem);
+	if (rq->mask == 0)
+		return NULL;
+	return list_entry (list_front (&rq->queues[runqueue_max_priority (rq)]),
+			struct thread, elem);
+}
+
+/* Invokes FUNC, which may change the thread's priority, on every
+   ready thread in the priority classes and files each thread
+   under its new priority.  Threads that end up at the same
+   priority keep their relative order. */
+static void
+ready_queue_rebuild (thread_action_func *func, void *aux) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct runqueue *rq = &cpus[i].rq;
+		struct list all;
+
+		spinlock_acquire (&rq->lock);
+		list_init (&all);
+		for (int pri = PRI_MAX; pri >= PRI_MIN; pri--)
+			while (!list_empty (&rq->queues[pri])) {
+				list_push_back (&all, list_pop_front (&rq->queues[pri]));
+				rq->cnt--;
+			}
+		rq->mask = 0;
+
+		while (!list_empty (&all)) {
+			struct thread *t = list_entry (list_pop_front (&all), struct thread, elem);
+			func (t, aux);
+			ready_queue_push (t);
+		}
+		spinlock_release (&rq->lock);
+	}
+}
+
+/* Takes the most urgent thread off the other run queues for idle
+   CPU THIEF, from the busiest queue among those it is first on.
+   Returns a null pointer if no other CPU has a thread ready.
+   THIEF's run queue lock must be held, so the others' are only
+   try-acquired, and a queue that is busy is passed over. */
+static struct thread *
+ready_queue_steal (struct cpu *thief) {
+	struct cpu *victim = NULL;
+	struct thread *best = NULL;
+
+	ASSERT (spinlock_held_by_current_cpu (&thief->rq.lock));
+
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct cpu *cpu = &cpus[i];
+		struct thread *t;
+
+		if (cpu == thief || cpu->rq.cnt == 0
+				|| !spinlock_try_acquire (&cpu->rq.lock))
+			continue;
+		t = runqueue_peek (&cpu->rq);
+		if (t != NULL && (best == NULL || thread_more_urgent (t, best)
+					|| (!thread_more_urgent (best, t)
+						&& cpu->rq.cnt > victim->rq.cnt))) {
+			/* Keep the best queue so far locked. */
+			if (victim != NULL)
+				spinlock_release (&victim->rq.lock);
+			victim = cpu;
+			best = t;
+		} else
+			spinlock_release (&cpu->rq.lock);
+	}
+	if (victim == NULL)
+		return NULL;
+	thief->steals++;
+	best = ready_queue_pop (victim);
+	if (thread_fair)
+		fair_place (best, victim, thief);
+	spinlock_release (&victim->rq.lock);
+	return best;
+}
+
+/* Chooses the CPU on whose run queue T, which is about to become
+   ready, should wait: its last CPU, unless another CPU is idle or
+   runs a thread less urgent than T there.  Looks at the other CPUs
+   without their locks, so the choice is only a good guess. */
+static struct cpu *
+ready_queue_place (struct thread *t) {
+	struct cpu *home = t->cpu;
+	struct cpu *best;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (home == NULL || !home->online)
+		home = cpu_current ();
+	if (cpu_cnt == 1 || home->curr == home->idle)
+		return home;
+
+	best = home;
+	for (int i = 0; i < cpu_cnt; i++) {
+		struct cpu *cpu = &cpus[i];
+
+		if (!cpu->online)
+			continue;
+		if (cpu->curr == cpu->idle)
+			return cpu;
+		if (thread_more_urgent (best->curr, cpu->curr))
+			best = cpu;
+	}
+	return thread_more_urgent (t, best->curr) ? best : home;
+}
+
+/* Returns true if T is in the EDF class. */
+static bool
+thread_is_edf (const struct thread *t) {
+	return t->edf_period != 0;
+}
+
+/* Returns true if thread A should run before thread B: A is an
+   EDF thread and B is not, both are EDF threads and A's deadline
+   is earlier, or neither is and A's priority is higher or, under
+   -fair, A is behind B by more than the wakeup granularity. */
+static bool
+thread_more_urgent (const struct thread *a, const struct thread *b) {
+	if (thread_is_edf (a) != thread_is_edf (b))
+		return thread_is_edf (a);
+	if (thread_is_edf (a))
+		return a->edf_deadline < b->edf_deadline;
+	if (thread_fair)
+		return a->vruntime + FAIR_WAKEUP_GRAN < b->vruntime;
+	return a->priority > b->priority;
+}
+
+/* Orders EDF threads so that the earliest deadline is on top. */
+static bool
+edf_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = pheap_entry (a_, struct thread, edf_elem);
+	const struct thread *b = pheap_entry (b_, struct thread, edf_elem);
+
+	return a->edf_deadline > b->edf_deadline;
+}
+
+/* Starts EDF thread T's latest period if its current one ended
+   before tick NOW: replenishes its budget and moves its deadline.
+   Interrupts must be off. */
+static void
+edf_replenish (struct thread *t, int64_t now) {
+	int64_t periods;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (now < t->edf_release + t->edf_period)
+		return;
+	periods = (now - t->edf_release) / t->edf_period;
+	t->edf_release += periods * t->edf_period;
+	t->edf_deadline = t->edf_release + t->edf_deadline_rel;
+	t->edf_used = 0;
+}
+
+/* If EDF thread T has used up its budget for the current period,
+   files it on the sleep wheel until the next one and returns
+   true.  T must be running or blocked.  sleep_lock must be
+   held. */
+static bool
+edf_throttle (struct thread *t) {
+	edf_replenish (t, timer_ticks ());
+	if (t->edf_used < t->edf_runtime)
+		return false;
+
+	sleep_wheel_add (t, t->edf_release + t->edf_period);
+	edf_throttles++;
+	return true;
+}
+
+/* Weights of nice values -20 through 19, each about 1.25 times
+   the next, so that one step of nice changes a thread's share of
+   a contended CPU by about 10%. */
+static const int fair_weights[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+/* Orders -fair threads by virtual runtime. */
+static bool
+fair_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = rbtree_entry (a_, struct thread, fair_elem);
+	const struct thread *b = rbtree_entry (b_, struct thread, fair_elem);
+
+	return a->vruntime < b->vruntime;
+}
+
+/* Returns the virtual runtime that one tick of CPU time costs T. */
+static int64_t
+fair_delta (const struct thread *t) {
+	int nice = t->nice;
+
+	if (nice < -20)
+		nice = -20;
+	else if (nice > 19)
+		nice = 19;
+	return FAIR_TICK * NICE_0_WEIGHT / fair_weights[nice + 20];
+}
+
+/* Advances RQ's MIN_VRUNTIME to the least virtual runtime among
+   its ready threads and CURR, its CPU's running thread, unless
+   that would move it backward. */
+static void
+fair_update_min (struct runqueue *rq, const struct thread *curr) {
+	int64_t min = curr->vruntime;
+	struct rbtree_elem *e = rbtree_min (&rq->fair);
+
+	if (e != NULL) {
+		int64_t first = rbtree_entry (e, struct thread, fair_elem)->vruntime;
+		if (first < min)
+			min = first;
+	}
+	if (min > rq->min_vruntime)
+		rq->min_vruntime = min;
+}
+
+/* Carries T's virtual runtime over from the run queue of CPU FROM,
+   which may be null, to that of CPU TO, where T is about to
+   become ready, and holds back any lead T built up while
+   asleep. */
+static void
+fair_place (struct thread *t, struct cpu *from, struct cpu *to) {
+	int64_t floor = to->rq.min_vruntime - FAIR_SLEEPER_CREDIT;
+
+	if (from != NULL && from != to)
+		t->vruntime += to->rq.min_vruntime - from->rq.min_vruntime;
+	if (t->vruntime < floor)
+		t->vruntime = floor;
+}
+
+/* Sets the effective priority of T to PRIORITY, moving T to the
+   matching ready queue if T is ready to run, or to its new place
+   among the waiters of whatever T is waiting on.  The caller must
+   hold synch.c's lock. */
+void
+thread_set_effective_priority (struct thread *t, int priority) {
+	enum intr_level old_level = intr_disable ();
+	int old_priority = t->priority;
+	struct cpu *cpu;
+
+	t->priority = priority;
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+	/* T's run queue can only change under that queue's lock, so
+	   check again once we hold it. */
+	while ((cpu = t->rq_cpu) != NULL) {
+		spinlock_acquire (&cpu->rq.lock);
+		if (t->rq_cpu == cpu) {
+			if (t->rq_priority != priority) {
+				ready_queue_remove (t);
+				ready_queue_push (t);
+			}
+			spinlock_release (&cpu->rq.lock);
+			break;
+		}
+		spinlock_release (&cpu->rq.lock);
+	}
+	synch_requeue_waiter (t, old_priority);
+
+	intr_set_level (old_level);
 }
 
 /* Use iretq to launch the thread */
@@ -592,89 +1519,17 @@ do_iret (struct intr_frame *tf) {
 			: : "g" ((uint64_t) tf) : "memory");
 }
 
-/* Switching the thread by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
-
-   At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.
-
-   It's not safe to call printf() until the thread switch is
-   complete.  In practice that means that printf()s should be
-   added at the end of the function. */
-static void
-thread_launch (struct thread *th) {
-	uint64_t tf_cur = (uint64_t) &running_thread ()->tf;
-	uint64_t tf = (uint64_t) &th->tf;
-	ASSERT (intr_get_level () == INTR_OFF);
-
-	/* The main switching logic.
-	 * We first restore the whole execution context into the intr_frame
-	 * and then switching to the next thread by calling do_iret.
-	 * Note that, we SHOULD NOT use any stack from here
-	 * until switching is done. */
-	__asm __volatile (
-			/* Store registers that will be used. */
-			"push %%rax\n"
-			"push %%rbx\n"
-			"push %%rcx\n"
-			/* Fetch input once */
-			"movq %0, %%rax\n"
-			"movq %1, %%rcx\n"
-			"movq %%r15, 0(%%rax)\n"
-			"movq %%r14, 8(%%rax)\n"
-			"movq %%r13, 16(%%rax)\n"
-			"movq %%r12, 24(%%rax)\n"
-			"movq %%r11, 32(%%rax)\n"
-			"movq %%r10, 40(%%rax)\n"
-			"movq %%r9, 48(%%rax)\n"
-			"movq %%r8, 56(%%rax)\n"
-			"movq %%rsi, 64(%%rax)\n"
-			"movq %%rdi, 72(%%rax)\n"
-			"movq %%rbp, 80(%%rax)\n"
-			"movq %%rdx, 88(%%rax)\n"
-			"pop %%rbx\n"              // Saved rcx
-			"movq %%rbx, 96(%%rax)\n"
-			"pop %%rbx\n"              // Saved rbx
-			"movq %%rbx, 104(%%rax)\n"
-			"pop %%rbx\n"              // Saved rax
-			"movq %%rbx, 112(%%rax)\n"
-			"addq $120, %%rax\n"
-			"movw %%es, (%%rax)\n"
-			"movw %%ds, 8(%%rax)\n"
-			"addq $32, %%rax\n"
-			"call __next\n"         // read the current rip.
-			"__next:\n"
-			"pop %%rbx\n"
-			"addq $(out_iret -  __next), %%rbx\n"
-			"movq %%rbx, 0(%%rax)\n" // rip
-			"movw %%cs, 8(%%rax)\n"  // cs
-			"pushfq\n"
-			"popq %%rbx\n"
-			"mov %%rbx, 16(%%rax)\n" // eflags
-			"mov %%rsp, 24(%%rax)\n" // rsp
-			"movw %%ss, 32(%%rax)\n"
-			"mov %%rcx, %%rdi\n"
-			"call do_iret\n"
-			"out_iret:\n"
-			: : "g"(tf_cur), "g" (tf) : "memory"
-			);
-}
-
 /* Schedules a new process. At entry, interrupts must be off.
  * This function modify current thread's status to status and then
  * finds another thread to run and switches to it.
  * It's not safe to call printf() in the schedule(). */
 static void
 do_schedule(int status) {
+	struct thread *curr = thread_current ();
+
 	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT (thread_current()->status == THREAD_RUNNING);
-	while (!list_empty (&destruction_req)) {
-		struct thread *victim =
-			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
-	}
-	thread_current ()->status = status;
+	spinlock_acquire (&curr->cpu->rq.lock);
+	curr->status = status;
 	schedule ();
 }
 
@@ -686,22 +1541,26 @@ schedule (void) {
 	* always at the beginning of a page and the stack pointer is
 	* somewhere in the middle, this locates the curent thread. */
 	struct thread *curr = running_thread ();
+	struct cpu *cpu = curr->cpu;
 
 	/* Chooses and returns the next thread to be scheduled.  Should
 	return a thread from the run queue, unless the run queue is
 	empty.  (If the running thread can continue running, then it
 	will be in the run queue.)  If the run queue is empty, return
-	idle_thread. */
+	the idle thread. */
 	struct thread *next = next_thread_to_run ();
 
 	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (spinlock_held_by_current_cpu (&cpu->rq.lock));
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
+	next->cpu = cpu;
+	cpu->curr = next;
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	cpu->thread_ticks = 0;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -709,21 +1568,89 @@ schedule (void) {
 #endif
 
 	if (curr != next) {
-		/* If the thread we switched from is dying, destroy its struct
-		   thread. This must happen late so that thread_exit() doesn't
-		   pull out the rug under itself.
-		   We just queuing the page free reqeust here because the page is
-		   currently used by the stack.
-		   The real destruction logic will be called at the beginning of the
-		   schedule(). */
-		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
-			ASSERT (curr != next);
-			list_push_back (&destruction_req, &curr->elem);
+		/* Save the callee-saved registers and the stack pointer of
+		 * the running thread, and resume NEXT where it left off.
+		 * NEXT finishes the switch in schedule_tail(). */
+		next->on_cpu = true;
+		cpu->prev = curr;
+		switch_threads (curr, next);
+	}
+	schedule_tail ();
+}
+
+/* Finishes a switch to the running thread, on whatever CPU it now
+   runs on: lets the thread switched away from, if any, run again
+   elsewhere, gives its page to the thread cache if it is dying,
+   and releases the run queue lock that schedule() took.  Runs
+   first thing in every thread switched to, including new ones. */
+static void
+schedule_tail (void) {
+	struct cpu *cpu = cpu_current ();
+	struct thread *prev = cpu->prev;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	cpu->prev = NULL;
+	if (prev != NULL) {
+		bool dying = prev->status == THREAD_DYING && prev != initial_thread;
+
+		/* PREV's registers are saved, since we are off its stack. */
+		__atomic_store_n (&prev->on_cpu, false, __ATOMIC_RELEASE);
+		if (dying) {
+			spinlock_acquire (&thread_cache_lock);
+			list_push_front (&thread_cache, &prev->elem);
+			thread_cache_cnt++;
+			spinlock_release (&thread_cache_lock);
 		}
+	}
+	spinlock_release (&cpu->rq.lock);
+}
+
+/* Returns a page for a new thread's struct thread and stack,
+   from the thread cache if possible.  The page is not zeroed;
+   init_thread() clears the struct thread, and the stack needs no
+   clearing.  Returns a null pointer if memory is exhausted. */
+static struct thread *
+thread_page_alloc (void) {
+	struct thread *t = NULL;
+	enum intr_level old_level = intr_disable ();
+
+	spinlock_acquire (&thread_cache_lock);
+	if (!list_empty (&thread_cache)) {
+		t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+		thread_cache_cnt--;
+		thread_cache_hits++;
+	} else
+		thread_cache_misses++;
+	spinlock_release (&thread_cache_lock);
+	intr_set_level (old_level);
+
+	return t != NULL ? t : palloc_get_page (0);
+}
 
-		/* Before switching the thread, we first save the information
-		 * of current running. */
-		thread_launch (next);
+/* Frees cached thread pages until at most MAX remain.  Returns
+   the number of pages freed.  Never sleeps: the page allocator
+   only takes its pools' spin locks. */
+size_t
+thread_cache_trim (size_t max) {
+	size_t freed = 0;
+
+	for (;;) {
+		enum intr_level old_level = intr_disable ();
+		struct thread *t = NULL;
+
+		spinlock_acquire (&thread_cache_lock);
+		if (thread_cache_cnt > max) {
+			t = list_entry (list_pop_back (&thread_cache), struct thread, elem);
+			thread_cache_cnt--;
+		}
+		spinlock_release (&thread_cache_lock);
+		intr_set_level (old_level);
+
+		if (t == NULL)
+			return freed;
+		palloc_free_page (t);
+		freed++;
 	}
 }
 
@@ -740,88 +1667,77 @@ allocate_tid (void) {
 	return tid;
 }
 
-/*
-* handle nested donation: 
-* if H is waiting on a lock that M holds and M is waiting on a lock that L holds, 
-* then both M and L should be boosted to H's priority. 
-* If necessary, you may impose a reasonable limit on depth of nested priority donation, 
-* such as 8 levels.
-*/
-void
-donate_priority (void)
-{
-  int level;
-  struct thread *curr = thread_current ();
-
-  for (level = 0; level < 8; level++){
-    if (!curr->wait_on_lock) 
-		break;
-
-	struct thread *holder = curr->wait_on_lock->holder;
-	if (holder->priority < curr->priority) {
-		holder->priority = curr->priority;
-	}
-	curr = holder;
-  }
-}
-
 /*
  * This function attempts to yield the CPU to a higher-priority thread from the
  * ready list, if such a thread exists and has a higher priority than the current thread.
 */
 void try_yield(void) {
+	struct thread *next;
+	struct runqueue *rq;
+	enum intr_level old_level;
+	bool yield;
+
 	// 외부 인터럽트가 발생하고 있을 때 thread_yield 금지
-	if (!intr_context() && !list_empty (&ready_list) && thread_current ()->priority < 
-    list_entry (list_front (&ready_list), struct thread, elem)->priority)
+	if (intr_context())
+		return;
+	old_level = intr_disable ();
+	rq = &cpu_current ()->rq;
+	spinlock_acquire (&rq->lock);
+	next = runqueue_peek (rq);
+	yield = next != NULL && thread_more_urgent (next, thread_current ());
+	spinlock_release (&rq->lock);
+	intr_set_level (old_level);
+
+	if (yield)
         thread_yield ();
 }
 
 void increase_recent_cpu(void) {
 	struct thread *curr = thread_current();
 	enum intr_level old_level = intr_disable ();
-	if (curr != idle_thread) {
+	if (!thread_is_idle (curr)) {
 		curr->recent_cpu += (1 << 14);
 	}
 	intr_set_level (old_level);
 }
 
+/* Once a second: records this second's decay coefficient and
+   decays the running and ready threads.  Blocked threads catch up
+   in thread_unblock(). */
 void refresh_recent_cpu(void) {
-	struct thread *curr = thread_current();
-	if (curr != idle_thread) {
-		enum intr_level old_level = intr_disable ();
-		calculate_recent_cpu(curr, NULL);
-		thread_foreach(calculate_recent_cpu, &ready_list, NULL);
-		thread_foreach(calculate_recent_cpu, &sleeping_list, NULL);
-		intr_set_level (old_level);
-	}
-	else{
-		enum intr_level old_level = intr_disable ();
-		thread_foreach(calculate_recent_cpu, &ready_list, NULL);
-		thread_foreach(calculate_recent_cpu, &sleeping_list, NULL);
-		intr_set_level (old_level);
-	}
+	enum intr_level old_level = intr_disable ();
+	int load_avg_twice = FP_MULTIPLY(load_avg, 2 << 14);
+
+	decay_history[decay_epoch % DECAY_HISTORY] =
+		FP_DIVIDE(load_avg_twice, load_avg_twice + (1 << 14));
+	decay_epoch++;
+
+	mlfqs_update(thread_current(), NULL);
+	ready_queue_rebuild(mlfqs_update, NULL);
+	intr_set_level (old_level);
 }
 
+/* Every fourth tick: only the running thread's recent_cpu has moved
+   since the last refresh, so it is the only priority to recompute.
+   A thread running on another CPU also catches up on this second's
+   decay here. */
 void refresh_priority(void) {
 	enum intr_level old_level = intr_disable ();
-	// priority는 int이므로, 고정 소수점 연산 필요 x?
-	struct thread *curr = thread_current();
-
-	calculate_priority(curr, NULL);
-	thread_foreach(calculate_priority, &ready_list, NULL);
-	thread_foreach(calculate_priority, &sleeping_list, NULL);
-	
+	mlfqs_update(thread_current(), NULL);
 	intr_set_level (old_level);
 }
 
 void refresh_load_avg(void) {
 	enum intr_level old_level = intr_disable ();
-	size_t ready_threads;
-	if (thread_current() == idle_thread) {
-		ready_threads = list_size(&ready_list);
-	}
-	else {
-		ready_threads = list_size(&ready_list)+1;
+	size_t ready_threads = 0;
+
+	/* Count the threads ready and running on every CPU.  The other
+	   CPUs' counts are read without their locks; an estimate is
+	   all the load average needs. */
+	for (int i = 0; i < cpu_cnt; i++) {
+		ready_threads += cpus[i].rq.cnt;
+		if (cpus[i].online && cpus[i].curr != cpus[i].idle)
+			ready_threads++;
 	}
 	/*
 	1. ready_threads가 0인 이상 load_avg는 증가X
@@ -832,34 +1748,53 @@ void refresh_load_avg(void) {
 	intr_set_level (old_level);
 }
 
-/* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2) */
+/* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2),
+   clamped to PRI_MIN..PRI_MAX so it always names a ready queue. */
 static void
 calculate_priority(struct thread *t, void *aux UNUSED) {
-	if (t != idle_thread) {
+	if (!thread_is_idle (t)) {
 		int load_avg_factor = FP_MULTIPLY(4 << FP_SHIFT, 1 << FP_SHIFT);
-		t->priority = PRI_MAX - (FP_DIVIDE(t->recent_cpu, load_avg_factor) >> 14)
+		int priority = PRI_MAX - (FP_DIVIDE(t->recent_cpu, load_avg_factor) >> 14)
 					- (t->nice * 2);
+		if (priority < PRI_MIN)
+			priority = PRI_MIN;
+		else if (priority > PRI_MAX)
+			priority = PRI_MAX;
+		t->priority = priority;
 	}
 }
 
-/* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice */
+/* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice,
+   applied once for every decay T has missed. */
 static void
 calculate_recent_cpu(struct thread *t, void *aux UNUSED) {
-	if (t != idle_thread) {
-		int load_avg_twice = FP_MULTIPLY(load_avg, 2 << 14);
-		int coeff = FP_DIVIDE(load_avg_twice, load_avg_twice + (1 << 14));
+	if (thread_is_idle (t))
+		return;
+
+	int64_t oldest = decay_epoch - DECAY_HISTORY;
+	if (t->decay_epoch < oldest) {
+		int32_t coeff = decay_history[oldest % DECAY_HISTORY];
+		int64_t missed = oldest - t->decay_epoch;
+
+		/* Bound the work done here with interrupts off; by now
+		   recent_cpu has all but settled at its fixed point. */
+		if (missed > DECAY_HISTORY)
+			missed = DECAY_HISTORY;
+		while (missed-- > 0)
+			t->recent_cpu = FP_MULTIPLY(coeff, t->recent_cpu) + (t->nice << 14);
+		t->decay_epoch = oldest;
+	}
+	for (; t->decay_epoch < decay_epoch; t->decay_epoch++) {
+		int32_t coeff = decay_history[t->decay_epoch % DECAY_HISTORY];
 		t->recent_cpu = FP_MULTIPLY(coeff, t->recent_cpu) + (t->nice << 14);
 	}
 }
 
-static bool 
-inc_function(const struct list_elem *a, const struct list_elem *b, void *aux) {
-    return list_entry(a, struct thread, elem)->wakeup_ticks < list_entry(b, struct thread, elem)->wakeup_ticks;
-}
-
-static bool
-dec_function(const struct list_elem *a, const struct list_elem *b, void *aux) {
-    return list_entry(a, struct thread, elem)->priority > list_entry(b, struct thread, elem)->priority;
+/* Brings T's recent_cpu up to date and recomputes its priority. */
+static void
+mlfqs_update(struct thread *t, void *aux) {
+	calculate_recent_cpu(t, aux);
+	calculate_priority(t, aux);
 }
 
 static int
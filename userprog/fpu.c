@@ -0,0 +1,299 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Lazy FPU context switching.
+
+   The kernel itself is built with -mno-sse -msoft-float and never
+   touches the x87, SSE or AVX registers, so that state belongs to
+   user programs alone.  Rather than saving and restoring it on
+   every thread switch, each CPU remembers which thread's state is
+   loaded in its registers (its `fpu_owner') and sets CR0.TS while
+   any other thread runs.  The first FPU instruction such a thread
+   executes raises #NM, and only then does fpu_claim() save the
+   owner's registers and load the running thread's.
+
+   A thread that never uses the FPU thus never gets a save area
+   and costs nothing beyond the CR0.TS update in fpu_activate().
+
+   With more than one CPU a thread may resume on a CPU other than
+   the one holding its registers, so there a thread's state is
+   saved as soon as it is switched out.  The restore is still
+   deferred until the thread next uses the FPU. */
+
+/* CR0 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP (1 << 1)             /* Monitor coprocessor. */
+#define CR0_EM (1 << 2)             /* x87 emulation. */
+#define CR0_TS (1 << 3)             /* Task switched. */
+#define CR0_NE (1 << 5)             /* Native x87 error reporting. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR (1 << 9)         /* FXSAVE, FXRSTOR and SSE. */
+#define CR4_OSXMMEXCPT (1 << 10)    /* Unmasked SSE exceptions. */
+#define CR4_OSXSAVE (1 << 18)       /* XSAVE and XGETBV/XSETBV. */
+
+/* CPUID.1:ECX bits. */
+#define CPUID_XSAVE (1 << 26)
+#define CPUID_AVX (1 << 28)
+
+/* XCR0 state components. */
+#define XCR0_X87 (1 << 0)
+#define XCR0_SSE (1 << 1)
+#define XCR0_AVX (1 << 2)
+
+/* FXSAVE areas are 16-byte aligned and XSAVE areas 64-byte
+   aligned.  We use the stricter alignment for both. */
+#define FPU_ALIGN 64
+
+/* Largest save area we support.  x87, SSE and AVX need 832 bytes;
+   we fall back to FXSAVE if XSAVE reports more. */
+#define FPU_AREA_MAX 1024
+#define FXSAVE_SIZE 512
+
+/* Default MXCSR: all SIMD exceptions masked, round to nearest. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* Whether XSAVE is in use, and the components it saves. */
+static bool use_xsave;
+static uint64_t xsave_mask;
+
+/* Size of a save area, in bytes. */
+static size_t fpu_size;
+
+/* FPU state of a thread that has not yet used the FPU. */
+static uint8_t fpu_init_state[FPU_AREA_MAX] __attribute__ ((aligned (FPU_ALIGN)));
+
+/* Statistics. */
+static long long fpu_trap_cnt;      /* # of #NM traps taken. */
+static long long fpu_save_cnt;      /* # of saves. */
+
+static void fpu_enable (void);
+
+static void
+cpuid (uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+		uint32_t *ecx, uint32_t *edx) {
+	asm volatile ("cpuid"
+			: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+			: "a" (leaf), "c" (subleaf));
+}
+
+/* Saves the FPU registers to AREA. */
+static void
+fpu_save (void *area) {
+	if (use_xsave)
+		asm volatile ("xsave64 %0"
+				: "=m" (*(uint8_t (*)[FPU_AREA_MAX]) area)
+				: "a" ((uint32_t) xsave_mask),
+				  "d" ((uint32_t) (xsave_mask >> 32))
+				: "memory");
+	else
+		asm volatile ("fxsave64 %0"
+				: "=m" (*(uint8_t (*)[FXSAVE_SIZE]) area) : : "memory");
+	fpu_save_cnt++;
+}
+
+/* Loads the FPU registers from AREA. */
+static void
+fpu_restore (const void *area) {
+	if (use_xsave)
+		asm volatile ("xrstor64 %0"
+				: : "m" (*(const uint8_t (*)[FPU_AREA_MAX]) area),
+				  "a" ((uint32_t) xsave_mask),
+				  "d" ((uint32_t) (xsave_mask >> 32))
+				: "memory");
+	else
+		asm volatile ("fxrstor64 %0"
+				: : "m" (*(const uint8_t (*)[FXSAVE_SIZE]) area) : "memory");
+}
+
+/* Returns T's save area, which must have been allocated. */
+static void *
+fpu_area (const struct thread *t) {
+	ASSERT (t->fpu != NULL);
+	return (void *) ROUND_UP ((uintptr_t) t->fpu, FPU_ALIGN);
+}
+
+/* Allocates an uninitialized save area for T.  Returns false if
+   memory is exhausted. */
+static bool
+fpu_alloc (struct thread *t) {
+	t->fpu = malloc (fpu_size + FPU_ALIGN - 1);
+	return t->fpu != NULL;
+}
+
+/* Detects the FPU save format, enables the FPU on the bootstrap
+   processor, and records the initial FPU state.  Leaves CR0.TS
+   set, so that the first user FPU instruction traps. */
+void
+fpu_init (void) {
+	uint32_t mxcsr = MXCSR_DEFAULT;
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+	if (ecx & CPUID_XSAVE) {
+		xsave_mask = XCR0_X87 | XCR0_SSE;
+		if (ecx & CPUID_AVX)
+			xsave_mask |= XCR0_AVX;
+		use_xsave = true;
+	}
+	fpu_enable ();
+
+	fpu_size = FXSAVE_SIZE;
+	if (use_xsave) {
+		/* EBX is the size needed for the components enabled in
+		   XCR0, which fpu_enable() just set. */
+		cpuid (0xd, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx <= FPU_AREA_MAX)
+			fpu_size = ebx;
+		else {
+			use_xsave = false;
+			lcr4 (rcr4 () & ~CR4_OSXSAVE);
+		}
+	}
+
+	clts ();
+	asm volatile ("fninit; ldmxcsr %0" : : "m" (mxcsr));
+	fpu_save (fpu_init_state);
+	fpu_save_cnt = 0;
+	lcr0 (rcr0 () | CR0_TS);
+}
+
+/* Enables the FPU on an application processor, as fpu_init() did
+   on the bootstrap processor. */
+void
+fpu_init_ap (void) {
+	fpu_enable ();
+	lcr0 (rcr0 () | CR0_TS);
+}
+
+/* Sets up CR0, CR4 and XCR0 for native x87, SSE and, if
+   available, AVX. */
+static void
+fpu_enable (void) {
+	uint64_t cr4;
+
+	lcr0 ((rcr0 () & ~CR0_EM) | CR0_MP | CR0_NE);
+	cr4 = rcr4 () | CR4_OSFXSR | CR4_OSXMMEXCPT;
+	if (use_xsave)
+		cr4 |= CR4_OSXSAVE;
+	lcr4 (cr4);
+	if (use_xsave)
+		asm volatile ("xsetbv"
+				: : "c" (0), "a" ((uint32_t) xsave_mask),
+				  "d" ((uint32_t) (xsave_mask >> 32)));
+}
+
+/* Handles #NM for the running user thread: gives it the FPU,
+   saving the state of the previous owner.  Returns false if a save
+   area cannot be allocated. */
+bool
+fpu_claim (void) {
+	struct thread *curr = thread_current ();
+	struct cpu *cpu;
+	enum intr_level old_level;
+
+	/* Allocate first, since malloc() may sleep. */
+	if (curr->fpu == NULL) {
+		if (!fpu_alloc (curr))
+			return false;
+		memcpy (fpu_area (curr), fpu_init_state, fpu_size);
+	}
+
+	old_level = intr_disable ();
+	cpu = cpu_current ();
+	fpu_trap_cnt++;
+	clts ();
+	if (cpu->fpu_owner != curr) {
+		if (cpu->fpu_owner != NULL)
+			fpu_save (fpu_area (cpu->fpu_owner));
+		fpu_restore (fpu_area (curr));
+		cpu->fpu_owner = curr;
+	}
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Prepares the running CPU to switch to NEXT: lets it use the FPU
+   directly if its state is already loaded, and traps its first FPU
+   instruction otherwise.  Called on every thread switch, with
+   interrupts off, and by fork and exec, with them on. */
+void
+fpu_activate (struct thread *next) {
+	/* Not thread_current(), which insists on THREAD_RUNNING. */
+	struct thread *curr = pg_round_down (rrsp ());
+	enum intr_level old_level = intr_disable ();
+	struct cpu *cpu = cpu_current ();
+
+	if (cpu_cnt > 1 && cpu->fpu_owner == curr && curr != next) {
+		/* CURR may run next on another CPU. */
+		clts ();
+		fpu_save (fpu_area (curr));
+		cpu->fpu_owner = NULL;
+	}
+
+	if (cpu->fpu_owner == next)
+		clts ();
+	else if ((rcr0 () & CR0_TS) == 0)
+		lcr0 (rcr0 () | CR0_TS);
+	intr_set_level (old_level);
+}
+
+/* Writes the running thread's FPU registers to its save area, if
+   they are loaded, so that fpu_fork() can copy them. */
+void
+fpu_flush (void) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level = intr_disable ();
+
+	if (cpu_current ()->fpu_owner == curr)
+		fpu_save (fpu_area (curr));
+	intr_set_level (old_level);
+}
+
+/* Gives CHILD a copy of PARENT's FPU state, which PARENT must have
+   written back with fpu_flush().  Returns false if memory is
+   exhausted. */
+bool
+fpu_fork (struct thread *child, const struct thread *parent) {
+	ASSERT (child->fpu == NULL);
+
+	if (parent->fpu == NULL)
+		return true;
+	if (!fpu_alloc (child))
+		return false;
+	memcpy (fpu_area (child), fpu_area (parent), fpu_size);
+	return true;
+}
+
+/* Discards the running thread's FPU state, so that it starts over
+   from the initial state if it uses the FPU again. */
+void
+fpu_release (void) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	uint8_t *fpu;
+
+	old_level = intr_disable ();
+	if (cpu_current ()->fpu_owner == curr) {
+		cpu_current ()->fpu_owner = NULL;
+		lcr0 (rcr0 () | CR0_TS);
+	}
+	fpu = curr->fpu;
+	curr->fpu = NULL;
+	intr_set_level (old_level);
+
+	free (fpu);
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) {
+	printf ("FPU: %lld traps, %lld saves\n", fpu_trap_cnt, fpu_save_cnt);
+}
@@ -5,7 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -32,7 +34,6 @@ static void __do_fork (void *);
 static void round_stack_pt(struct intr_frame *);
 static int tokenize_input(const char *, int, char **);
 
-extern struct lock mutex;
 
 /* General process initializer for initd and other process. */
 static void
@@ -96,6 +97,9 @@ process_fork (const char *name, struct intr_frame *if_) {
 	*/
 	struct thread *curr = thread_current();
 
+	/* Let the child copy our FPU registers from memory. */
+	fpu_flush ();
+
 	tid_t child_tid = thread_create (name,
 			PRI_DEFAULT, __do_fork, if_);
 
@@ -205,6 +209,9 @@ __do_fork (void *aux) {
 
 	current->fd_idx = parent->fd_idx;
 
+	if (!fpu_fork (current, parent))
+		goto error;
+
 	sema_up(&current->fork_sema);
 
 	// In child process, the return value should be 0
@@ -244,9 +251,9 @@ process_exec (void *f_name) {
 	process_cleanup ();
 
 	/* And then load the binary */
-	sema_down(&mutex);
+	rwlock_acquire_write (&filesys_lock);
 	success = load (file_name, &_if);
-	sema_up(&mutex);
+	rwlock_release (&filesys_lock);
 
 	sema_up(&(thread_current()->load_sema));
 
@@ -318,6 +325,7 @@ process_cleanup (void) {
 #ifdef VM
 	supplemental_page_table_kill (&curr->spt);
 #endif
+	fpu_release ();
 
 	uint64_t *pml4;
 	/* Destroy the current process's page directory and switch back
@@ -346,6 +354,9 @@ process_activate (struct thread *next) {
 
 	/* Set thread's kernel stack for use in processing interrupts. */
 	tss_update (next);
+
+	/* Trap its FPU use unless its FPU state is already loaded. */
+	fpu_activate (next);
 }
 
 // find child thread
@@ -455,10 +466,6 @@ load (const char *file_name, struct intr_frame *if_) {
 	t->run_file = file;
 	file_deny_write(file);
 
-	#ifdef VM
-	list_init(&t->fcfs_cache);
-	#endif
-
 	/* Read and verify executable header. */
 	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
@@ -790,6 +797,17 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+		/* Nothing to read: an anonymous page reads as zeros, and
+		   may share the zero frame until written. */
+		if (page_read_bytes == 0) {
+			if (!vm_alloc_page (VM_ANON, upage, writable))
+				return false;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
+			ofs += PGSIZE;
+			continue;
+		}
+
 		/* TODO: Set up aux to pass information to the lazy_load_segment. */
 		struct file_info *aux  = (struct file_info *)malloc(sizeof(struct file_info));
 		if (aux == NULL) {
@@ -1,9 +1,13 @@
 #include "userprog/syscall.h"
+#include <hash.h>
+#include <list.h>
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
@@ -16,6 +20,27 @@
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 
+/* Serializes file system access.  Reading a file only needs it
+   shared; anything that changes the file system or the open-inode
+   list needs it exclusively. */
+struct rwlock filesys_lock;
+
+/* Futexes.  A thread in futex_wait() is queued under the file page
+   that backs the word it waits on, so processes that map the same
+   file meet on the same queue whatever address each mapped it at. */
+#define FUTEX_BUCKETS 64            /* Number of wait queues. */
+
+/* A thread waiting in futex_wait(). */
+struct futex_waiter {
+	struct inode *inode;        /* File backing the word. */
+	off_t ofs;                  /* Offset of the word in it. */
+	struct semaphore sema;      /* Upped by futex_wake(). */
+	struct list_elem elem;      /* Element in a futex_queues list. */
+};
+
+static struct list futex_queues[FUTEX_BUCKETS];
+static struct lock futex_lock;
+
 /* System call.
  *
  * Previously system call services was handled by the interrupt handler
@@ -28,6 +53,7 @@ void syscall_handler (struct intr_frame *);
 #define MSR_STAR 0xc0000081         /* Segment selector msr */
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target */
 #define MSR_SYSCALL_MASK 0xc0000084 /* Mask for the eflags */
+#define MSR_KERNEL_GS_BASE 0xc0000102 /* %gs base after swapgs */
 
 enum {
 	STD_INPUT,
@@ -57,6 +83,19 @@ check_pt(void *addr) {
 
 void
 syscall_init (void) {
+	syscall_init_ap ();
+	
+	rwlock_init_named (&filesys_lock, "filesys");
+
+	for (int i = 0; i < FUTEX_BUCKETS; i++)
+		list_init (&futex_queues[i]);
+	lock_init (&futex_lock);
+}
+
+/* Points the running CPU's syscall instruction at syscall_entry.
+   The MSRs are per CPU, so every CPU does this. */
+void
+syscall_init_ap (void) {
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -66,8 +105,9 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-	
-	sema_init(&mutex, 1);
+
+	/* syscall_entry finds this CPU's TSS through %gs. */
+	write_msr(MSR_KERNEL_GS_BASE, (uint64_t) cpu_current ());
 }
 
 /* The main system call interface */
@@ -111,9 +151,9 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	{
 		check_address(f->R.rdi);
 		check_pt(f->R.rdi);
-		sema_down(&mutex);
+		rwlock_acquire_write (&filesys_lock);
 		f->R.rax = create (f->R.rdi, f->R.rsi);
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 		break;
 	}
 
@@ -186,6 +226,24 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		break;
 	}
 
+	case SYS_CLOCK_GETTIME:
+	{
+		f->R.rax = clock_gettime (f->R.rdi, (struct timespec *) f->R.rsi);
+		break;
+	}
+
+	case SYS_FUTEX_WAIT:
+	{
+		f->R.rax = futex_wait ((int *) f->R.rdi, f->R.rsi);
+		break;
+	}
+
+	case SYS_FUTEX_WAKE:
+	{
+		f->R.rax = futex_wake ((int *) f->R.rdi, f->R.rsi);
+		break;
+	}
+
     default:
         break;
 }
@@ -222,9 +280,9 @@ exit (int status) {
 */
 pid_t
 fork (const char *thread_name, struct intr_frame *f){
-	sema_down(&mutex);
+	rwlock_acquire_write (&filesys_lock);
 	pid_t res = process_fork(thread_name, f);
-	sema_up(&mutex);
+	rwlock_release (&filesys_lock);
 	return res;
 }
 
@@ -314,9 +372,9 @@ open (const char *file) {
 	if (file == NULL) {
 		return -1;
 	}
-	sema_down(&mutex);
+	rwlock_acquire_write (&filesys_lock);
 	struct file* opened_f = filesys_open(file);
-	sema_up(&mutex);
+	rwlock_release (&filesys_lock);
 	if (opened_f == NULL) {
 		return -1;
 	}
@@ -370,10 +428,10 @@ read (int fd, void *buffer, unsigned size) {
 			exit(-1);
 	}
 
-	sema_down(&mutex);
+	rwlock_acquire_read (&filesys_lock);
 	
 	if (opened_f == NULL) {
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 		return -1;
 	}
 	
@@ -388,17 +446,17 @@ read (int fd, void *buffer, unsigned size) {
             buf_pos += 1;
         }
         *buf_pos = '\0';
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 		return buf_pos - (char *)buffer;
     }
 
 	else if (fd >= 2) {
 		off_t res = file_read(opened_f, buffer, size);
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 		return res;
 	}
 
-	sema_up(&mutex);
+	rwlock_release (&filesys_lock);
 	return -1;
 }
 
@@ -422,11 +480,11 @@ write (int fd, const void *buffer, unsigned size) {
 	if (fd < 0 || fd > FD_MAX)
 		return NULL;
 	
-	sema_down(&mutex);
+	rwlock_acquire_write (&filesys_lock);
 
 	if (fd == STD_OUTPUT) {
 		putbuf(buffer, size);
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 		return size;
 	}
 
@@ -435,16 +493,16 @@ write (int fd, const void *buffer, unsigned size) {
 		struct file* opened_f = curr->fd_table[fd];
 
 		if (opened_f == NULL) {
-			sema_up(&mutex);
+			rwlock_release (&filesys_lock);
 			return 0;
 		}
 		off_t res = file_write(opened_f, buffer, size);
-		sema_up(&mutex);
+		rwlock_release (&filesys_lock);
 
 		return res;
 	}
 
-	sema_up(&mutex);
+	rwlock_release (&filesys_lock);
 
 	return 0;
 }
@@ -525,7 +583,7 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	
 	// It must fail if addr is not page-aligned or 
 	// if the range of pages mapped overlaps any existing set of mapped pages
-	if (addr != pg_round_down(addr) || spt_find_page(&curr->spt, pg_round_down(addr+length))) {
+	if (addr != pg_round_down(addr)) {
 		return NULL;
 	}
 
@@ -536,7 +594,8 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	}
 
 	// validate mmap over stack segment and offset value
-	if (offset != pg_round_down(offset) || file_length(file) <= offset || spt_find_page(&thread_current()->spt, addr)) {
+	if (offset != pg_round_down(offset) || file_length(file) <= offset
+			|| spt_first_page(&curr->spt, addr, addr + length) != NULL) {
 		return NULL;
 	}	
 
@@ -551,4 +610,112 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 void
 munmap (void *addr) {
 	do_munmap(addr);
-}
\ No newline at end of file
+}
+
+/* Stores the current time of CLOCK in *TS.  Returns 0 if
+   successful, -1 if CLOCK is not a known clock.  A bad TS
+   terminates the process. */
+int
+clock_gettime (int clock, struct timespec *ts) {
+	int64_t now;
+
+	check_address (ts);
+	check_address ((uint8_t *) ts + sizeof *ts - 1);
+	if (clock != CLOCK_MONOTONIC)
+		return -1;
+
+	now = timer_ns ();
+	ts->tv_sec = now / 1000000000;
+	ts->tv_nsec = now % 1000000000;
+	return 0;
+}
+/* Returns the inode of the file that backs the word at ADDR in
+   the current process, and stores the word's offset in that file
+   in *OFS.  Returns a null pointer if ADDR is misaligned or does
+   not lie in a file mapping.  An unmapped ADDR terminates the
+   process. */
+static struct inode *
+futex_key (int *addr, off_t *ofs) {
+	struct page *page;
+	struct inode *inode;
+
+	check_address (addr);
+	if ((uintptr_t) addr % sizeof *addr != 0)
+		return NULL;
+
+	page = spt_find_page (&thread_current ()->spt, addr);
+	if (page == NULL)
+		exit (-1);
+	if (page_get_type (page) != VM_FILE)
+		return NULL;
+
+	inode = file_backed_inode (page, ofs);
+	*ofs += pg_ofs (addr);
+	return inode;
+}
+
+/* Returns the wait queue for offset OFS in INODE. */
+static struct list *
+futex_queue (struct inode *inode, off_t ofs) {
+	uint64_t h = hash_bytes (&inode, sizeof inode) ^ hash_int (ofs);
+	return &futex_queues[h % FUTEX_BUCKETS];
+}
+
+/* If the word at ADDR holds EXPECTED, sleeps until futex_wake() is
+   called on the same word of the same file, by any process.
+   Returns 0 after such a wakeup, or -1 at once if the word holds
+   another value or ADDR is not an aligned word in a file
+   mapping. */
+int
+futex_wait (int *addr, int expected) {
+	struct futex_waiter w;
+
+	w.inode = futex_key (addr, &w.ofs);
+	if (w.inode == NULL)
+		return -1;
+	sema_init (&w.sema, 0);
+
+	/* futex_wake() takes FUTEX_LOCK after the waker stores to the
+	   word, so either we see the store here or it sees us queued. */
+	lock_acquire (&futex_lock);
+	if (*(volatile int *) addr != expected) {
+		lock_release (&futex_lock);
+		return -1;
+	}
+	list_push_back (futex_queue (w.inode, w.ofs), &w.elem);
+	lock_release (&futex_lock);
+
+	sema_down (&w.sema);
+	return 0;
+}
+
+/* Wakes up to N threads waiting in futex_wait() on the word at
+   ADDR, oldest first.  Returns the number woken, or -1 if ADDR is
+   not an aligned word in a file mapping. */
+int
+futex_wake (int *addr, int n) {
+	struct inode *inode;
+	struct list *queue;
+	struct list_elem *e;
+	off_t ofs;
+	int woken = 0;
+
+	inode = futex_key (addr, &ofs);
+	if (inode == NULL)
+		return -1;
+	queue = futex_queue (inode, ofs);
+
+	lock_acquire (&futex_lock);
+	for (e = list_begin (queue); e != list_end (queue) && woken < n; ) {
+		struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+		if (w->inode == inode && w->ofs == ofs) {
+			e = list_remove (e);
+			sema_up (&w->sema);
+			woken++;
+		} else
+			e = list_next (e);
+	}
+	lock_release (&futex_lock);
+	return woken;
+}
@@ -1,11 +1,17 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "devices/disk.h"
 
 #include <bitmap.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -23,17 +29,380 @@ static const struct page_operations anon_ops = {
 
 struct bitmap *swap_bitmap;
 
+/* Swap slots are handed out a cluster at a time, with a next-fit
+   cursor, so that pages evicted one after another land next to
+   each other on disk and a fault can read its neighbours ahead.
+   A slot may be shared by the pages of several processes since
+   fork, and is freed along with the last of them.  SWAP_LOCK
+   protects the bitmap, the cursor, the current cluster,
+   SLOT_PAGES and SLOT_REFS. */
+#define SWAP_CLUSTER 8                  /* Slots per cluster. */
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE) /* Sectors per slot. */
+static struct lock swap_lock;
+static size_t swap_cursor;              /* Where the next search starts. */
+static size_t cluster_next;             /* Next slot of current cluster. */
+static size_t cluster_left;             /* Slots left in it. */
+static struct page **slot_pages;        /* Page in each slot, or NULL. */
+static uint16_t *slot_refs;             /* Pages sharing each slot. */
+
+static size_t swap_slot_alloc (void);
+static void swap_slot_free (size_t slot, struct page *page);
+static size_t swap_run (struct page *page, size_t max, size_t *after);
+
+/* Swap slots move to and from the disk a run at a time, one IDE
+   request per run, through two buffers of SWAP_RUN pages.  A
+   swap-in reads the run of slots around the page that hold pages
+   of the same process into RUN_BUF, where read-ahead then finds
+   them.  RUN_VALID has a bit for each slot of the run that still
+   holds what was read, and a slot's bit is cleared when the slot
+   is freed, so that a reused slot is never served from RUN_BUF.
+   Evicted pages are copied to STAGE_BUF while they land in
+   consecutive slots, and written out together once the run is
+   broken or full, or the eviction batch is over; reading from
+   the disk writes the staged run out first.  SWAP_IO_LOCK
+   protects both buffers and the STAGE_ variables, and is taken
+   before SWAP_LOCK, which protects the RUN_ variables. */
+#define SWAP_RUN (SWAP_READAHEAD + 1)   /* Most slots per request. */
+static struct lock swap_io_lock;
+static uint8_t *run_buf;                /* Pages of the last run read. */
+static size_t run_base;                 /* Its first slot. */
+static size_t run_cnt;                  /* Its number of slots. */
+static unsigned run_valid;              /* Slots still as read. */
+static uint8_t *stage_buf;              /* Pages waiting to be written. */
+static size_t stage_base;               /* Slot of the first. */
+static size_t stage_cnt;                /* Their number. */
+
+static void swap_read (struct page *page, void *kva);
+static void swap_stage (size_t slot, struct page *page);
+static void swap_stage_flush (void);
+static bool anon_unmap (struct page *page);
+static void anon_remap (struct page *page, struct list_elem *stop);
+static void anon_share_out (struct page *page);
+
+/* Compressed swap cache.  Evicted anonymous pages are compressed
+   into a pool of user pages set aside at boot, in ZSWAP_CHUNK
+   byte chunks, and only go to the swap disk if they do not
+   compress to ZSWAP_MAX bytes or the pool is full.  Like a swap
+   slot, a compressed page may be shared since fork; ZSWAP_REFS
+   counts its sharers by its first chunk.  SWAP_LOCK protects the
+   pool, ZSWAP_REFS and the compressor's buffers. */
+#define ZSWAP_CHUNK 64                  /* Bytes per pool chunk. */
+#define ZSWAP_MAX (PGSIZE * 3 / 4)      /* Largest page kept. */
+static uint8_t *zswap_pool;             /* Chunks, contiguous. */
+static struct bitmap *zswap_map;        /* Chunks in use. */
+static uint16_t *zswap_refs;            /* Pages sharing each entry. */
+static uint8_t zswap_buf[ZSWAP_MAX];    /* Compressor output. */
+
+static bool zswap_store (struct page *page);
+static bool zswap_load (struct page *page, void *kva);
+static void zswap_free (struct page *page);
+
+/* Statistics. */
+static long long zswap_stores;          /* Pages compressed. */
+static long long zswap_bytes;           /* Their compressed size. */
+static long long zswap_hits;            /* Swap-ins from the pool. */
+static long long disk_stores;           /* Pages written to disk. */
+static long long disk_hits;             /* Swap-ins from disk. */
+static long long disk_reads;            /* Runs read from disk. */
+static long long disk_writes;           /* Runs written to disk. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
 	/* TODO: Set up the swap_disk. */
 	swap_disk = disk_get(1, 1);
 
+	lock_init (&swap_lock);
+	lock_init (&swap_io_lock);
 	if (swap_disk != NULL) {
 		// disk size는 sector 수를 반환, 각 sector는 512 byte sector임
 		// 우리는 4KB page를 할당해야 하므로, length = disk_size / 8 의 비트맵을 만들면 됨
 		swap_bitmap = bitmap_create (disk_size(swap_disk) / 8);
+		slot_pages = calloc (bitmap_size (swap_bitmap), sizeof *slot_pages);
+		slot_refs = calloc (bitmap_size (swap_bitmap), sizeof *slot_refs);
+		run_buf = palloc_get_multiple (0, SWAP_RUN);
+		stage_buf = palloc_get_multiple (0, SWAP_RUN);
+		if (slot_pages == NULL || slot_refs == NULL
+				|| run_buf == NULL || stage_buf == NULL)
+			PANIC ("swap slot table allocation failed");
+	}
+
+	/* An eighth of the user pool, which is all free yet. */
+	size_t pool_pages = palloc_user_free_cnt () / 8;
+	if (pool_pages > 0)
+		zswap_pool = palloc_get_multiple (PAL_USER, pool_pages);
+	if (zswap_pool != NULL) {
+		zswap_map = bitmap_create (pool_pages * PGSIZE / ZSWAP_CHUNK);
+		zswap_refs = calloc (pool_pages * PGSIZE / ZSWAP_CHUNK,
+				sizeof *zswap_refs);
+		if (zswap_map == NULL || zswap_refs == NULL)
+			PANIC ("compressed swap pool allocation failed");
+	}
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap: %lld pages compressed to %lld%% of size, "
+			"%lld written to disk; %lld swap-ins from RAM, %lld from disk\n",
+			zswap_stores,
+			zswap_stores > 0 ? zswap_bytes * 100 / (zswap_stores * PGSIZE) : 0,
+			disk_stores, zswap_hits, disk_hits);
+	printf ("Swap: %lld disk reads, %lld disk writes\n",
+			disk_reads, disk_writes);
+}
+
+/* Hash table for lz_compress(), under SWAP_LOCK. */
+static uint16_t lz_table[LZ_TABLE_SIZE];
+
+/* Compresses PAGE, which must not be mapped, into the pool.
+   Returns false if it does not compress well or the pool is
+   full. */
+static bool
+zswap_store (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+	bool stored = false;
+	size_t len, idx;
+
+	if (zswap_pool == NULL)
+		return false;
+
+	lock_acquire (&swap_lock);
+	len = lz_compress (page->frame->kva, PGSIZE, zswap_buf, ZSWAP_MAX,
+			lz_table);
+	if (len > 0) {
+		idx = bitmap_scan_and_flip (zswap_map, 0,
+				DIV_ROUND_UP (len, ZSWAP_CHUNK), false);
+		if (idx != BITMAP_ERROR) {
+			memcpy (zswap_pool + idx * ZSWAP_CHUNK, zswap_buf, len);
+			zswap_refs[idx] = 1;
+			anon_page->zswap_idx = idx;
+			anon_page->zswap_len = len;
+			zswap_stores++;
+			zswap_bytes += len;
+			stored = true;
+		}
+	}
+	lock_release (&swap_lock);
+	return stored;
+}
+
+/* Decompresses PAGE from the pool into KVA. */
+static bool
+zswap_load (struct page *page, void *kva) {
+	struct anon_page *anon_page = &page->anon;
+	bool ok;
+
+	lock_acquire (&swap_lock);
+	ok = lz_decompress (zswap_pool + anon_page->zswap_idx * ZSWAP_CHUNK,
+			anon_page->zswap_len, kva, PGSIZE);
+	lock_release (&swap_lock);
+	return ok;
+}
+
+/* Drops PAGE's share of its chunks in the pool, freeing them along
+   with the last share. */
+static void
+zswap_free (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+
+	lock_acquire (&swap_lock);
+	if (--zswap_refs[anon_page->zswap_idx] == 0)
+		bitmap_set_multiple (zswap_map, anon_page->zswap_idx,
+				DIV_ROUND_UP (anon_page->zswap_len, ZSWAP_CHUNK), false);
+	lock_release (&swap_lock);
+	anon_page->zswap_idx = BITMAP_ERROR;
+}
+
+/* Reserves CNT contiguous free slots, searching from the cursor
+   on and then from the start of the disk.  Returns the first, or
+   BITMAP_ERROR if there is no such run. */
+static size_t
+swap_cluster_find (size_t cnt) {
+	size_t start = bitmap_scan_and_flip (swap_bitmap, swap_cursor, cnt, false);
+
+	if (start == BITMAP_ERROR && swap_cursor > 0)
+		start = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+	if (start != BITMAP_ERROR)
+		swap_cursor = (start + cnt) % bitmap_size (swap_bitmap);
+	return start;
+}
+
+/* Allocates a swap slot, next to the last one handed out if the
+   current cluster has room.  Returns BITMAP_ERROR if swap is
+   full.  The page it is for is entered in SLOT_PAGES by
+   swap_stage(), once the slot's contents are queued. */
+static size_t
+swap_slot_alloc (void) {
+	size_t slot = BITMAP_ERROR;
+
+	if (swap_bitmap == NULL)
+		return BITMAP_ERROR;
+
+	lock_acquire (&swap_lock);
+	if (cluster_left == 0) {
+		/* Fall back to single slots once swap is fragmented. */
+		size_t cnt = SWAP_CLUSTER;
+		size_t start = swap_cluster_find (cnt);
+		if (start == BITMAP_ERROR)
+			start = swap_cluster_find (cnt = 1);
+		if (start != BITMAP_ERROR) {
+			cluster_next = start;
+			cluster_left = cnt;
+		}
 	}
+	if (cluster_left > 0) {
+		slot = cluster_next++;
+		cluster_left--;
+		slot_refs[slot] = 1;
+	}
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Drops PAGE's share of SLOT, freeing it along with the last
+   share. */
+static void
+swap_slot_free (size_t slot, struct page *page) {
+	lock_acquire (&swap_lock);
+	if (slot_pages[slot] == page)
+		slot_pages[slot] = NULL;
+	if (--slot_refs[slot] == 0) {
+		bitmap_reset (swap_bitmap, slot);
+		if (slot >= run_base && slot < run_base + run_cnt)
+			run_valid &= ~(1u << (slot - run_base));
+	}
+	lock_release (&swap_lock);
+}
+
+/* Counts the slots around PAGE's that hold other pages of PAGE's
+   process: up to MAX right after it and then, if there is room
+   left, right before it.  Stores the number after in *AFTER and
+   returns the number before.  SWAP_LOCK must be held. */
+static size_t
+swap_run (struct page *page, size_t max, size_t *after) {
+	size_t slot = page->bitmap_idx;
+	size_t before = 0;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	*after = 0;
+	while (*after < max && slot + *after + 1 < bitmap_size (swap_bitmap)) {
+		struct page *next = slot_pages[slot + *after + 1];
+		if (next == NULL || next->anon.thread != page->anon.thread)
+			break;
+		++*after;
+	}
+	while (*after + before < max && before < slot) {
+		struct page *prev = slot_pages[slot - before - 1];
+		if (prev == NULL || prev->anon.thread != page->anon.thread)
+			break;
+		before++;
+	}
+	return before;
+}
+
+/* Reads swapped out PAGE into KVA: from RUN_BUF, if its slot is
+   there, or else by reading the run around its slot into RUN_BUF
+   first, in one request. */
+static void
+swap_read (struct page *page, void *kva) {
+	size_t slot = page->bitmap_idx;
+
+	lock_acquire (&swap_io_lock);
+	lock_acquire (&swap_lock);
+	if (slot < run_base || slot >= run_base + run_cnt
+			|| !(run_valid & (1u << (slot - run_base)))) {
+		size_t before, after;
+
+		before = swap_run (page, SWAP_RUN - 1, &after);
+		run_base = slot - before;
+		run_cnt = before + 1 + after;
+		run_valid = 0;
+		lock_release (&swap_lock);
+
+		swap_stage_flush ();
+		disk_read_multiple (swap_disk, run_base * SLOT_SECTORS, run_buf,
+				run_cnt * SLOT_SECTORS);
+		disk_reads++;
+
+		/* Only our own pages are in the run, and none of them can
+		   go away while we handle a fault of our process. */
+		lock_acquire (&swap_lock);
+		run_valid = (1u << run_cnt) - 1;
+	}
+	lock_release (&swap_lock);
+
+	memcpy (kva, run_buf + (slot - run_base) * PGSIZE, PGSIZE);
+	lock_release (&swap_io_lock);
+}
+
+/* Queues the contents of PAGE to be written to SLOT, just
+   allocated for it, along with the slots before it that are
+   already queued.  Only then does PAGE show up in SLOT_PAGES, so
+   that a run read in meanwhile cannot take in SLOT before it is
+   written. */
+static void
+swap_stage (size_t slot, struct page *page) {
+	lock_acquire (&swap_io_lock);
+	if (stage_cnt > 0
+			&& (slot != stage_base + stage_cnt || stage_cnt == SWAP_RUN))
+		swap_stage_flush ();
+	if (stage_cnt == 0)
+		stage_base = slot;
+	memcpy (stage_buf + stage_cnt++ * PGSIZE, page->frame->kva, PGSIZE);
+
+	lock_acquire (&swap_lock);
+	slot_pages[slot] = page;
+	lock_release (&swap_lock);
+	lock_release (&swap_io_lock);
+}
+
+/* Writes the queued pages out in one request.  SWAP_IO_LOCK must
+   be held. */
+static void
+swap_stage_flush (void) {
+	ASSERT (lock_held_by_current_thread (&swap_io_lock));
+
+	if (stage_cnt == 0)
+		return;
+	disk_write_multiple (swap_disk, stage_base * SLOT_SECTORS, stage_buf,
+			stage_cnt * SLOT_SECTORS);
+	disk_writes++;
+	stage_cnt = 0;
+}
+
+/* Writes out the pages that swap-outs have queued.  Called at the
+   end of each eviction batch. */
+void
+anon_swap_flush (void) {
+	if (stage_buf == NULL)
+		return;
+	lock_acquire (&swap_io_lock);
+	swap_stage_flush ();
+	lock_release (&swap_io_lock);
+}
+
+/* Stores in PAGES up to MAX pages of PAGE's process that are
+   swapped out to the slots right after PAGE's, and then, if there
+   is room left, right before it, so that a process walking its
+   memory either way gets its next pages read ahead along with
+   PAGE.  Returns how many it stored. */
+size_t
+anon_swap_neighbours (struct page *page, struct page **pages, size_t max) {
+	size_t before, after, i;
+
+	if (page->bitmap_idx == BITMAP_ERROR)
+		return 0;
+
+	lock_acquire (&swap_lock);
+	before = swap_run (page, max, &after);
+	for (i = 0; i < after; i++)
+		pages[i] = slot_pages[page->bitmap_idx + 1 + i];
+	for (i = 0; i < before; i++)
+		pages[after + i] = slot_pages[page->bitmap_idx - 1 - i];
+	lock_release (&swap_lock);
+	return before + after;
 }
 
 /* Initialize the file mapping */
@@ -44,51 +413,164 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 
 	struct anon_page *anon_page = &page->anon;
 	anon_page->thread = thread_current();
+	anon_page->zswap_idx = BITMAP_ERROR;
+	page->bitmap_idx = BITMAP_ERROR;
 
 	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the compressed pool or
+ * the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
 	size_t bitmap_idx = page->bitmap_idx;
 
-	for (int i = 0; i < 8; i++) {
-        disk_read(swap_disk, bitmap_idx*8+i, page->frame->kva + (i * DISK_SECTOR_SIZE));
-    }
-	bitmap_set(swap_bitmap, bitmap_idx, false);
+	if (anon_page->zswap_idx != BITMAP_ERROR) {
+		bool ok = zswap_load (page, page->frame->kva);
+		zswap_free (page);
+		zswap_hits++;
+		return ok;
+	}
+
+	disk_hits++;
+	swap_read (page, page->frame->kva);
+	swap_slot_free(bitmap_idx, page);
+	page->bitmap_idx = BITMAP_ERROR;
 
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Makes DST, a new anonymous page with no frame, share the place
+ * in the compressed pool or on the swap disk of SRC, which is
+ * swapped out.  Each reads it in on its first touch, and the last
+ * to do so, or to be destroyed, frees it. */
+void
+anon_share_swapped (struct page *src, struct page *dst) {
+	lock_acquire (&swap_lock);
+	if (src->anon.zswap_idx != BITMAP_ERROR) {
+		zswap_refs[src->anon.zswap_idx]++;
+		dst->anon.zswap_idx = src->anon.zswap_idx;
+		dst->anon.zswap_len = src->anon.zswap_len;
+	} else {
+		ASSERT (src->bitmap_idx != BITMAP_ERROR);
+		slot_refs[src->bitmap_idx]++;
+		dst->bitmap_idx = src->bitmap_idx;
+	}
+	lock_release (&swap_lock);
+}
+
+/* Swap out the page by compressing it into the pool, or else
+ * queueing its contents to be written to the swap disk.  The pages sharing its frame
+ * copy-on-write go along, and share its place in swap.  Fails,
+ * leaving the pages in place, if the process of one of them is
+ * running on another CPU. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	size_t bitmap_idx = bitmap_scan_and_flip(swap_bitmap, 0, 1, false);
-	if (bitmap_idx == BITMAP_ERROR)
-        return false;
+	size_t bitmap_idx;
+
+	// page table update, before writing, so that the owners, which
+	// need not be the current thread, cannot change it under us
+	if (!anon_unmap (page))
+		return false;
+	pml4_set_dirty(anon_page->thread->pml4, page->va, false);
 
+	if (zswap_store(page)) {
+		anon_share_out (page);
+		memset(page->frame->kva, 0, PGSIZE);
+		page->frame = NULL;
+		return true;
+	}
+
+	bitmap_idx = swap_slot_alloc ();
+	if (bitmap_idx == BITMAP_ERROR) {
+		/* Nowhere to put it: map it back. */
+		anon_remap (page, NULL);
+		return false;
+	}
 	page->bitmap_idx = bitmap_idx;
-	for (int i = 0; i < 8; i++) {
-        disk_write(swap_disk, bitmap_idx*8+i, page->frame->kva + (i * DISK_SECTOR_SIZE));
-    }
-	memset(page->frame->kva, 0, PGSIZE);
+	disk_stores++;
 
-	// page table update
-	pml4_clear_page(thread_current()->pml4, page->va);
-	pml4_set_dirty(anon_page->thread->pml4, page->va, false);
+	swap_stage (bitmap_idx, page);
+	anon_share_out (page);
+	memset(page->frame->kva, 0, PGSIZE);
     page->frame = NULL;
 	
 	return true;
 }
 
+/* Unmaps PAGE, whose frame is being evicted, and every page that
+ * shares the frame, and returns true.  Fails, leaving them all
+ * mapped, if the process of one is running on another CPU.  The
+ * frame is pinned, so no page joins or leaves its sharers
+ * meanwhile. */
+static bool
+anon_unmap (struct page *page) {
+	struct list *sharers = &page->frame->sharers;
+	struct list_elem *e;
+
+	if (!vm_unmap_victim (page, page->anon.thread))
+		return false;
+	for (e = list_begin (sharers); e != list_end (sharers); e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+
+		if (!vm_unmap_victim (p, p->anon.thread)) {
+			anon_remap (page, e);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Maps back PAGE, and the pages sharing its frame up to STOP, or
+ * all of them if STOP is null, after anon_unmap(). */
+static void
+anon_remap (struct page *page, struct list_elem *stop) {
+	struct list *sharers = &page->frame->sharers;
+	struct list_elem *e;
+
+	vm_remap_victim (page, page->anon.thread);
+	for (e = list_begin (sharers); e != list_end (sharers) && e != stop;
+			e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+
+		vm_remap_victim (p, p->anon.thread);
+	}
+}
+
+/* Gives each page sharing the frame of PAGE, just swapped out, a
+ * share of PAGE's place in swap, and takes the frame from it. */
+static void
+anon_share_out (struct page *page) {
+	struct list *sharers = &page->frame->sharers;
+	struct list_elem *e;
+
+	for (e = list_begin (sharers); e != list_end (sharers); e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+
+		anon_share_swapped (page, p);
+		p->frame = NULL;
+	}
+}
+
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	vm_frame_wait (page);
 	if (page->frame != NULL) {
-		free(page->frame);
+		/* Fails only to split a 2 MB page, and then the whole
+		   page table is about to go: anonymous pages are
+		   destroyed only as their process exits or execs. */
+		pml4_clear_page (anon_page->thread->pml4, page->va);
+		vm_frame_put (page->frame, page);
+		page->frame = NULL;
+	} else if (anon_page->zswap_idx != BITMAP_ERROR)
+		zswap_free (page);
+	else if (page->bitmap_idx != BITMAP_ERROR) {
+		swap_slot_free (page->bitmap_idx, page);
+		page->bitmap_idx = BITMAP_ERROR;
 	}
 }
@@ -1,12 +1,18 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <hash.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static bool mmap_lazy_load (struct page *page, void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -16,9 +22,54 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* A file page in memory.  Every mapping of the same page of the
+   same file, in any process, maps the one frame recorded here, so
+   processes that map a file see each other's stores at once.  The
+   frame is owned by the process that read it in, and can be
+   evicted only while no other process maps it.  An entry stays
+   here while its frame is written back, so that a process faulting
+   the page in meanwhile waits instead of reading stale data. */
+struct file_frame {
+	struct inode *inode;        /* Backing file. */
+	off_t ofs;                  /* Offset of the page in it. */
+	struct frame *frame;        /* Frame holding the page. */
+	int map_cnt;                /* Number of pages mapping FRAME. */
+	bool dirty;                 /* Written through an unmapped page? */
+	bool writeback;             /* Being written back and dropped? */
+	struct hash_elem elem;      /* Element in file_frames. */
+};
+
+/* Resident file pages, by inode and offset. */
+static struct hash file_frames;
+static struct lock file_frames_lock;
+
+/* Signaled when a write-back finishes.  WRITEBACK_SEQ counts the
+   write-backs finished, so a process reading a page in can tell
+   whether one may have raced with its read. */
+static struct condition writeback_done;
+static unsigned writeback_seq;
+
+static uint64_t file_frame_hash (const struct hash_elem *, void *);
+static bool file_frame_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+static struct file_frame *file_frame_find (struct inode *, off_t);
+static bool file_frame_publish (struct page *, unsigned seq);
+static void file_frame_retire (struct file_frame *, struct file_page *,
+		bool dirty);
+static bool file_page_read (struct page *);
+static void file_page_info (struct page *, struct mmap_info *);
+static void file_page_setup (struct page *, struct mmap_info *);
+static struct mmap_file *spt_mmap_file (struct supplemental_page_table *,
+		void *va);
+static struct mmap_file *mmap_file_open (struct file *);
+static void mmap_file_put (struct mmap_file *);
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	hash_init (&file_frames, file_frame_hash, file_frame_less, NULL);
+	lock_init (&file_frames_lock);
+	cond_init (&writeback_done);
 }
 
 /* Initialize the file backed page */
@@ -32,80 +83,394 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 
 /* Swap in the page by read contents from the file. */
 static bool
-file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
-	off_t res = file_read_at(file_page->file, kva, file_page->read_bytes, file_page->ofs);
-	if (res != file_page->read_bytes)
-        return false;
-	
-	memset(kva + file_page->read_bytes, 0, PGSIZE-(file_page->read_bytes));
-	return true;
+file_backed_swap_in (struct page *page, void *kva UNUSED) {
+	return file_page_read (page);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  Fails,
+   leaving the page in place, if another process maps it too or
+   its owner is running on another CPU. */
 static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
-	struct thread *curr = thread_current();
-
-    if (pml4_is_dirty(curr->pml4, page->va)) {
-		file_seek (file_page->file, file_page->ofs);
-		file_write (file_page->file, page->va, file_page->read_bytes);
-        // file_write_at(file_page->file, page->va, file_page->read_bytes, file_page->ofs);
-        pml4_set_dirty(curr->pml4, page->va, false);
-    }
-	pml4_clear_page(curr->pml4, page->va);
+	uint64_t *pml4 = page->frame->owner->pml4;
+	struct file_frame *ff;
+	bool dirty;
+
+	lock_acquire (&file_frames_lock);
+	ff = file_frame_find (file_get_inode (file_page->mfile->file), file_page->ofs);
+	if (ff != NULL && ff->map_cnt > 1) {
+		lock_release (&file_frames_lock);
+		return false;
+	}
+	if (ff != NULL) {
+		ff->map_cnt = 0;
+		ff->writeback = true;
+	}
+	lock_release (&file_frames_lock);
+
+	/* Unmap first: the owner need not be the current thread. */
+	if (!vm_unmap_victim (page, page->frame->owner)) {
+		if (ff != NULL) {
+			lock_acquire (&file_frames_lock);
+			ff->map_cnt = 1;
+			ff->writeback = false;
+			cond_broadcast (&writeback_done, &file_frames_lock);
+			lock_release (&file_frames_lock);
+		}
+		return false;
+	}
+	dirty = pml4_is_dirty (pml4, page->va);
+	pml4_set_dirty(pml4, page->va, false);
+
+	if (ff != NULL) {
+		lock_acquire (&file_frames_lock);
+		file_frame_retire (ff, file_page, dirty);
+		lock_release (&file_frames_lock);
+	} else if (dirty)
+		file_write_at (file_page->mfile->file, page->frame->kva,
+				file_page->read_bytes, file_page->ofs);
 	page->frame = NULL;
 
 	return true;
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller.
+   The frame is written back and freed along with the last page
+   that maps it. */
 static void
 file_backed_destroy (struct page *page) {
 	struct file_page *file_page = &page->file;
 	struct thread *curr = thread_current();
+	struct frame *frame;
+	struct file_frame *ff;
+	bool dirty, last = true;
+
+	vm_frame_wait (page);
+	frame = page->frame;
+	if (frame == NULL) {
+		mmap_file_put (file_page->mfile);
+		return;
+	}
 
-	if (pml4_is_dirty(curr->pml4, page->va)) {
-		file_write_at(file_page->file, page->va, file_page->read_bytes, file_page->ofs);
-		pml4_set_dirty(thread_current()->pml4, page->va, false);
+	/* File pages are never part of a 2 MB page, so this does not
+	   fail. */
+	dirty = pml4_is_dirty (curr->pml4, page->va);
+	pml4_clear_page (curr->pml4, page->va);
+
+	lock_acquire (&file_frames_lock);
+	ff = file_frame_find (file_get_inode (file_page->mfile->file), file_page->ofs);
+	if (ff != NULL) {
+		last = --ff->map_cnt == 0;
+		if (last) {
+			ff->writeback = true;
+			file_frame_retire (ff, file_page, dirty);
+		} else {
+			ff->dirty |= dirty;
+			if (frame->page == page)
+				vm_frame_detach (frame);
+		}
 	}
+	lock_release (&file_frames_lock);
 
-	if (page->frame != NULL) {
-		list_remove(&(page->frame->fcfs_elem));
-		free(page->frame);
+	if (ff == NULL && dirty)
+		file_write_at (file_page->mfile->file, frame->kva,
+				file_page->read_bytes, file_page->ofs);
+	if (last)
+		vm_frame_free (frame);
+	page->frame = NULL;
+	mmap_file_put (file_page->mfile);
+}
+
+/* Maps into PAGE, a file-backed page of the current process that
+   is not in memory, the frame of another mapping of the same file
+   page.  Returns false, doing nothing, if there is none. */
+bool
+file_backed_attach (struct page *page) {
+	struct thread *curr = thread_current ();
+	struct mmap_info info;
+	struct file_frame *ff;
+
+	file_page_info (page, &info);
+	lock_acquire (&file_frames_lock);
+	ff = file_frame_find (file_get_inode (info.mfile->file), info.ofs);
+	while (ff != NULL && ff->writeback) {
+		cond_wait (&writeback_done, &file_frames_lock);
+		ff = file_frame_find (file_get_inode (info.mfile->file), info.ofs);
 	}
+	if (ff != NULL)
+		ff->map_cnt++;
+	lock_release (&file_frames_lock);
+	if (ff == NULL)
+		return false;
 
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct mmap_info *aux = page->uninit.aux;
+
+		page->operations = &file_ops;
+		file_page_setup (page, aux);
+	}
+	page->frame = ff->frame;
+	pml4_set_page (curr->pml4, page->va, ff->frame->kva, page->writable);
+	return true;
 }
 
+/* Gives the current process a page mapping the same file page as
+   SRC, a file-backed page in SRC_SPT of the process being forked.
+   The new page shares SRC's frame once it is faulted in.  Pages
+   are copied in order of address, so the file is reopened only
+   for the first page of each mapping and shared by the rest. */
+bool
+file_backed_copy (struct supplemental_page_table *src_spt,
+		struct page *src) {
+	struct mmap_info *aux = malloc (sizeof *aux);
+
+	if (aux == NULL)
+		return false;
+	file_page_info (src, aux);
+
+	if (spt_mmap_file (src_spt, src->va - PGSIZE) == aux->mfile)
+		aux->mfile = spt_mmap_file (&thread_current ()->spt,
+				src->va - PGSIZE);
+	else
+		aux->mfile = mmap_file_open (aux->mfile->file);
+	if (aux->mfile == NULL) {
+		free (aux);
+		return false;
+	}
+
+	if (!vm_alloc_page_with_initializer (VM_FILE, src->va, src->writable,
+				mmap_lazy_load, aux)) {
+		if (aux->mfile->page_cnt == 0)
+			mmap_file_put (aux->mfile);
+		free (aux);
+		return false;
+	}
+	aux->mfile->page_cnt++;
+	return true;
+}
+
+/* Frees AUX, the mmap_info of a file-backed page destroyed before
+   it was ever faulted in. */
+void
+file_backed_free_aux (struct mmap_info *aux) {
+	mmap_file_put (aux->mfile);
+	free (aux);
+}
+
+/* Returns the inode of the file that backs PAGE, a file-backed
+   page, and stores the offset of the page within it in *OFS. */
+struct inode *
+file_backed_inode (struct page *page, off_t *ofs) {
+	struct mmap_info info;
+
+	file_page_info (page, &info);
+	*ofs = info.ofs;
+	return file_get_inode (info.mfile->file);
+}
+
+/* Reads PAGE, a file-backed page, into its frame and records the
+   frame as the one for its file page.  Reads the page again if a
+   write-back may have raced with the read. */
 static bool
-mmap_lazy_load (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-	struct mmap_info *mmap_info = (struct mmap_info *)aux;
+file_page_read (struct page *page) {
 	struct file_page *file_page = &page->file;
-	list_push_back(&(thread_current()->mmap_info_list), &(file_page->file_elem));
-	
-	off_t res = file_read_at (mmap_info->file, page->va, 
-					mmap_info->read_bytes, mmap_info->ofs);
+	void *kva = page->frame->kva;
+	unsigned seq;
 
-	if (res != mmap_info->read_bytes) {
-		return false;
+	do {
+		lock_acquire (&file_frames_lock);
+		seq = writeback_seq;
+		lock_release (&file_frames_lock);
+
+		if (file_read_at (file_page->mfile->file, kva, file_page->read_bytes,
+					file_page->ofs) != (off_t) file_page->read_bytes)
+			return false;
+		memset (kva + file_page->read_bytes, 0,
+				PGSIZE - file_page->read_bytes);
+	} while (!file_frame_publish (page, seq));
+	return true;
+}
+
+/* Records PAGE's frame, just read in, as the frame for its file
+   page.  If another process read the same page in meanwhile, maps
+   that frame instead and frees PAGE's.  Returns false, doing
+   nothing, if the page may have been written back since SEQ was
+   taken from writeback_seq, so that the frame may be stale. */
+static bool
+file_frame_publish (struct page *page, unsigned seq) {
+	struct file_page *file_page = &page->file;
+	struct inode *inode = file_get_inode (file_page->mfile->file);
+	struct frame *frame = page->frame;
+	struct file_frame *ff;
+
+	lock_acquire (&file_frames_lock);
+	ff = file_frame_find (inode, file_page->ofs);
+	while (ff != NULL && ff->writeback) {
+		cond_wait (&writeback_done, &file_frames_lock);
+		ff = file_frame_find (inode, file_page->ofs);
 	}
+	if (ff == NULL) {
+		if (seq != writeback_seq) {
+			lock_release (&file_frames_lock);
+			return false;
+		}
+		ff = malloc (sizeof *ff);
+		if (ff != NULL) {
+			ff->inode = inode;
+			ff->ofs = file_page->ofs;
+			ff->frame = frame;
+			ff->map_cnt = 1;
+			ff->dirty = false;
+			ff->writeback = false;
+			hash_insert (&file_frames, &ff->elem);
+		}
+		lock_release (&file_frames_lock);
+		return true;
+	}
+	ff->map_cnt++;
+	lock_release (&file_frames_lock);
+
+	page->frame = ff->frame;
+	pml4_set_page (thread_current ()->pml4, page->va, ff->frame->kva,
+			page->writable);
+	vm_frame_free (frame);
+	return true;
+}
+
+/* Writes back FF, which no page maps any more and which is marked
+   as under write-back, if it or FILE_PAGE's mapping is DIRTY, and
+   then drops it.  The caller must hold file_frames_lock, which is
+   released during the write. */
+static void
+file_frame_retire (struct file_frame *ff, struct file_page *file_page,
+		bool dirty) {
+	ASSERT (ff->writeback);
+
+	if (dirty || ff->dirty) {
+		lock_release (&file_frames_lock);
+		file_write_at (file_page->mfile->file, ff->frame->kva,
+				file_page->read_bytes, file_page->ofs);
+		lock_acquire (&file_frames_lock);
+	}
+	hash_delete (&file_frames, &ff->elem);
+	free (ff);
+	writeback_seq++;
+	cond_broadcast (&writeback_done, &file_frames_lock);
+}
+
+/* Returns the resident file page for offset OFS in INODE, or a
+   null pointer if there is none.  The caller must hold
+   file_frames_lock. */
+static struct file_frame *
+file_frame_find (struct inode *inode, off_t ofs) {
+	struct file_frame key;
+	struct hash_elem *e;
+
+	key.inode = inode;
+	key.ofs = ofs;
+	e = hash_find (&file_frames, &key.elem);
+	return e != NULL ? hash_entry (e, struct file_frame, elem) : NULL;
+}
+
+/* Returns a hash value for file_frame E. */
+static uint64_t
+file_frame_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct file_frame *ff = hash_entry (e, struct file_frame, elem);
+	return hash_bytes (&ff->inode, sizeof ff->inode) ^ hash_int (ff->ofs);
+}
+
+/* Returns true if file_frame A precedes file_frame B. */
+static bool
+file_frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct file_frame *a = hash_entry (a_, struct file_frame, elem);
+	const struct file_frame *b = hash_entry (b_, struct file_frame, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Stores in *INFO the file, offset and sizes that back PAGE, a
+   file-backed page that may not have been faulted in yet. */
+static void
+file_page_info (struct page *page, struct mmap_info *info) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		*info = *(struct mmap_info *) page->uninit.aux;
+	else {
+		info->mfile = page->file.mfile;
+		info->ofs = page->file.ofs;
+		info->read_bytes = page->file.read_bytes;
+		info->length = page->file.length;
+	}
+}
+
+/* Returns the mmap_file of the file-backed page at VA in SPT, or a
+   null pointer if there is none. */
+static struct mmap_file *
+spt_mmap_file (struct supplemental_page_table *spt, void *va) {
+	struct page *page = spt_find_page (spt, va);
+	struct mmap_info info;
+
+	if (page == NULL || page_get_type (page) != VM_FILE)
+		return NULL;
+	file_page_info (page, &info);
+	return info.mfile;
+}
+
+/* Returns a new mmap_file for a reopened copy of FILE, with no
+   pages yet, or a null pointer if out of memory. */
+static struct mmap_file *
+mmap_file_open (struct file *file) {
+	struct mmap_file *mfile = malloc (sizeof *mfile);
+
+	if (mfile == NULL)
+		return NULL;
+	mfile->file = file_reopen (file);
+	if (mfile->file == NULL) {
+		free (mfile);
+		return NULL;
+	}
+	mfile->page_cnt = 0;
+	return mfile;
+}
+
+/* Drops a page's reference to MFILE, closing it along with the
+   last.  An MFILE that no page has referred to yet is closed too. */
+static void
+mmap_file_put (struct mmap_file *mfile) {
+	if (mfile->page_cnt <= 1) {
+		file_close (mfile->file);
+		free (mfile);
+	} else
+		mfile->page_cnt--;
+}
 
-	memset((char *)page->va + mmap_info->read_bytes, 0, PGSIZE-mmap_info->read_bytes);
+/* Fills in PAGE's file_page from AUX, which it frees. */
+static void
+file_page_setup (struct page *page, struct mmap_info *aux) {
+	struct file_page *file_page = &page->file;
 
+	list_push_back (&thread_current ()->mmap_info_list,
+			&file_page->file_elem);
 	file_page->page = page;
-	file_page->file = mmap_info->file;
-	file_page->ofs = mmap_info->ofs;
-	file_page->read_bytes = mmap_info->read_bytes;
-	file_page->length = mmap_info->length;
+	file_page->mfile = aux->mfile;
+	file_page->ofs = aux->ofs;
+	file_page->read_bytes = aux->read_bytes;
+	file_page->length = aux->length;
+	free (aux);
+}
 
-	pml4_set_dirty(thread_current()->pml4, page->va, false);
-	free(aux);
+static bool
+mmap_lazy_load (struct page *page, void *aux) {
+	/* TODO: Load the segment from the file */
+	/* TODO: This called when the first page fault occurs on address VA. */
+	/* TODO: VA is available when calling this function. */
+	struct mmap_info *mmap_info = (struct mmap_info *)aux;
 
-	return true;
+	file_page_setup (page, mmap_info);
+	return file_page_read (page);
 }
 
 /* Do the mmap */
@@ -117,8 +482,8 @@ do_mmap (void *addr, size_t length, int writable,
 
 	// You should use the file_reopen function to obtain a separate and 
 	// independent reference to the file for each of its mappings
-	struct file *reopen_file = file_reopen(file);
-	if (reopen_file == NULL) {
+	struct mmap_file *mfile = mmap_file_open (file);
+	if (mfile == NULL) {
         return NULL;
     }
 
@@ -126,9 +491,21 @@ do_mmap (void *addr, size_t length, int writable,
 	// just like anonymous pages. 
 	// You can use vm_alloc_page_with_initializer or 
 	// vm_alloc_page to make a page object.
-	size_t read_bytes = file_length(reopen_file) < length ? file_length(reopen_file) : length;
+	size_t read_bytes = file_length(mfile->file) < length ? file_length(mfile->file) : length;
 	size_t zero_bytes = pg_round_up(length) - read_bytes;
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	void *upage = addr;
+	void *inserted = addr;      /* End of the pages already in SPT. */
+	struct page **pages;        /* Pages not yet in SPT. */
+	size_t cnt = 0;
+
+	/* The pages go into the spt a last-level node's worth at a
+	   time, so that the tree is walked once per node. */
+	pages = malloc (SPT_FANOUT * sizeof *pages);
+	if (pages == NULL) {
+		mmap_file_put (mfile);
+		return NULL;
+	}
 
 	while (read_bytes > 0 || zero_bytes > 0) {
 		/* Do calculate how to fill this page.
@@ -139,29 +516,50 @@ do_mmap (void *addr, size_t length, int writable,
 
 		/* TODO: Set up aux to pass information to the lazy_load_segment. */
 		struct mmap_info *aux  = (struct mmap_info *)malloc(sizeof(struct mmap_info));
-		if (aux == NULL) {
-			return false;
-		}
+		if (aux == NULL)
+			goto fail;
 
-		aux->file = reopen_file;
+		aux->mfile = mfile;
 		aux->ofs = offset;
 		aux->read_bytes = page_read_bytes;
 		aux->length = length;
 
-		if (!vm_alloc_page_with_initializer (VM_FILE, upage,
-					writable, mmap_lazy_load, aux)) {
-						file_close(reopen_file);
-						free(aux);
-						return false;
-					}
+		pages[cnt] = vm_new_page (VM_FILE, upage, writable, mmap_lazy_load,
+				aux);
+		if (pages[cnt] == NULL) {
+			free (aux);
+			goto fail;
+		}
+		cnt++;
+		mfile->page_cnt++;
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
 		offset += PGSIZE;
+
+		if (pg_no (upage) % SPT_FANOUT == 0
+				|| (read_bytes == 0 && zero_bytes == 0)) {
+			if (!spt_insert_range (spt, pages, cnt))
+				goto fail;
+			inserted = upage;
+			cnt = 0;
+		}
 	}
+	free (pages);
 	return addr;
+
+fail:
+	/* Destroying the pages drops their references to MFILE, and
+	   the last one closes it. */
+	if (mfile->page_cnt == 0)
+		mmap_file_put (mfile);
+	while (cnt > 0)
+		vm_dealloc_page (pages[--cnt]);
+	spt_remove_range (spt, addr, inserted);
+	free (pages);
+	return NULL;
 }
 
 /* Do the munmap */
@@ -172,27 +570,13 @@ do_munmap (void *addr) {
 	// The pages are then removed from the process's list of virtual pages.
 	struct thread *curr = thread_current();
 	struct page *page = spt_find_page(&curr->spt, addr);
-	struct file_page *file_page = &page->file;
-	struct file *file = file_page->file;
-	void *upage = addr;
+	struct mmap_info info;
 
-	uint32_t write_bytes = 0;
-	uint32_t length = file_page->length;
-
-	while (write_bytes < length) {
-        struct page *m_page = spt_find_page(&curr->spt, upage);
-		struct file_page *m_file_page = &m_page->file;
-
-        if (pml4_is_dirty(curr->pml4, upage)) {
-			file_write_at(m_file_page->file, upage, m_file_page->read_bytes, m_file_page->ofs);
-		}
-
-        hash_delete(&(curr->spt), &(m_page->page_elem));
-        spt_remove_page(&curr->spt, m_page);
-
-        upage += PGSIZE;
-		write_bytes += PGSIZE;
-    }
+	if (page == NULL || page_get_type (page) != VM_FILE)
+		return;
+	file_page_info (page, &info);
 
-	file_close(file);
+	/* Destroying a page writes it back if it is dirty, and
+	   destroying the last one closes the mapping's file. */
+	spt_remove_range (&curr->spt, addr, addr + info.length);
 }
@@ -1,13 +1,78 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
+#include "devices/timer.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
 #define LIMIT_STACK_SIZE 1 << 20
+#define EVICT_BATCH 8           /* Frames evicted at a time. */
+
+/* Every frame that holds a user page, in any process, in the
+   order the clock hand sweeps them.  FRAME_TABLE_LOCK protects
+   the list, the hand and each frame's `pinned'; FRAME_UNPINNED is
+   signaled when an eviction finishes. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct lock frame_table_lock;
+static struct condition frame_unpinned;
+
+/* A page of zeros, mapped read-only by every anonymous page that
+   was read but never written.  It is shared copy-on-write like a
+   forked page, but is not in the frame table, so it is never
+   evicted, and its own reference keeps SHARE_CNT above 1. */
+static struct frame zero_frame;
+
+/* Statistics. */
+static long long fault_cnt;     /* Page faults handled. */
+static long long fault_ns;      /* Time spent on them. */
+static long long fork_cnt;      /* Page tables copied by fork. */
+static long long fork_ns;       /* Time spent on them. */
+static long long swap_in_cnt;   /* Pages read back in. */
+static long long evict_cnt;     /* Frames evicted. */
+static long long cow_cnt;       /* Pages copied on write. */
+static long long readahead_cnt; /* Pages swapped in ahead of faults. */
+static long long zero_map_cnt;  /* Read faults given the zero frame. */
+static long long huge_cnt;      /* Regions mapped with a 2 MB page. */
+static long long huge_place_cnt;/* Frames placed for one. */
+static long long reclaim_runs;  /* Times the reclaim daemon woke. */
+static long long reclaim_cnt;   /* Frames it freed. */
+
+/* The reclaim daemon evicts in the background whenever fewer
+   than VM_WMARK_LOW user frames are free, until VM_WMARK_HIGH
+   are, so that faults find free frames rather than wait for a
+   victim's write-out.  Set by -wmark-low and -wmark-high. */
+size_t vm_wmark_low = 16;
+size_t vm_wmark_high = 32;
+static struct semaphore reclaim_sema;
+static bool reclaim_pending;
+static void reclaim_daemon (void *aux);
+
+/* The merge daemon scans VM_KSM_PAGES frames every VM_KSM_INTERVAL
+   ticks for anonymous pages with the same contents, in any
+   process, and maps them all read-only to one frame, to be copied
+   again on write.  Scanned frames are listed in KSM_TABLE by a
+   hash of their contents, for later ones to be compared with.  Set
+   by -ksm-pages and -ksm-interval; off unless -ksm-pages is given,
+   since merging turns pages copy-on-write behind a process's back.
+   FRAME_TABLE_LOCK protects the table and the cursor. */
+size_t vm_ksm_pages = 0;
+int64_t vm_ksm_interval = TIMER_FREQ;
+static struct hash ksm_table;
+static struct list_elem *ksm_cursor;
+static uint64_t zero_hash;              /* Hash of a page of zeros. */
+static long long ksm_scanned;           /* Frames compared. */
+static long long ksm_merged;            /* Frames freed by merging. */
+static void ksm_daemon (void *aux);
+static uint64_t ksm_hash (const struct hash_elem *e, void *aux);
+static bool ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -21,6 +86,44 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	clock_hand = list_end (&frame_table);
+	lock_init (&frame_table_lock);
+	cond_init (&frame_unpinned);
+	zero_frame.kva = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+	zero_frame.share_cnt = 1;
+	list_init (&zero_frame.sharers);
+
+	if (vm_wmark_high < vm_wmark_low)
+		vm_wmark_high = vm_wmark_low;
+	sema_init (&reclaim_sema, 0);
+	if (vm_wmark_low > 0)
+		thread_create ("reclaim", PRI_DEFAULT, reclaim_daemon, NULL);
+
+	hash_init (&ksm_table, ksm_hash, ksm_less, NULL);
+	ksm_cursor = list_end (&frame_table);
+	zero_hash = hash_bytes (zero_frame.kva, PGSIZE);
+	if (vm_ksm_pages > 0 && vm_ksm_interval > 0)
+		thread_create ("ksm", PRI_DEFAULT, ksm_daemon, NULL);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld faults, %lld swap-ins, %lld read ahead, "
+			"%lld evictions, %lld copies on write, %lld zero-page maps\n",
+			fault_cnt, swap_in_cnt, readahead_cnt, evict_cnt, cow_cnt,
+			zero_map_cnt);
+	printf ("VM: %lld ns per fault, %lld ns per fork's page table copy\n",
+			fault_cnt > 0 ? fault_ns / fault_cnt : 0,
+			fork_cnt > 0 ? fork_ns / fork_cnt : 0);
+	anon_print_stats ();
+	printf ("VM: reclaim woke %lld times, freed %lld frames\n",
+			reclaim_runs, reclaim_cnt);
+	printf ("VM: merging compared %lld frames, saved %lld\n",
+			ksm_scanned, ksm_merged);
+	printf ("VM: %lld 2 MB pages mapped, %lld frames placed for them\n",
+			huge_cnt, huge_place_cnt);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -37,27 +140,61 @@ page_get_type (struct page *page) {
 	}
 }
 
-/* Returns a hash value for page p. */
-unsigned
-page_hash (const struct hash_elem *p_, void *aux UNUSED) {
-  const struct page *p = hash_entry (p_, struct page, page_elem);
-  return hash_bytes (&p->va, sizeof p->va);
-}
-
-/* Returns true if page a precedes page b. */
-bool
-page_less (const struct hash_elem *a_,
-           const struct hash_elem *b_, void *aux UNUSED) {
-  const struct page *a = hash_entry (a_, struct page, page_elem);
-  const struct page *b = hash_entry (b_, struct page, page_elem);
-
-  return a->va < b->va;
-}
-
 /* Helpers */
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
+static bool vm_handle_fault (struct intr_frame *f, void *addr, bool user,
+		bool write, bool not_present);
+static bool vm_claim_frame (struct page *page, bool keep_pinned);
+static bool vm_map_frame (struct page *page, struct frame *frame,
+		bool keep_pinned);
+static void vm_swap_readahead (struct page **pages, size_t cnt);
+static void vm_try_collapse (struct page *page);
+static size_t vm_evict (struct frame **keep, size_t max);
 static struct frame *vm_evict_frame (void);
+static struct frame *vm_get_free_frame (struct page *page);
+static void *vm_place_frame (struct page *page);
+static void vm_frame_unlink (struct frame *frame);
+static bool vm_frame_pin (struct page *page);
+static void vm_frame_unpin (struct frame *frame);
+static void vm_frame_share (struct frame *frame, struct page *page);
+static bool vm_running_elsewhere (struct thread *t);
+static bool vm_page_idle (struct page *page, struct thread *owner);
+static void spt_detach (struct supplemental_page_table *, struct page *);
+
+/* Creates the pending page object for UPAGE with initializer,
+ * without inserting it into any spt, for callers that insert many
+ * at once with spt_insert_range().  Returns NULL if out of
+ * memory. */
+struct page *
+vm_new_page (enum vm_type type, void *upage, bool writable,
+		vm_initializer *init, void *aux) {
+	ASSERT (VM_TYPE(type) != VM_UNINIT)
+
+	/* Create the page, fetch the initialier according to the VM type,
+	 * and then create "uninit" page struct by calling uninit_new. You
+	 * should modify the field after calling the uninit_new. */
+	struct page *new_page = (struct page *)malloc(sizeof(struct page));
+	if (new_page == NULL)
+		return NULL;
+
+	void *va = pg_round_down(upage);
+
+	switch (VM_TYPE(type)) {
+		case VM_ANON:
+			uninit_new(new_page, va, init, type, aux, anon_initializer);
+			break;
+		case VM_FILE:
+			uninit_new(new_page, va, init, type, aux, file_backed_initializer);
+			break;
+		default:
+			NOT_REACHED();
+			break;
+	}
+
+	new_page->writable = writable;
+	return new_page;
+}
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -71,30 +208,10 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* Create the page, fetch the initialier according to the VM type,
-		 * and then create "uninit" page struct by calling uninit_new. You
-		 * should modify the field after calling the uninit_new. */
-		
-		struct page *new_page = (struct page *)malloc(sizeof(struct page));
+		struct page *new_page = vm_new_page (type, upage, writable, init, aux);
 		if (new_page == NULL)
             goto err;
 
-		void *va = pg_round_down(upage);
-
-		switch (VM_TYPE(type)) {
-            case VM_ANON:
-                uninit_new(new_page, va, init, type, aux, anon_initializer);
-                break;
-            case VM_FILE:
-                uninit_new(new_page, va, init, type, aux, file_backed_initializer);
-                break;
-            default:
-                NOT_REACHED();
-                break;
-        }
-
-		new_page->writable = writable;
-
 		/* Insert the page into the spt. */
 		if (!spt_insert_page(spt, new_page)) {
 			free(new_page);
@@ -106,110 +223,849 @@ err:
 	return false;
 }
 
+#define SPT_VPN_LIMIT ((uint64_t) 1 << (SPT_BITS * SPT_LEVELS))
+
+/* Returns the number of bits of a VPN below the index at LEVEL. */
+static inline int
+spt_shift (int level) {
+	return SPT_BITS * (SPT_LEVELS - 1 - level);
+}
+
+/* Returns the last-level node of SPT that holds VPN's slot,
+ * creating the nodes on the way there if CREATE.  Returns NULL if
+ * there is no such node, or it cannot be created. */
+static struct spt_node *
+spt_leaf (struct supplemental_page_table *spt, uint64_t vpn, bool create) {
+	struct spt_node **node = &spt->root;
+
+	if (vpn >= SPT_VPN_LIMIT)
+		return NULL;
+	for (int level = 0; ; level++) {
+		if (*node == NULL) {
+			if (!create || (*node = calloc (1, sizeof **node)) == NULL)
+				return NULL;
+		}
+		if (level == SPT_LEVELS - 1)
+			return *node;
+		node = (struct spt_node **)
+			&(*node)->slots[(vpn >> spt_shift (level)) & (SPT_FANOUT - 1)];
+	}
+}
+
+/* Returns the slot for VPN in SPT, creating the nodes on the way
+ * there if CREATE.  Returns NULL if there is no such slot, or it
+ * cannot be created. */
+static void **
+spt_slot (struct supplemental_page_table *spt, uint64_t vpn, bool create) {
+	struct spt_node *leaf = spt_leaf (spt, vpn, create);
+
+	return leaf != NULL ? &leaf->slots[vpn & (SPT_FANOUT - 1)] : NULL;
+}
+
 /* Returns the page containing the given virtual address, or a null pointer if no such page exists. */
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt, void *va) {
-	struct page *page = (struct page *)malloc(sizeof(struct page));
-	/* Find page in supplement page table - implemented project 3 */
-	struct hash_elem *e;
-
-	page->va =  pg_round_down(va);
-	e = hash_find (&spt->spt_ht, &page->page_elem);
+	void **slot = spt_slot (spt, pg_no (va), false);
 
-	free(page);
-	return e != NULL ? hash_entry (e, struct page, page_elem) : NULL;
+	return slot != NULL ? *slot : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
 spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
-	/* Insert page in supplement page - implemented project 3 */
-	struct hash_elem *e = hash_insert (&spt->spt_ht, &page->page_elem);
+	void **slot = spt_slot (spt, pg_no (page->va), true);
+
+	if (slot == NULL || *slot != NULL)
+		return false;
+	*slot = page;
+	return true;
+}
+
+/* Inserts PAGES, CNT pages at consecutive addresses from that of
+ * the first, into SPT.  Walks down to each last-level node once,
+ * rather than once per page.  Fails, leaving SPT as it was, if
+ * one of the addresses is taken or out of memory. */
+bool
+spt_insert_range (struct supplemental_page_table *spt,
+		struct page **pages, size_t cnt) {
+	uint64_t first = pg_no (pages[0]->va);
+	size_t i = 0;
+
+	while (i < cnt) {
+		uint64_t vpn = first + i;
+		struct spt_node *leaf = spt_leaf (spt, vpn, true);
 
-	return e == NULL ? true : false;
+		if (leaf == NULL)
+			goto undo;
+		do {
+			void **slot = &leaf->slots[vpn & (SPT_FANOUT - 1)];
+
+			ASSERT (pg_no (pages[i]->va) == vpn);
+			if (*slot != NULL)
+				goto undo;
+			*slot = pages[i++];
+		} while (i < cnt && (++vpn & (SPT_FANOUT - 1)) != 0);
+	}
+	return true;
+
+undo:
+	while (i-- > 0)
+		spt_detach (spt, pages[i]);
+	return false;
 }
 
+/* Removes PAGE from SPT, freeing the nodes left empty, and frees
+ * PAGE. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	spt_detach (spt, page);
 	vm_dealloc_page (page);
-	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes PAGE from SPT, freeing the nodes left empty. */
+static void
+spt_detach (struct supplemental_page_table *spt, struct page *page) {
+	struct spt_node **path[SPT_LEVELS];
+	struct spt_node **node = &spt->root;
+	uint64_t vpn = pg_no (page->va);
+	int level;
+
+	for (level = 0; level < SPT_LEVELS; level++) {
+		void **slot;
+
+		ASSERT (*node != NULL);
+		path[level] = node;
+		slot = &(*node)->slots[(vpn >> spt_shift (level)) & (SPT_FANOUT - 1)];
+		if (level == SPT_LEVELS - 1) {
+			ASSERT (*slot == page);
+			*slot = NULL;
+		}
+		node = (struct spt_node **) slot;
+	}
+
+	/* Bottom up, free nodes until one still has something in it. */
+	for (level = SPT_LEVELS - 1; level >= 0; level--) {
+		struct spt_node *n = *path[level];
+		size_t i;
+
+		for (i = 0; i < SPT_FANOUT; i++)
+			if (n->slots[i] != NULL)
+				break;
+		if (i < SPT_FANOUT)
+			break;
+		free (n);
+		*path[level] = NULL;
+	}
+}
+
+/* Returns the first page under NODE, at LEVEL, with a VPN in
+ * [START, END).  BASE is the first VPN that NODE covers. */
+static struct page *
+spt_node_first (struct spt_node *node, int level, uint64_t base,
+		uint64_t start, uint64_t end) {
+	int shift = spt_shift (level);
+
+	for (size_t i = 0; i < SPT_FANOUT; i++) {
+		uint64_t lo = base + ((uint64_t) i << shift);
+		uint64_t hi = lo + ((uint64_t) 1 << shift);
+		struct page *page;
+
+		if (lo >= end)
+			break;
+		if (hi <= start || node->slots[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1)
+			return node->slots[i];
+		page = spt_node_first (node->slots[i], level + 1, lo, start, end);
+		if (page != NULL)
+			return page;
+	}
+	return NULL;
+}
+
+/* Returns the page of SPT at the lowest address in [START, END),
+ * or NULL if there is none.  Iterate in address order with
+ * START set past the page returned last. */
+struct page *
+spt_first_page (struct supplemental_page_table *spt, void *start, void *end) {
+	if (spt->root == NULL)
+		return NULL;
+	return spt_node_first (spt->root, 0, 0, pg_no (start),
+			pg_no (pg_round_up (end)));
+}
+
+/* Removes and frees the pages under *NODE, at LEVEL, with a VPN
+ * in [START, END), and frees *NODE if that leaves it empty.  BASE
+ * is the first VPN that *NODE covers. */
+static void
+spt_node_remove (struct spt_node **node, int level, uint64_t base,
+		uint64_t start, uint64_t end) {
+	int shift = spt_shift (level);
+	bool empty = true;
+
+	for (size_t i = 0; i < SPT_FANOUT; i++) {
+		uint64_t lo = base + ((uint64_t) i << shift);
+		uint64_t hi = lo + ((uint64_t) 1 << shift);
+		void **slot = &(*node)->slots[i];
+
+		if (*slot != NULL && lo < end && hi > start) {
+			if (level == SPT_LEVELS - 1) {
+				struct page *page = *slot;
+
+				*slot = NULL;
+				vm_dealloc_page (page);
+			} else
+				spt_node_remove ((struct spt_node **) slot, level + 1, lo,
+						start, end);
+		}
+		if (*slot != NULL)
+			empty = false;
+	}
+	if (empty) {
+		free (*node);
+		*node = NULL;
+	}
+}
+
+/* Removes and frees every page of SPT in [START, END), in one
+ * walk down the tree that visits each node in the range once. */
+void
+spt_remove_range (struct supplemental_page_table *spt, void *start, void *end) {
+	if (spt->root != NULL)
+		spt_node_remove (&spt->root, 0, 0, pg_no (start),
+				pg_no (pg_round_up (end)));
+}
+
+/* Get the struct frame, that will be evicted.
+ * Sweeps the clock hand over the frame table, giving each frame
+ * whose page was accessed since the last sweep a second chance.
+ * A frame shared copy-on-write is evicted from all its pages at
+ * once.  Returns NULL if every frame is pinned, unowned, or mapped
+ * by a thread running on another CPU.  The
+ * caller must hold frame_table_lock. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-	struct thread *curr = thread_current();
-	struct list *fcfs_cache = &curr->fcfs_cache;
+	size_t cnt = list_size (&frame_table);
+
+	/* The first sweep may do nothing but clear accessed bits. */
+	for (size_t i = 0; i < 2 * cnt; i++) {
+		struct frame *frame;
+		struct list_elem *e;
+		bool idle;
 
-	if (!list_empty(fcfs_cache)) {
-		victim = list_entry(list_pop_front(fcfs_cache), struct frame, fcfs_elem);
+		if (clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, frame_elem);
+		clock_hand = list_next (clock_hand);
+
+		if (frame->pinned || frame->page == NULL)
+			continue;
+
+		/* Every page sharing it must be idle. */
+		idle = vm_page_idle (frame->page, frame->owner);
+		for (e = list_begin (&frame->sharers); e != list_end (&frame->sharers);
+				e = list_next (e)) {
+			struct page *p = list_entry (e, struct page, share_elem);
+			idle &= vm_page_idle (p, p->anon.thread);
+		}
+		if (idle)
+			return frame;
 	}
-	
-	return victim;
+	return NULL;
+}
+
+/* Returns true if PAGE, of OWNER, was not accessed since the last
+ * sweep of the clock hand and OWNER is not running on another CPU.
+ * Clears the accessed bit for the next sweep. */
+static bool
+vm_page_idle (struct page *page, struct thread *owner) {
+	if (vm_running_elsewhere (owner))
+		return false;
+	if (pml4_is_accessed (owner->pml4, page->va)) {
+		pml4_set_accessed (owner->pml4, page->va, false);
+		return false;
+	}
+	return true;
+}
+
+/* Returns true if T, a thread other than the current one, is
+ * running on another CPU, or is being switched away from there,
+ * so that its translations may sit in a TLB this CPU cannot
+ * flush. */
+static bool
+vm_running_elsewhere (struct thread *t) {
+	if (t == thread_current ())
+		return false;
+	return __atomic_load_n (&t->status, __ATOMIC_ACQUIRE) == THREAD_RUNNING
+		|| __atomic_load_n (&t->on_cpu, __ATOMIC_ACQUIRE);
+}
+
+/* Marks PAGE, whose frame is being evicted, not present in the
+ * page table of OWNER, its process, and returns true.  If OWNER is
+ * running on another CPU meanwhile, it may go on using the frame
+ * through a stale TLB entry, so marks PAGE present again and
+ * returns false instead.  A thread being switched to loads its
+ * page table after it is marked running, so one that starts
+ * running later sees PAGE not present.  Also fails if there is no
+ * memory to split a 2 MB page around PAGE. */
+bool
+vm_unmap_victim (struct page *page, struct thread *owner) {
+	if (!pml4_clear_page (owner->pml4, page->va))
+		return false;
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	if (!vm_running_elsewhere (owner))
+		return true;
+	vm_remap_victim (page, owner);
+	return false;
+}
+
+/* Marks PAGE, of OWNER, present again after vm_unmap_victim(), as
+ * it was before. */
+void
+vm_remap_victim (struct page *page, struct thread *owner) {
+	uint64_t *pte = pml4e_walk (owner->pml4, (uint64_t) page->va, false);
+
+	ASSERT (pte != NULL);
+	*pte |= PTE_P;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Evicts up to MAX, at most EVICT_BATCH, pages and returns how
+ * many it evicted.  If KEEP is nonnull, the frame of the first is
+ * stored there, pinned, and kept.  The others go back to the user
+ * pool.  The anonymous ones among them land in neighbouring swap
+ * slots and are written out together at the end. */
+static size_t
+vm_evict (struct frame **keep, size_t max) {
+	struct frame *spare[EVICT_BATCH];
+	struct frame *frame;
+	size_t spare_cnt = 0, cnt = 0;
+	size_t tries;
+
+	if (max > EVICT_BATCH)
+		max = EVICT_BATCH;
+
+	lock_acquire (&frame_table_lock);
+	tries = list_size (&frame_table);
+	while (tries-- > 0 && cnt < max
+			&& (frame = vm_get_victim ()) != NULL) {
+		bool evicted;
+
+		/* Write the victim out without the lock held.  Its owner
+		   waits in vm_frame_wait() if it faults on or frees the
+		   page meanwhile. */
+		frame->pinned = true;
+		lock_release (&frame_table_lock);
+		evicted = swap_out (frame->page);
+		lock_acquire (&frame_table_lock);
+
+		if (!evicted) {
+			/* A file page mapped by another process too, or one
+			   whose process is running elsewhere; try the next. */
+			frame->pinned = false;
+			continue;
+		}
+
+		frame->page = NULL;
+		frame->owner = NULL;
+		frame->share_cnt = 1;
+		list_init (&frame->sharers);
+		evict_cnt++;
+		if (keep != NULL && cnt == 0)
+			*keep = frame;
+		else {
+			vm_frame_unlink (frame);
+			spare[spare_cnt++] = frame;
+		}
+		cnt++;
+	}
+	cond_broadcast (&frame_unpinned, &frame_table_lock);
+	lock_release (&frame_table_lock);
+	anon_swap_flush ();
+
+	for (size_t i = 0; i < spare_cnt; i++) {
+		palloc_free_page (spare[i]->kva);
+		free (spare[i]);
+	}
+	return cnt;
+}
+
+/* Evict a batch of pages and return the frame of the first; the
+ * others are left free for the faults that follow.
+ * Return NULL on error.  The frame is returned pinned. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-	swap_out(victim->page);
+	struct frame *victim = NULL;
 
+	vm_evict (&victim, EVICT_BATCH);
 	return victim;
 }
 
+/* Frees frames in the background while the user pool is below
+ * the high watermark.  Woken by vm_get_free_frame(). */
+static void
+reclaim_daemon (void *aux UNUSED) {
+	for (;;) {
+		size_t free_cnt;
+
+		sema_down (&reclaim_sema);
+		reclaim_runs++;
+		while ((free_cnt = palloc_user_free_cnt ()) < vm_wmark_high) {
+			size_t cnt = vm_evict (NULL, vm_wmark_high - free_cnt);
+			if (cnt == 0)
+				break;
+			reclaim_cnt += cnt;
+		}
+		reclaim_pending = false;
+	}
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is in the frame table, pinned until its page is read
+ * in. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = (struct frame *)malloc(sizeof(struct frame));
-	
+	struct frame *frame = vm_get_free_frame (NULL);
+
 	/* TODO: Fill this function. */
+	if (frame == NULL)
+		frame = vm_evict_frame ();
+	ASSERT (frame == NULL || frame->page == NULL);
+	return frame;
+}
+
+/* Like vm_get_frame(), but returns NULL rather than evicting if
+ * the user pool is empty.  If PAGE is not null, the frame is for
+ * it, and is placed for a 2 MB page if possible. */
+static struct frame *
+vm_get_free_frame (struct page *page) {
+	struct frame *frame = (struct frame *)malloc(sizeof(struct frame));
+
 	if (frame == NULL) {
 		printf("frame malloc failed!\n");
 		exit(-1);
 	}
 
-	void *kva = palloc_get_page(PAL_USER);
+	void *kva = page != NULL ? vm_place_frame (page) : NULL;
+	if (kva != NULL)
+		huge_place_cnt++;
+	else
+		kva = palloc_get_page(PAL_USER);
+	if (vm_wmark_low > 0 && !reclaim_pending
+			&& palloc_user_free_cnt () < vm_wmark_low) {
+		reclaim_pending = true;
+		sema_up (&reclaim_sema);
+	}
 	if (kva == NULL) {
 		free(frame);
-		return vm_evict_frame();
+		return NULL;
 	}
 
 	frame->kva = kva;
 	frame->page = NULL;
+	frame->owner = NULL;
+	frame->pinned = true;
+	frame->share_cnt = 1;
+	list_init (&frame->sharers);
+	frame->ksm_listed = false;
+
+	lock_acquire (&frame_table_lock);
+	list_push_back (&frame_table, &frame->frame_elem);
+	lock_release (&frame_table_lock);
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Waits until PAGE, of the current process, is not being evicted.
+ * Afterward PAGE is either resident and unpinned, or has no frame. */
+void
+vm_frame_wait (struct page *page) {
+	lock_acquire (&frame_table_lock);
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_unpinned, &frame_table_lock);
+	lock_release (&frame_table_lock);
+}
+
+/* Pins PAGE's frame, so that it is not evicted, and returns true.
+ * Returns false if PAGE is not resident. */
+static bool
+vm_frame_pin (struct page *page) {
+	bool pinned = false;
+
+	lock_acquire (&frame_table_lock);
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_unpinned, &frame_table_lock);
+	if (page->frame != NULL)
+		pinned = page->frame->pinned = true;
+	lock_release (&frame_table_lock);
+	return pinned;
+}
+
+/* Unpins FRAME. */
+static void
+vm_frame_unpin (struct frame *frame) {
+	lock_acquire (&frame_table_lock);
+	frame->pinned = false;
+	cond_broadcast (&frame_unpinned, &frame_table_lock);
+	lock_release (&frame_table_lock);
+}
+
+/* Points PAGE at FRAME, which it is to map copy-on-write, and
+ * adds it to FRAME's sharers.  The zero frame keeps no list of
+ * sharers, since it is never evicted. */
+static void
+vm_frame_share (struct frame *frame, struct page *page) {
+	lock_acquire (&frame_table_lock);
+	frame->share_cnt++;
+	if (frame != &zero_frame)
+		list_push_back (&frame->sharers, &page->share_elem);
+	page->frame = frame;
+	lock_release (&frame_table_lock);
+}
+
+/* Drops PAGE's share of FRAME, and frees FRAME if no other page
+ * maps it.  Returns true if FRAME was freed.  If PAGE is FRAME's
+ * page, another sharer takes FRAME over, so that the clock goes on
+ * evicting it. */
+bool
+vm_frame_put (struct frame *frame, struct page *page) {
+	bool last;
+
+	lock_acquire (&frame_table_lock);
+	if (frame->page == page) {
+		if (!list_empty (&frame->sharers)) {
+			struct page *next = list_entry (list_pop_front (&frame->sharers),
+					struct page, share_elem);
+
+			frame->page = next;
+			frame->owner = next->anon.thread;
+		} else {
+			frame->page = NULL;
+			frame->owner = NULL;
+		}
+	} else if (frame != &zero_frame)
+		list_remove (&page->share_elem);
+	last = --frame->share_cnt == 0;
+	lock_release (&frame_table_lock);
+
+	if (last)
+		vm_frame_free (frame);
+	return last;
+}
+
+/* Leaves FRAME in memory without an owner, because its owner's
+ * page is gone but other processes still map it.  The clock
+ * passes over it until vm_frame_free() is called. */
+void
+vm_frame_detach (struct frame *frame) {
+	lock_acquire (&frame_table_lock);
+	frame->page = NULL;
+	frame->owner = NULL;
+	lock_release (&frame_table_lock);
+}
+
+/* Removes FRAME from the frame table and frees it along with its
+ * page of memory.  No process may still map it. */
+void
+vm_frame_free (struct frame *frame) {
+	lock_acquire (&frame_table_lock);
+	vm_frame_unlink (frame);
+	lock_release (&frame_table_lock);
+
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Removes FRAME from the frame table, moving the clock hand off
+ * it.  The caller must hold frame_table_lock. */
+static void
+vm_frame_unlink (struct frame *frame) {
+	if (clock_hand == &frame->frame_elem)
+		clock_hand = list_next (clock_hand);
+	if (ksm_cursor == &frame->frame_elem)
+		ksm_cursor = list_next (ksm_cursor);
+	if (frame->ksm_listed) {
+		hash_delete (&ksm_table, &frame->ksm_elem);
+		frame->ksm_listed = false;
+	}
+	list_remove (&frame->frame_elem);
+}
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->ksm_hash;
+}
+
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->ksm_hash
+		< hash_entry (b, struct frame, ksm_elem)->ksm_hash;
+}
+
+/* Maps PAGE, of FRAME's owner, to FRAME read-only, so that it
+ * holds still while it is compared, and returns true.  If the
+ * owner is running on another CPU, where it may go on writing
+ * through a stale TLB entry, maps PAGE back as it was and returns
+ * false. */
+static bool
+ksm_protect (struct frame *frame, struct page *page) {
+	uint64_t *pml4 = frame->owner->pml4;
+
+	pml4_set_page (pml4, page->va, frame->kva, false);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	if (!vm_running_elsewhere (frame->owner))
+		return true;
+	pml4_set_page (pml4, page->va, frame->kva, page->writable);
+	return false;
+}
+
+/* Maps FRAME's page, of FRAME's owner, to TARGET read-only
+ * instead, frees FRAME, which the caller pinned and protected,
+ * and returns true.  If the owner is running on another CPU,
+ * where it may go on reading FRAME through a stale TLB entry,
+ * maps the page back to FRAME and returns false. */
+static bool
+ksm_replace (struct frame *frame, struct frame *target) {
+	struct page *page = frame->page;
+	uint64_t *pml4 = frame->owner->pml4;
+
+	pml4_set_page (pml4, page->va, target->kva, false);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	if (vm_running_elsewhere (frame->owner)) {
+		pml4_set_page (pml4, page->va, frame->kva, false);
+		return false;
+	}
+
+	vm_frame_share (target, page);
+	vm_frame_put (frame, page);
+	ksm_merged++;
+
+	/* Wake anyone who waited on FRAME for PAGE. */
+	lock_acquire (&frame_table_lock);
+	cond_broadcast (&frame_unpinned, &frame_table_lock);
+	lock_release (&frame_table_lock);
+	return true;
+}
+
+/* Merges FRAME, pinned, with the zero frame or a listed frame of
+ * the same contents, or else lists it.  Either way FRAME ends up
+ * unpinned or freed. */
+static void
+ksm_merge (struct frame *frame) {
+	struct page *page = frame->page;
+	uint64_t *pml4 = frame->owner->pml4;
+	struct frame *other = NULL;
+	struct page *other_page = NULL;
+	struct hash_elem *e;
+
+	/* Leave 2 MB pages whole. */
+	if (pml4_is_huge (pml4, page->va)) {
+		vm_frame_unpin (frame);
+		return;
+	}
+
+	/* Write-protect it, so it stays as compared.  A write waits in
+	   vm_handle_wp() for us to finish. */
+	if (!ksm_protect (frame, page)) {
+		vm_frame_unpin (frame);
+		return;
+	}
+	frame->ksm_hash = hash_bytes (frame->kva, PGSIZE);
+	ksm_scanned++;
+
+	if (frame->ksm_hash == zero_hash
+			&& !memcmp (frame->kva, zero_frame.kva, PGSIZE)
+			&& ksm_replace (frame, &zero_frame))
+		return;
+
+	lock_acquire (&frame_table_lock);
+	e = hash_find (&ksm_table, &frame->ksm_elem);
+	if (e != NULL) {
+		other = hash_entry (e, struct frame, ksm_elem);
+		/* A shared frame is read-only everywhere already; an
+		   unshared one must have a page to write-protect. */
+		if (other->pinned || (other->share_cnt == 1 && other->page == NULL))
+			other = NULL;
+		else
+			other->pinned = true;
+	}
+	lock_release (&frame_table_lock);
+
+	if (other != NULL) {
+		other_page = other->share_cnt == 1 ? other->page : NULL;
+		if (other_page != NULL && !ksm_protect (other, other_page)) {
+			vm_frame_unpin (other);
+			other = NULL;
+		}
+	}
+	if (other != NULL) {
+		if (!memcmp (frame->kva, other->kva, PGSIZE)
+				&& ksm_replace (frame, other)) {
+			vm_frame_unpin (other);
+			return;
+		}
+		if (other_page != NULL)
+			pml4_set_page (other->owner->pml4, other_page->va, other->kva,
+					other_page->writable);
+		vm_frame_unpin (other);
+	}
+
+	/* No match: map it back and list it in place of the last frame
+	   with that hash, which has changed since. */
+	pml4_set_page (pml4, page->va, frame->kva, page->writable);
+	lock_acquire (&frame_table_lock);
+	e = hash_replace (&ksm_table, &frame->ksm_elem);
+	if (e != NULL)
+		hash_entry (e, struct frame, ksm_elem)->ksm_listed = false;
+	frame->ksm_listed = true;
+	lock_release (&frame_table_lock);
+	vm_frame_unpin (frame);
+}
+
+/* Merges pages of identical contents in the background, scanning
+ * vm_ksm_pages frames of the frame table every vm_ksm_interval
+ * ticks. */
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (vm_ksm_interval);
+
+		for (size_t i = 0; i < vm_ksm_pages; i++) {
+			struct frame *frame = NULL;
+
+			lock_acquire (&frame_table_lock);
+			if (list_empty (&frame_table)) {
+				lock_release (&frame_table_lock);
+				break;
+			}
+			if (ksm_cursor == list_end (&frame_table))
+				ksm_cursor = list_begin (&frame_table);
+			frame = list_entry (ksm_cursor, struct frame, frame_elem);
+			ksm_cursor = list_next (ksm_cursor);
+
+			/* Only unshared anonymous pages, not under I/O. */
+			if (frame->pinned || frame->share_cnt != 1 || frame->page == NULL
+					|| VM_TYPE (frame->page->operations->type) != VM_ANON)
+				frame = NULL;
+			else {
+				if (frame->ksm_listed) {
+					hash_delete (&ksm_table, &frame->ksm_elem);
+					frame->ksm_listed = false;
+				}
+				frame->pinned = true;
+			}
+			lock_release (&frame_table_lock);
+
+			if (frame != NULL)
+				ksm_merge (frame);
+		}
+	}
+}
+
+/* Growing the stack.  The new page is claimed like any other
+ * by the fault that grew it. */
 static void
 vm_stack_growth (void *addr) {
 	void *stack_bottom = pg_round_down(addr);
-	if (vm_alloc_page(VM_ANON, stack_bottom, true)) {
-		vm_claim_page(stack_bottom);
-	}
+	vm_alloc_page(VM_ANON, stack_bottom, true);
+}
+
+/* Returns true if PAGE is an anonymous page that was never
+ * touched and has no contents to load: it reads as zeros. */
+static bool
+vm_page_is_zero (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Maps PAGE, which reads as zeros, to the zero frame read-only.
+ * Its first write gives it a frame of its own in
+ * vm_handle_wp(). */
+static bool
+vm_map_zero (struct page *page) {
+	struct thread *curr = thread_current ();
+
+	/* Turns PAGE into an anonymous page without touching KVA. */
+	if (!swap_in (page, zero_frame.kva))
+		return false;
+	vm_frame_share (&zero_frame, page);
+	zero_map_cnt++;
+	return pml4_set_page (curr->pml4, page->va, zero_frame.kva, false);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * PAGE shares its frame with another process since fork, or is
+ * mapped to the zero frame.  Gives
+ * PAGE a copy of its own, or takes the frame over if no other
+ * page maps it any longer. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct thread *curr = thread_current ();
+	struct frame *old, *new;
+	bool last;
+
+	/* Evicted since the fault: bring it back in, private. */
+	if (!vm_frame_pin (page))
+		return vm_do_claim_page (page);
+
+	old = page->frame;
+	lock_acquire (&frame_table_lock);
+	last = old->share_cnt == 1;
+	if (last) {
+		old->page = page;
+		old->owner = curr;
+	}
+	lock_release (&frame_table_lock);
+
+	if (last) {
+		pml4_set_page (curr->pml4, page->va, old->kva, true);
+		vm_frame_unpin (old);
+		return true;
+	}
+
+	new = vm_get_frame ();
+	if (new == NULL) {
+		vm_frame_unpin (old);
+		return false;
+	}
+	memcpy (new->kva, old->kva, PGSIZE);
+	new->page = page;
+	new->owner = curr;
+	page->frame = new;
+	pml4_set_page (curr->pml4, page->va, new->kva, true);
+	cow_cnt++;
+
+	/* Another sharer takes OLD over if PAGE was its page. */
+	if (!vm_frame_put (old, page))
+		vm_frame_unpin (old);
+	vm_frame_unpin (new);
+	return true;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user, bool write, bool not_present) {
+vm_try_handle_fault (struct intr_frame *f, void *addr, bool user, bool write, bool not_present) {
+	int64_t start = timer_ns ();
+	bool handled = vm_handle_fault (f, addr, user, write, not_present);
+
+	fault_ns += timer_ns () - start;
+	return handled;
+}
+
+/* Handles a fault at ADDR for vm_try_handle_fault(). */
+static bool
+vm_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user, bool write, bool not_present) {
 	struct thread *curr = thread_current();
 	struct supplemental_page_table *spt = &curr->spt;
 	struct page *page = spt_find_page(spt, addr);
+	fault_cnt++;
 	// Set rsp
 	void *rsp = f->rsp;
 	if (!user)         
@@ -220,6 +1076,8 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user, bool wr
 		return false;
 	}
 	else if (!not_present) {
+		if (write && page != NULL && page->writable && page->frame != NULL)
+			return vm_handle_wp (page);
 		return false;
 	}
 	/*  three cases of bogus page fault: 
@@ -231,11 +1089,153 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr, bool user, bool wr
 		// stack bottom > addr > LIMIT_STACK_SIZE && user addr
 		if (USER_STACK - ((uintptr_t)rsp - 8) < LIMIT_STACK_SIZE && rsp-8 <= addr && addr < USER_STACK) {
 			vm_stack_growth(addr);
-			return true;
+			page = spt_find_page(spt, addr);
 		}
+		if (page == NULL)
+			return false;
+	}
+
+	/* Never written: reading it needs no frame of its own. */
+	if (!write && vm_page_is_zero (page))
+		return vm_map_zero (page);
+
+	/* case 2: swapped out - read the process's pages in the slots
+	   around it along with it. */
+	struct page *ahead[SWAP_READAHEAD];
+	size_t ahead_cnt = 0;
+
+	if (VM_TYPE (page->operations->type) == VM_ANON && page->frame == NULL)
+		ahead_cnt = anon_swap_neighbours (page, ahead, SWAP_READAHEAD);
+	if (!vm_do_claim_page (page))
 		return false;
+	vm_swap_readahead (ahead, ahead_cnt);
+	vm_try_collapse (page);
+	return true;
+}
+
+/* Swaps in PAGES, of the current process, ahead of faults on
+ * them, as long as there are free frames.  Never evicts. */
+static void
+vm_swap_readahead (struct page **pages, size_t cnt) {
+	for (size_t i = 0; i < cnt; i++) {
+		struct frame *frame;
+
+		if (pages[i]->frame != NULL)
+			continue;
+		frame = vm_get_free_frame (pages[i]);
+		if (frame == NULL)
+			break;
+		if (!vm_map_frame (pages[i], frame, false))
+			break;
+		readahead_cnt++;
+	}
+}
+
+/* Returns true if P, page I of the 2 MB region at BASE of the
+ * current process, may be part of a 2 MB page mapped to BLOCK
+ * with WRITABLE: anonymous, resident at page I of BLOCK, and in a
+ * frame that no other page shares. */
+static bool
+vm_collapsible (struct page *p, uint8_t *block, size_t i, bool writable) {
+	return p != NULL && VM_TYPE (p->operations->type) == VM_ANON
+		&& p->writable == writable && p->frame != NULL
+		&& p->frame != &zero_frame && p->frame->kva == block + i * PGSIZE
+		&& p->frame->share_cnt == 1 && p->frame->page == p;
+}
+
+/* Maps the 2 MB region around PAGE, just faulted in, with a single
+ * 2 MB page once every page in it is resident, anonymous, of
+ * PAGE's permissions, mapped by the current process alone, and in
+ * one aligned block of the user pool, where vm_place_frame() puts
+ * them.  Frames are never copied into place here, which would
+ * stall the fault on a 2 MB copy.  File pages are left alone:
+ * their dirty bit would apply to the whole 2 MB, all of which
+ * would be written back.  Each page keeps its struct frame, so
+ * the clock sees no change, and clearing or remapping any page of
+ * the region splits it back in threads/mmu.c. */
+static void
+vm_try_collapse (struct page *page) {
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &curr->spt;
+	uint8_t *base = (uint8_t *) ((uint64_t) page->va & ~(HUGE_PGSIZE - 1));
+	size_t idx = ((uint64_t) page->va & (HUGE_PGSIZE - 1)) / PGSIZE;
+	uint8_t *block;
+	bool ok = true;
+	size_t pinned, i;
+
+	if (VM_TYPE (page->operations->type) != VM_ANON || page->frame == NULL)
+		return;
+	block = (uint8_t *) page->frame->kva - idx * PGSIZE;
+	if (((uint64_t) block & (HUGE_PGSIZE - 1)) != 0
+			|| base + HUGE_PGSIZE > (uint8_t *) KERN_BASE
+			|| pml4_is_huge (curr->pml4, base))
+		return;
+
+	/* Unlocked look first, from the end, which a region filling up
+	   in order reaches last. */
+	for (i = HUGE_PGPAGES; i-- > 0; )
+		if (!vm_collapsible (spt_find_page (spt, base + i * PGSIZE), block, i,
+					page->writable))
+			return;
+
+	/* Pin the frames, so that they hold still, and look again. */
+	for (pinned = 0; ok && pinned < HUGE_PGPAGES; pinned++) {
+		struct page *p = spt_find_page (spt, base + pinned * PGSIZE);
+
+		if (!vm_frame_pin (p))
+			break;
+		ok = vm_collapsible (p, block, pinned, page->writable);
 	}
-	return vm_do_claim_page (page);
+	ok = ok && pinned == HUGE_PGPAGES;
+
+	/* Anonymous pages are always written out whole, so the dirty
+	   bit, which now covers the whole 2 MB, does not matter. */
+	if (ok && pml4_set_huge_page (curr->pml4, base, block, page->writable))
+		huge_cnt++;
+
+	for (i = 0; i < pinned; i++)
+		vm_frame_unpin (spt_find_page (spt, base + i * PGSIZE)->frame);
+}
+
+/* Returns a free page of the user pool for PAGE, of the current
+ * process, to be faulted into, where its 2 MB region can later be
+ * mapped in place with a single 2 MB page: next to a neighbour's
+ * frame if that lies where it would in an aligned block, or else
+ * in a wholly free aligned block.  Returns a null pointer if
+ * PAGE is not anonymous or there is no such page. */
+static void *
+vm_place_frame (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t idx = ((uint64_t) page->va & (HUGE_PGSIZE - 1)) / PGSIZE;
+	uint8_t *want = NULL;
+
+	if (page_get_type (page) != VM_ANON)
+		return NULL;
+
+	/* FRAME_TABLE_LOCK keeps the neighbours' frames from being
+	   freed under us. */
+	lock_acquire (&frame_table_lock);
+	for (int d = -1; d <= 1 && want == NULL; d += 2) {
+		struct page *n;
+		uint8_t *block;
+
+		if ((d < 0 && idx == 0) || (d > 0 && idx == HUGE_PGPAGES - 1))
+			continue;
+		n = spt_find_page (spt, (uint8_t *) page->va + d * PGSIZE);
+		if (n == NULL || n->frame == NULL || n->frame == &zero_frame)
+			continue;
+		block = (uint8_t *) n->frame->kva - (idx + d) * PGSIZE;
+		if (((uint64_t) block & (HUGE_PGSIZE - 1)) != 0) {
+			lock_release (&frame_table_lock);
+			return NULL;
+		}
+		want = block + idx * PGSIZE;
+	}
+	lock_release (&frame_table_lock);
+
+	if (want != NULL)
+		return palloc_get_at (PAL_USER, want);
+	return palloc_get_in_block (PAL_USER, HUGE_PGPAGES, idx);
 }
 
 /* Free the page.
@@ -246,20 +1246,6 @@ vm_dealloc_page (struct page *page) {
 	free (page);
 }
 
-void
-update_lru_cache(struct list *fcfs_cache, struct list_elem *fcfs_elem) {
-	if (!list_empty (fcfs_cache)) {
-		for (struct list_elem *e = list_rbegin (fcfs_cache); e != list_rend (fcfs_cache); e = list_prev (e)) {
-			if (e == fcfs_elem) {
-				list_remove(e);
-				break;
-			}
-		}
-	}
-	// not in list or list emtpy
-	list_push_back(fcfs_cache, fcfs_elem);
-}
-
 /* Claim the page that allocate on VA. */
 bool
 vm_claim_page (void *va) {
@@ -271,24 +1257,55 @@ vm_claim_page (void *va) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	return vm_claim_frame (page, false);
+}
+
+/* Claims PAGE.  If KEEP_PINNED, and PAGE gets a frame of its own,
+ * leaves the frame pinned for the caller to unpin. */
+static bool
+vm_claim_frame (struct page *page, bool keep_pinned) {
+	/* The page may be on its way out, or have been mapped back if
+	   there was nowhere to put it. */
+	vm_frame_wait (page);
+	if (page->frame != NULL)
+		return pml4_set_page (thread_current ()->pml4, page->va,
+				page->frame->kva, page->writable);
+
+	/* Another process may have this file page in memory already. */
+	if (page_get_type (page) == VM_FILE && file_backed_attach (page))
+		return true;
+
+	struct frame *frame = vm_get_free_frame (page);
+	if (frame == NULL)
+		frame = vm_get_frame ();
 	if (frame == NULL)
 		return false;
-		
+	return vm_map_frame (page, frame, keep_pinned);
+}
+
+/* Maps PAGE to FRAME, just taken pinned from vm_get_frame(), and
+ * reads PAGE in.  Unpins FRAME unless KEEP_PINNED and successful. */
+static bool
+vm_map_frame (struct page *page, struct frame *frame, bool keep_pinned) {
 	struct thread *curr = thread_current();
 
 	/* Set links */
 	frame->page = page;
+	frame->owner = curr;
 	page->frame = frame;
 
 	
 	/* Insert page table entry to map page's VA to frame's PA - implemented project 3 */
 	pml4_set_page(curr->pml4, page->va, frame->kva, page->writable);
-	
-	list_push_back(&curr->fcfs_cache, &frame->fcfs_elem);
-	// update_lru_cache(&curr->fcfs_cache, &frame->fcfs_elem);
 
-	return swap_in (page, frame->kva);
+	if (VM_TYPE (page->operations->type) != VM_UNINIT)
+		swap_in_cnt++;
+	bool success = swap_in (page, frame->kva);
+
+	/* Unless the page now shares another process's frame. */
+	if (page->frame == frame && !(keep_pinned && success))
+		vm_frame_unpin (frame);
+	return success;
 }
 
 /* Initialize new supplemental page table 
@@ -303,7 +1320,7 @@ find what data should be there.
 */
 void
 supplemental_page_table_init (struct supplemental_page_table *spt) {
-	hash_init(&spt->spt_ht, page_hash, page_less, NULL);
+	spt->root = NULL;
 }
 
 /* Copies the supplemental page table from src to dst. 
@@ -319,15 +1336,21 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src) {
 	
 	// Iterate through each page in the source's supplemental page table
-	struct hash_iterator i;
-	hash_first(&i, &src->spt_ht);
+	struct page *src_page;
+	int64_t start = timer_ns ();
 
-	while (hash_next(&i)) {
-		struct page *src_page = hash_entry(hash_cur(&i), struct page, page_elem);
+	for (src_page = spt_first_page (src, NULL, (void *) KERN_BASE);
+			src_page != NULL;
+			src_page = spt_first_page (src, src_page->va + PGSIZE, (void *) KERN_BASE)) {
 
         // Create a new page for the destination supplemental page table
 		switch(VM_TYPE(src_page->operations->type)) {
 			case VM_UNINIT :{
+				if (VM_TYPE(src_page->uninit.type) == VM_FILE) {
+					if (!file_backed_copy(src, src_page))
+						return false;
+					break;
+				}
 				// allocate uninit page and claim them
 				vm_alloc_page_with_initializer(src_page->uninit.type, src_page->va,
 					src_page->writable, src_page->uninit.init, src_page->uninit.aux);
@@ -341,46 +1364,44 @@ supplemental_page_table_copy (struct supplemental_page_table *dst,
 					return false;
 				}
 
-				if (!vm_do_claim_page(dst_page)) {
-					return false;
+				/* Share the parent's frame read-only in both; the
+				   first write copies it in vm_handle_wp(). */
+				if (vm_frame_pin(src_page)) {
+					struct frame *frame = src_page->frame;
+
+					anon_initializer(dst_page, VM_ANON, frame->kva);
+					vm_frame_share(frame, dst_page);
+					pml4_set_page(src_page->anon.thread->pml4, src_page->va, frame->kva, false);
+					pml4_set_page(thread_current()->pml4, dst_page->va, frame->kva, false);
+					vm_frame_unpin(frame);
+					break;
 				}
 
-				memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
+				/* Swapped out: the child shares the parent's slot,
+				   and each reads it in on its first touch. */
+				anon_initializer(dst_page, VM_ANON, NULL);
+				anon_share_swapped(src_page, dst_page);
 				break;
 			}
 			case VM_FILE :{
-				vm_alloc_page(src_page->operations->type, src_page->va, src_page->writable);
-
-				struct page *dst_page = spt_find_page(dst, src_page->va);
-				if (dst_page == NULL) {
+				// shares the parent's frame on first touch
+				if (!file_backed_copy(src, src_page))
 					return false;
-				}
-
-				if (!vm_do_claim_page(dst_page)) {
-					return false;
-				}
-
-				memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
-
-				list_push_back(&thread_current()->fcfs_cache, &dst_page->frame->fcfs_elem);
 				break;
 			}
 			default :
 				break;
 		}
 	}
+	fork_ns += timer_ns () - start;
+	fork_cnt++;
 	return true;
 }
 
-static void spt_destroy(struct hash_elem *e, void *aux UNUSED) {
-    const struct page *page = hash_entry(e, struct page, page_elem);
-    vm_dealloc_page(page);
-}
-
 /* Free the resource hold by the supplemental page table */
 void
 supplemental_page_table_kill (struct supplemental_page_table *spt) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
-	hash_clear(&spt->spt_ht, spt_destroy);
+	spt_remove_range (spt, NULL, (void *) KERN_BASE);
 }